@@ -92,6 +92,7 @@ enum {
 };
 
 struct SHA256Context;
+struct VFH256Context;
 struct VSC_C_lck;
 struct ban;
 struct busyobj;
@@ -106,6 +107,7 @@ struct objhead;
 struct pool;
 struct poolparam;
 struct sess;
+struct sesscache;
 struct sesspool;
 struct vbc;
 struct vbo;
@@ -165,7 +167,9 @@ struct http {
 	unsigned		magic;
 #define HTTP_MAGIC		0x6428b5c9
 
-	enum httpwhence		logtag;
+	uint8_t			logtag;		/* enum httpwhence */
+	uint8_t			hixbits;	/* Header name index, 0: none */
+	uint16_t		gen;		/* Bumped when headers move */
 
 	struct ws		*ws;
 	txt			*hd;
@@ -192,7 +196,9 @@ struct http_conn {
 	unsigned		maxhdr;
 	struct ws		*ws;
 	txt			rxbuf;
+	const char		*rxscan;	/* end of line scan got to */
 	txt			pipeline;
+	unsigned		nread;		/* read(2) calls, for stats */
 };
 
 /*--------------------------------------------------------------------*/
@@ -305,6 +311,7 @@ struct worker {
 	struct waitinglist	*nwaitinglist;
 	struct vbo		*nvbo;
 	void			*nhashpriv;
+	struct sesscache	*nsesscache;
 	struct dstat		stats;
 
 	/* Pool stuff */
@@ -326,6 +333,7 @@ struct worker {
 
 	/* Lookup stuff */
 	struct SHA256Context	*sha256ctx;
+	struct VFH256Context	*vfh256ctx;
 
 	struct ws		ws[1];
 
@@ -361,6 +369,10 @@ struct worker {
 #define RES_ESI_CHILD		(1<<5)
 #define RES_GUNZIP		(1<<6)
 
+	/* resp hd[] slots below this are covered by obj->objcore->hdrblk */
+	uint16_t		res_hdrblk;
+	uint16_t		res_hdrgen;
+
 	/* Temporary accounting */
 	struct acct		acct_tmp;
 };
@@ -429,14 +441,34 @@ struct objcore {
 	unsigned		flags;
 #define OC_F_BUSY		(1<<1)
 #define OC_F_PASS		(1<<2)
+#define OC_F_VARY		(1<<3)		/* In objhead vary index */
 #define OC_F_LRUDONTMOVE	(1<<4)
 #define OC_F_PRIV		(1<<5)		/* Stevedore private flag */
 #define OC_F_LURK		(3<<6)		/* Ban-lurker-color */
 	unsigned		timer_idx;
 	VTAILQ_ENTRY(objcore)	list;
+	VTAILQ_ENTRY(objcore)	vary_list;
+	uint32_t		vary_fp;
 	VTAILQ_ENTRY(objcore)	lru_list;
 	VTAILQ_ENTRY(objcore)	ban_list;
 	struct ban		*ban;
+	struct hdrblk		*hdrblk;
+};
+
+/*--------------------------------------------------------------------
+ * Object headers serialized for delivery, see RES_HdrBlk().  Lives in
+ * the object workspace, but hangs off the objcore so objects without
+ * one keep their size.
+ */
+
+struct hdrblk {
+	unsigned		magic;
+#define HDRBLK_MAGIC		0x2c0e5e1b
+	unsigned		len;
+	char			*blk;
+	uint16_t		gen;		/* of obj->http when built */
+	uint16_t		nhd;		/* of obj->http when built */
+	uint16_t		n;		/* headers in the block */
 };
 
 static inline unsigned
@@ -526,6 +558,7 @@ struct busyobj {
 	struct vef_priv		*vef_priv;
 
 	unsigned		should_close;
+	unsigned		first_byte_tmo;	/* Timed out while parked */
 	char			*h_content_length;
 
 	unsigned		do_esi;
@@ -591,6 +624,10 @@ struct req {
 	/* The busy objhead we sleep on */
 	struct objhead		*hash_objhead;
 
+	/* The fetch we wait for without a worker, see FetchPark() */
+	struct busyobj		*fetch_bo;
+	struct objcore		*fetch_oc;
+
 	/* Built Vary string */
 	uint8_t			*vary_b;
 	uint8_t			*vary_l;
@@ -614,6 +651,13 @@ struct req {
 	uint64_t		req_bodybytes;
 	char			*ws_req;	/* WS above request data */
 
+	/* The request body, see FetchReqBody() */
+	uint8_t			reqbody;
+#define REQBODY_UNREAD		0
+#define REQBODY_TAKEN		1
+#define REQBODY_CACHED		2
+	struct storagehead	body;
+
 	double			t_resp;
 
 	struct http_conn	htc[1];
@@ -631,7 +675,8 @@ struct sess {
 
 	struct worker		*wrk;
 	struct req		*req;
-	struct sessmem		*mem;
+	struct sessmem		*mem;		/* NULL while idle */
+	struct sesspool		*sesspool;
 
 	/* Session related fields ------------------------------------*/
 
@@ -649,9 +694,11 @@ struct sess {
 	char			port[PORT_BUFSIZE];
 
 	VTAILQ_ENTRY(sess)	poollist;
+	double			t_sched;	/* Pool_Schedule, VTIM_mono */
 	struct acct		acct_ses;
 
 	VTAILQ_ENTRY(sess)	list;
+	unsigned		wslot;		/* cache_waiter_wheel.c */
 
 	/* Timestamps, all on TIM_real() timescale */
 	double			t_open;		/* fd accepted */
@@ -681,8 +728,9 @@ struct sess {
 void VCA_Init(void);
 void VCA_Shutdown(void);
 int VCA_Accept(struct listen_sock *ls, struct wrk_accept *wa);
-void VCA_SetupSess(struct worker *w);
-void VCA_FailSess(struct worker *w);
+int VCA_AcceptMore(struct listen_sock *ls, struct wrk_accept *wa);
+void VCA_SetupSess(struct worker *w, struct sess *sp, struct wrk_accept *wa);
+void VCA_FailSess(struct worker *w, struct wrk_accept *wa);
 
 /* cache_backend.c */
 void VBE_UseHealth(const struct director *vdi);
@@ -760,9 +808,13 @@ struct storage *FetchStorage(struct worker *w, ssize_t sz);
 int FetchError(struct worker *w, const char *error);
 int FetchError2(struct worker *w, const char *error, const char *more);
 int FetchHdr(struct sess *sp, int need_host_hdr);
+int FetchResp(struct sess *sp);
+int FetchPark(struct sess *sp);
 int FetchBody(struct worker *w, struct object *obj);
 int FetchReqBody(struct sess *sp);
+void FetchReqBodyFree(struct req *req);
 void Fetch_Init(void);
+void Fetch_ParkInit(void);
 
 /* cache_gzip.c */
 struct vgz;
@@ -792,12 +844,18 @@ int VGZ_WrwGunzip(struct worker *w, struct vgz *, const void *ibuf,
 unsigned HTTP_estimate(unsigned nhttp);
 void HTTP_Copy(struct http *to, const struct http * const fm);
 struct http *HTTP_create(void *p, uint16_t nhttp);
+unsigned HTTP_estimate_noindex(unsigned nhttp);
+struct http *HTTP_create_noindex(void *p, uint16_t nhttp);
 const char *http_StatusMessage(unsigned);
 unsigned http_EstimateWS(const struct http *fm, unsigned how, uint16_t *nhd);
 void HTTP_Init(void);
 void http_ClrHeader(struct http *to);
 unsigned http_Write(struct worker *w, unsigned vsl_id, const struct http *hp,
     int resp);
+unsigned http_WriteBlk(struct worker *w, unsigned vsl_id,
+    const struct http *hp, const char *blk, unsigned blklen, unsigned nblk);
+int http_HdrBlk(const struct http *hp, unsigned how, char **blk,
+    unsigned *len);
 void http_CopyResp(struct http *to, const struct http *fm);
 void http_SetResp(struct http *to, const char *proto, uint16_t status,
     const char *response);
@@ -830,6 +888,7 @@ uint16_t http_DissectResponse(struct worker *w, const struct http_conn *htc,
     struct http *sp);
 const char *http_DoConnection(const struct http *hp);
 void http_CopyHome(struct worker *w, unsigned vsl_id, const struct http *hp);
+int http_Rehome(struct http *hp, struct ws *ws);
 void http_Unset(struct http *hp, const char *hdr);
 void http_CollectHdr(struct http *hp, const char *hdr);
 
@@ -890,6 +949,7 @@ void PAN_Init(void);
 
 /* cache_pipe.c */
 void PipeSession(struct sess *sp);
+void Pipe_Init(void);
 
 /* cache_pool.c */
 void Pool_Init(void);
@@ -909,6 +969,10 @@ unsigned WRW_WriteH(struct worker *w, const txt *hh, const char *suf);
 void WRW_Sendfile(struct worker *w, int fd, off_t off, unsigned len);
 #endif  /* SENDFILE_WORKS */
 
+/* cache_sender.c */
+void SND_Deliver(struct sess *sp, ssize_t low, ssize_t high);
+void SND_Init(void);
+
 /* cache_session.c [SES] */
 struct sess *SES_New(struct worker *wrk, struct sesspool *pp);
 struct sess *SES_Alloc(void);
@@ -919,8 +983,12 @@ struct sesspool *SES_NewPool(struct pool *pp, unsigned pool_no);
 void SES_DeletePool(struct sesspool *sp, struct worker *wrk);
 int SES_Schedule(struct sess *sp);
 void SES_Handle(struct sess *sp, double now);
+unsigned SES_PoolNo(const struct sess *sp);
 void SES_GetReq(struct sess *sp);
 void SES_ReleaseReq(struct sess *sp);
+void SES_Cleanup(struct worker *wrk);
+struct sess *SES_Detach(struct sess *sp);
+struct sess *SES_Attach(struct sess *sp);
 
 /* cache_shmlog.c */
 extern struct VSC_C_main *VSC_C_main;
@@ -959,7 +1027,8 @@ void WSL_Flush(struct worker *w, int overflow);
 
 /* cache_response.c */
 void RES_BuildHttp(const struct sess *sp);
-void RES_WriteObj(struct sess *sp);
+void RES_HdrBlk(struct object *o);
+int RES_WriteObj(struct sess *sp);
 void RES_StreamStart(struct sess *sp);
 void RES_StreamEnd(struct sess *sp);
 void RES_StreamPoll(struct worker *);
@@ -967,6 +1036,9 @@ void RES_StreamPoll(struct worker *);
 /* cache_vary.c */
 struct vsb *VRY_Create(const struct sess *sp, const struct http *hp);
 int VRY_Match(struct sess *sp, const uint8_t *vary);
+uint8_t *VRY_Spec(const uint8_t *vary);
+int VRY_SameHeaders(const uint8_t *v1, const uint8_t *v2);
+uint32_t VRY_Fingerprint(const uint8_t *vary);
 void VRY_Validate(const uint8_t *vary);
 
 /* cache_vcl.c */
@@ -1028,6 +1100,7 @@ int RFC2616_Do_Cond(const struct sess *sp);
 struct object *STV_NewObject(struct worker *wrk, const char *hint, unsigned len,
     uint16_t nhttp);
 struct storage *STV_alloc(struct worker *w, size_t size);
+struct storage *STV_AllocTransient(size_t size);
 void STV_trim(struct storage *st, size_t size);
 void STV_free(struct storage *st);
 void STV_open(void);
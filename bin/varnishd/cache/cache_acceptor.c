@@ -35,12 +35,19 @@
  * Once the session is allocated we move into it with a call to
  * VCA_SetupSess().
  *
+ * With accept_batch > 1 the listen sockets are non-blocking, and the
+ * worker which woke up drains further connections with VCA_AcceptMore().
+ *
  * If we fail to allocate a session we call VCA_FailSess() to clean up
  * and initiate pacing.
  */
 
 #include "config.h"
 
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdlib.h>
+
 #include "cache.h"
 #include "common/heritage.h"
 
@@ -53,6 +60,7 @@ static pthread_t	VCA_thread;
 static struct timeval	tv_sndtimeo;
 static struct timeval	tv_rcvtimeo;
 static int hack_ready;
+static unsigned vca_batch;
 static double vca_pace = 0.0;
 static struct lock pace_mtx;
 
@@ -174,9 +182,29 @@ vca_pace_good(void)
  * Accept on a listen socket, and handle error returns.
  */
 
+static void
+vca_accept_fail(const struct listen_sock *ls)
+{
+
+	switch (errno) {
+	case ECONNABORTED:
+		break;
+	case EMFILE:
+		VSL(SLT_Debug, ls->sock, "Too many open files");
+		vca_pace_bad();
+		break;
+	default:
+		VSL(SLT_Debug, ls->sock, "Accept failed: %s",
+		    strerror(errno));
+		vca_pace_bad();
+		break;
+	}
+}
+
 int
 VCA_Accept(struct listen_sock *ls, struct wrk_accept *wa)
 {
+	struct pollfd pfd;
 	int i;
 
 	CHECK_OBJ_NOTNULL(ls, LISTEN_SOCK_MAGIC);
@@ -185,24 +213,45 @@ VCA_Accept(struct listen_sock *ls, struct wrk_accept *wa)
 	while(!hack_ready)
 		(void)usleep(100*1000);
 
-	wa->acceptaddrlen = sizeof wa->acceptaddr;
-	i = accept(ls->sock, (void*)&wa->acceptaddr, &wa->acceptaddrlen);
-
-	if (i < 0) {
-		switch (errno) {
-		case ECONNABORTED:
-			break;
-		case EMFILE:
-			VSL(SLT_Debug, ls->sock, "Too many open files");
-			vca_pace_bad();
-			break;
-		default:
-			VSL(SLT_Debug, ls->sock, "Accept failed: %s",
-			    strerror(errno));
-			vca_pace_bad();
+	while (1) {
+		wa->acceptaddrlen = sizeof wa->acceptaddr;
+		i = accept(ls->sock, (void*)&wa->acceptaddr,
+		    &wa->acceptaddrlen);
+		if (i >= 0 || !vca_batch ||
+		    (errno != EAGAIN && errno != EWOULDBLOCK))
 			break;
-		}
+		/* Non-blocking listen socket, wait for a connection */
+		pfd.fd = ls->sock;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		(void)poll(&pfd, 1, -1);
 	}
+
+	if (i < 0)
+		vca_accept_fail(ls);
+	wa->acceptlsock = ls;
+	wa->acceptsock = i;
+	return (i);
+}
+
+/*--------------------------------------------------------------------
+ * Accept another connection, if one is ready, after VCA_Accept().
+ *
+ * Returns -1 without pacing if none are, or if we are not batching.
+ */
+
+int
+VCA_AcceptMore(struct listen_sock *ls, struct wrk_accept *wa)
+{
+	int i;
+
+	CHECK_OBJ_NOTNULL(ls, LISTEN_SOCK_MAGIC);
+	if (!vca_batch || ls->sock < 0 || vca_pace > 0.0)
+		return (-1);
+	wa->acceptaddrlen = sizeof wa->acceptaddr;
+	i = accept(ls->sock, (void*)&wa->acceptaddr, &wa->acceptaddrlen);
+	if (i < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+		vca_accept_fail(ls);
 	wa->acceptlsock = ls;
 	wa->acceptsock = i;
 	return (i);
@@ -220,13 +269,11 @@ VCA_Accept(struct listen_sock *ls, struct wrk_accept *wa)
  */
 
 void
-VCA_FailSess(struct worker *w)
+VCA_FailSess(struct worker *w, struct wrk_accept *wa)
 {
-	struct wrk_accept *wa;
 
 	CHECK_OBJ_NOTNULL(w, WORKER_MAGIC);
-	CAST_OBJ_NOTNULL(wa, (void*)w->ws->f, WRK_ACCEPT_MAGIC);
-	AZ(w->sp);
+	CHECK_OBJ_NOTNULL(wa, WRK_ACCEPT_MAGIC);
 	AZ(close(wa->acceptsock));
 	w->stats.sess_drop++;
 	vca_pace_bad();
@@ -237,15 +284,12 @@ VCA_FailSess(struct worker *w)
  */
 
 void
-VCA_SetupSess(struct worker *w)
+VCA_SetupSess(struct worker *w, struct sess *sp, struct wrk_accept *wa)
 {
-	struct sess *sp;
-	struct wrk_accept *wa;
 
 	CHECK_OBJ_NOTNULL(w, WORKER_MAGIC);
-	CAST_OBJ_NOTNULL(wa, (void*)w->ws->f, WRK_ACCEPT_MAGIC);
-	sp = w->sp;
 	CHECK_OBJ_NOTNULL(sp, SESS_MAGIC);
+	CHECK_OBJ_NOTNULL(wa, WRK_ACCEPT_MAGIC);
 	sp->fd = wa->acceptsock;
 	sp->vsl_id = wa->acceptsock | VSL_CLIENTMARKER ;
 	wa->acceptsock = -1;
@@ -257,6 +301,12 @@ VCA_SetupSess(struct worker *w)
 	assert(wa->acceptaddrlen <= sp->sockaddrlen);
 	memcpy(&sp->sockaddr, &wa->acceptaddr, wa->acceptaddrlen);
 	sp->sockaddrlen = wa->acceptaddrlen;
+	if (sp->mylsock->myaddr != NULL) {
+		assert(sp->mylsock->myaddrlen <= sp->mysockaddrlen);
+		memcpy(&sp->mysockaddr, sp->mylsock->myaddr,
+		    sp->mylsock->myaddrlen);
+		sp->mysockaddrlen = sp->mylsock->myaddrlen;
+	}
 	vca_pace_good();
 	w->stats.sess_conn++;
 
@@ -277,6 +327,60 @@ VCA_SetupSess(struct worker *w)
 #endif
 }
 
+/*--------------------------------------------------------------------
+ * Set a socket option on a listen socket and its SO_REUSEPORT shards
+ */
+
+static void
+vca_sockopt(const struct listen_sock *ls, int opt, const void *val,
+    socklen_t len)
+{
+	unsigned u;
+
+	AZ(setsockopt(ls->sock, SOL_SOCKET, opt, val, len));
+	for (u = 0; u < ls->nshard; u++)
+		AZ(setsockopt(ls->shard[u]->sock, SOL_SOCKET, opt, val, len));
+}
+
+/*--------------------------------------------------------------------
+ * Connections to a listen socket bound to a specific address all have
+ * that address as their local address, so we can spare the sessions a
+ * getsockname(2) each.
+ */
+
+static void
+vca_myaddr(struct listen_sock *ls)
+{
+	struct sockaddr_storage ss;
+	socklen_t sl;
+	unsigned u;
+
+	sl = sizeof ss;
+	AZ(getsockname(ls->sock, (void*)&ss, &sl));
+	switch (ss.ss_family) {
+	case AF_INET:
+		if (((struct sockaddr_in*)&ss)->sin_addr.s_addr ==
+		    htonl(INADDR_ANY))
+			return;
+		break;
+	case AF_INET6:
+		if (IN6_IS_ADDR_UNSPECIFIED(
+		    &((struct sockaddr_in6*)&ss)->sin6_addr))
+			return;
+		break;
+	default:
+		return;
+	}
+	ls->myaddr = malloc(sizeof *ls->myaddr);
+	XXXAN(ls->myaddr);
+	memcpy(ls->myaddr, &ss, sl);
+	ls->myaddrlen = sl;
+	for (u = 0; u < ls->nshard; u++) {
+		ls->shard[u]->myaddr = ls->myaddr;
+		ls->shard[u]->myaddrlen = sl;
+	}
+}
+
 /*--------------------------------------------------------------------*/
 
 static void *
@@ -290,16 +394,27 @@ vca_acct(void *arg)
 #endif
 	struct listen_sock *ls;
 	double t0, now;
+	unsigned u;
 
 	THR_SetName("cache-acceptor");
 	(void)arg;
 
+	vca_batch = cache_param->accept_batch > 1;
+
 	VTAILQ_FOREACH(ls, &heritage.socks, list) {
 		if (ls->sock < 0)
 			continue;
 		AZ(listen(ls->sock, cache_param->listen_depth));
-		AZ(setsockopt(ls->sock, SOL_SOCKET, SO_LINGER,
-		    &linger, sizeof linger));
+		for (u = 0; u < ls->nshard; u++)
+			AZ(listen(ls->shard[u]->sock,
+			    cache_param->listen_depth));
+		vca_sockopt(ls, SO_LINGER, &linger, sizeof linger);
+		vca_myaddr(ls);
+		if (vca_batch) {
+			AZ(VTCP_nonblocking(ls->sock));
+			for (u = 0; u < ls->nshard; u++)
+				AZ(VTCP_nonblocking(ls->shard[u]->sock));
+		}
 	}
 
 	hack_ready = 1;
@@ -316,9 +431,8 @@ vca_acct(void *arg)
 			VTAILQ_FOREACH(ls, &heritage.socks, list) {
 				if (ls->sock < 0)
 					continue;
-				AZ(setsockopt(ls->sock, SOL_SOCKET,
-				    SO_SNDTIMEO,
-				    &tv_sndtimeo, sizeof tv_sndtimeo));
+				vca_sockopt(ls, SO_SNDTIMEO,
+				    &tv_sndtimeo, sizeof tv_sndtimeo);
 			}
 		}
 #endif
@@ -330,9 +444,8 @@ vca_acct(void *arg)
 			VTAILQ_FOREACH(ls, &heritage.socks, list) {
 				if (ls->sock < 0)
 					continue;
-				AZ(setsockopt(ls->sock, SOL_SOCKET,
-				    SO_RCVTIMEO,
-				    &tv_rcvtimeo, sizeof tv_rcvtimeo));
+				vca_sockopt(ls, SO_RCVTIMEO,
+				    &tv_rcvtimeo, sizeof tv_rcvtimeo);
 			}
 		}
 #endif
@@ -408,11 +521,17 @@ void
 VCA_Shutdown(void)
 {
 	struct listen_sock *ls;
+	unsigned u;
 	int i;
 
 	VTAILQ_FOREACH(ls, &heritage.socks, list) {
 		if (ls->sock < 0)
 			continue;
+		for (u = 0; u < ls->nshard; u++) {
+			i = ls->shard[u]->sock;
+			ls->shard[u]->sock = -1;
+			(void)close(i);
+		}
 		i = ls->sock;
 		ls->sock = -1;
 		(void)close(i);
@@ -69,7 +69,6 @@ DOT acceptor -> first [style=bold,color=green]
 #include "hash/hash_slinger.h"
 #include "vcl.h"
 #include "vcli_priv.h"
-#include "vsha256.h"
 #include "vtcp.h"
 #include "vtim.h"
 
@@ -99,7 +98,7 @@ DOT }
 static int
 cnt_wait(struct sess *sp)
 {
-	int i, j, tmo;
+	int i, j, tmo, pend;
 	struct pollfd pfd[1];
 	struct worker *wrk;
 	double now, when;
@@ -122,12 +121,22 @@ cnt_wait(struct sess *sp)
 
 	assert(!isnan(sp->t_req));
 	tmo = (int)(1e3 * cache_param->timeout_linger);
+	/*
+	 * If we already hold some of the request, from pipelining or
+	 * because the waiter read it, see if it is complete before polling.
+	 */
+	pend = Tlen(sp->req->htc->rxbuf) > 0;
 	while (1) {
-		pfd[0].fd = sp->fd;
-		pfd[0].events = POLLIN;
-		pfd[0].revents = 0;
-		j = poll(pfd, 1, tmo);
-		assert(j >= 0);
+		if (pend) {
+			pend = 0;
+			j = 0;
+		} else {
+			pfd[0].fd = sp->fd;
+			pfd[0].events = POLLIN;
+			pfd[0].revents = 0;
+			j = poll(pfd, 1, tmo);
+			assert(j >= 0);
+		}
 		now = VTIM_real();
 		if (j != 0)
 			i = HTC_Rx(sp->req->htc);
@@ -337,6 +346,7 @@ static int
 cnt_deliver(struct sess *sp)
 {
 	struct worker *wrk;
+	int i;
 
 	CHECK_OBJ_NOTNULL(sp, SESS_MAGIC);
 	wrk = sp->wrk;
@@ -346,12 +356,15 @@ cnt_deliver(struct sess *sp)
 	sp->req->director = NULL;
 	sp->req->restarts = 0;
 
-	RES_WriteObj(sp);
+	i = RES_WriteObj(sp);
 
 	assert(WRW_IsReleased(wrk));
 	assert(wrk->wrw.ciov == wrk->wrw.siov);
 	(void)HSH_Deref(wrk, NULL, &wrk->obj);
 	http_Setup(wrk->resp, NULL);
+	if (i)
+		/* The sender has the session, and will reschedule it */
+		return (1);
 	sp->step = STP_DONE;
 	return (0);
 }
@@ -426,6 +439,7 @@ cnt_done(struct sess *sp)
 	sp->req->t_resp = NAN;
 
 	sp->req->req_bodybytes = 0;
+	FetchReqBodyFree(sp->req);
 
 	sp->req->hash_always_miss = 0;
 	sp->req->hash_ignore_busy = 0;
@@ -600,18 +614,39 @@ cnt_fetch(struct sess *sp)
 	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
 
 	CHECK_OBJ_NOTNULL(sp->req->vcl, VCL_CONF_MAGIC);
-	CHECK_OBJ_NOTNULL(wrk->busyobj, BUSYOBJ_MAGIC);
 
-	AN(sp->req->director);
-	AZ(wrk->busyobj->vbc);
-	AZ(wrk->busyobj->should_close);
-	AZ(wrk->storage_hint);
+	if (sp->req->fetch_bo != NULL) {
+		/* Back from FetchPark(), the request has been sent */
+		AZ(wrk->busyobj);
+		AZ(wrk->objcore);
+		wrk->busyobj = sp->req->fetch_bo;
+		sp->req->fetch_bo = NULL;
+		wrk->objcore = sp->req->fetch_oc;
+		sp->req->fetch_oc = NULL;
+		CHECK_OBJ_NOTNULL(wrk->busyobj, BUSYOBJ_MAGIC);
+		http_Setup(wrk->busyobj->beresp, wrk->ws);
+		need_host_hdr = 0;
+		i = FetchResp(sp);
+	} else {
+		CHECK_OBJ_NOTNULL(wrk->busyobj, BUSYOBJ_MAGIC);
+		AN(sp->req->director);
+		AZ(wrk->busyobj->vbc);
+		AZ(wrk->busyobj->should_close);
+		AZ(wrk->storage_hint);
 
-	http_Setup(wrk->busyobj->beresp, wrk->ws);
+		http_Setup(wrk->busyobj->beresp, wrk->ws);
 
-	need_host_hdr = !http_GetHdr(wrk->busyobj->bereq, H_Host, NULL);
+		need_host_hdr =
+		    !http_GetHdr(wrk->busyobj->bereq, H_Host, NULL);
 
-	i = FetchHdr(sp, need_host_hdr);
+		i = FetchHdr(sp, need_host_hdr);
+		if (i == 0 && cache_param->fetch_park &&
+		    sp->req->esi_level == 0 && !FetchPark(sp))
+			/* NB: sp is no longer ours */
+			return (1);
+		if (i == 0)
+			i = FetchResp(sp);
+	}
 	/*
 	 * If we recycle a backend connection, there is a finite chance
 	 * that the backend closed it before we get a request to it.
@@ -620,6 +655,8 @@ cnt_fetch(struct sess *sp)
 	if (i == 1) {
 		VSC_C_main->backend_retry++;
 		i = FetchHdr(sp, need_host_hdr);
+		if (i == 0)
+			i = FetchResp(sp);
 	}
 
 	if (i) {
@@ -820,6 +857,14 @@ cnt_fetchbody(struct sess *sp)
 	l = http_EstimateWS(wrk->busyobj->beresp,
 	    pass ? HTTPH_R_PASS : HTTPH_A_INS, &nhttp);
 
+	/*
+	 * Space for RES_HdrBlk() to go over the header lines again, with
+	 * CRNL, and the Content-Length: header added after the fetch.
+	 */
+	if (wrk->objcore != NULL && cache_param->obj_hdrblk)
+		l += l + 2 * nhttp + PRNDUP(sizeof (struct hdrblk)) +
+		    strlen("Content-Length: XxxXxxXxxXxxXxxXxx\r\n");
+
 	/* Create Vary instructions */
 	if (wrk->objcore != NULL) {
 		CHECK_OBJ_NOTNULL(wrk->objcore, OBJCORE_MAGIC);
@@ -934,6 +979,7 @@ cnt_fetchbody(struct sess *sp)
 	}
 
 	if (wrk->obj->objcore != NULL) {
+		RES_HdrBlk(wrk->obj);
 		EXP_Insert(wrk->obj);
 		AN(wrk->obj->objcore);
 		AN(wrk->obj->objcore->ban);
@@ -994,6 +1040,7 @@ cnt_streambody(struct sess *sp)
 	AN(sp->req->director);
 
 	if (!i && wrk->obj->objcore != NULL) {
+		RES_HdrBlk(wrk->obj);
 		EXP_Insert(wrk->obj);
 		AN(wrk->obj->objcore);
 		AN(wrk->obj->objcore->ban);
@@ -1047,8 +1094,9 @@ cnt_first(struct sess *sp)
 	VTCP_name(&sp->sockaddr, sp->sockaddrlen,
 	    sp->addr, sizeof sp->addr, sp->port, sizeof sp->port);
 	if (cache_param->log_local_addr) {
-		AZ(getsockname(sp->fd, (void*)&sp->mysockaddr,
-		    &sp->mysockaddrlen));
+		if (sp->mysockaddr.ss_family == AF_UNSPEC)
+			AZ(getsockname(sp->fd, (void*)&sp->mysockaddr,
+			    &sp->mysockaddrlen));
 		VTCP_name(&sp->mysockaddr, sp->mysockaddrlen,
 		    laddr, sizeof laddr, lport, sizeof lport);
 		WSP(sp, SLT_SessionOpen, "%s %s %s %s",
@@ -1381,6 +1429,12 @@ cnt_pass(struct sess *sp)
 	wrk->busyobj = VBO_GetBusyObj(wrk);
 	http_Setup(wrk->busyobj->bereq, wrk->ws);
 	http_FilterHeader(sp, HTTPH_R_PASS);
+	if (http_HdrIs(sp->http, H_Transfer_Encoding, "chunked")) {
+		/* FetchReqBody() passes the body on as it is */
+		http_Unset(wrk->busyobj->bereq, H_Content_Length);
+		http_SetHeader(wrk, sp->vsl_id, wrk->busyobj->bereq,
+		    "Transfer-Encoding: chunked");
+	}
 
 	wrk->connect_timeout = 0;
 	wrk->first_byte_timeout = 0;
@@ -1524,10 +1578,10 @@ cnt_recv(struct sess *sp)
 		}
 	}
 
-	SHA256_Init(wrk->sha256ctx);
+	HSH_DigestInit(wrk);
 	VCL_hash_method(sp);
 	assert(sp->req->handling == VCL_RET_HASH);
-	SHA256_Final(sp->req->digest, wrk->sha256ctx);
+	HSH_DigestFinal(wrk, sp->req->digest);
 
 	if (!strcmp(sp->http->hd[HTTP_HDR_REQ].b, "HEAD"))
 		sp->req->wantbody = 0;
@@ -1703,7 +1757,9 @@ CNT_Session(struct sess *sp)
 	    sp->step == STP_FIRST ||
 	    sp->step == STP_WAIT ||
 	    sp->step == STP_LOOKUP ||
-	    sp->step == STP_RECV);
+	    sp->step == STP_RECV ||
+	    sp->step == STP_FETCH ||
+	    sp->step == STP_DONE);
 
 	AZ(wrk->obj);
 	AZ(wrk->objcore);
@@ -90,6 +90,7 @@ ved_include(struct sess *sp, const char *src, const char *host)
 
 	/* Client content already taken care of */
 	http_Unset(sp->http, H_Content_Length);
+	http_Unset(sp->http, H_Transfer_Encoding);
 
 	sxid = sp->req->xid;
 	while (1) {
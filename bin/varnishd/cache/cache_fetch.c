@@ -30,15 +30,18 @@
 #include "config.h"
 
 #include <inttypes.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include "cache.h"
 
 #include "cache_backend.h"
+#include "hash/hash_slinger.h"
 #include "vcli_priv.h"
 #include "vct.h"
 #include "vtcp.h"
+#include "vtim.h"
 
 static unsigned fetchfrag;
 
@@ -245,65 +248,128 @@ fetch_straight(struct worker *wrk, struct http_conn *htc, ssize_t cl)
 /*--------------------------------------------------------------------
  * Read a chunked HTTP object.
  *
- * XXX: Reading one byte at a time is pretty pessimal.
+ * The chunk headers are parsed out of a window of what the backend
+ * sent, which we fill with as much as one read(2) will give us, rather
+ * than one byte at a time.  Any pipelined input left over from reading
+ * the headers is used as the first window, in place.
+ *
+ * Chunk payload already in the window is handed to the VFP through the
+ * htc pipeline, and the VFP reads whatever remains of the chunk off the
+ * socket itself, straight into storage.
  */
 
+#define FETCH_CBUF	8192
+
+static int
+fetch_cfill(struct worker *wrk, struct http_conn *htc, char *buf,
+    char **b, char **e)
+{
+	ssize_t i, l;
+
+	l = *e - *b;
+	if (l == 0 && htc->pipeline.b != NULL) {
+		*b = htc->pipeline.b;
+		*e = htc->pipeline.e;
+		htc->pipeline.b = htc->pipeline.e = NULL;
+		return (1);
+	}
+	AZ(htc->pipeline.b);
+	if (l >= FETCH_CBUF / 2)
+		return (FetchError(wrk, "chunked header too long"));
+	memmove(buf, *b, l);
+	*b = buf;
+	*e = buf + l;
+	i = HTC_Read(wrk, htc, *e, FETCH_CBUF - l);
+	if (i <= 0)
+		return (-1);
+	*e += i;
+	return (1);
+}
+
 static int
 fetch_chunked(struct worker *wrk, struct http_conn *htc)
 {
-	int i;
-	char buf[20];		/* XXX: 20 is arbitrary */
+	char buf[FETCH_CBUF];
+	char nbr[20];		/* XXX: 20 is arbitrary */
+	char *b, *e, *p, *q;
 	unsigned u;
-	ssize_t cl;
+	ssize_t cl, l;
 
 	assert(wrk->busyobj->body_status == BS_CHUNKED);
+	b = e = buf;
 	do {
-		/* Skip leading whitespace */
-		do {
-			if (HTC_Read(wrk, htc, buf, 1) <= 0)
-				return (-1);
-		} while (vct_islws(buf[0]));
+		/* Find the next line which is not just whitespace */
+		while (1) {
+			q = memchr(b, '\n', e - b);
+			if (q == NULL) {
+				if (fetch_cfill(wrk, htc, buf, &b, &e) <= 0)
+					return (-1);
+				continue;
+			}
+			for (p = b; p < q && vct_islws(*p); p++)
+				continue;
+			if (p < q)
+				break;
+			b = q + 1;
+		}
 
-		if (!vct_ishex(buf[0]))
+		if (!vct_ishex(*p))
 			return (FetchError(wrk,"chunked header non-hex"));
 
 		/* Collect hex digits, skipping leading zeros */
-		for (u = 1; u < sizeof buf; u++) {
-			do {
-				if (HTC_Read(wrk, htc, buf + u, 1) <= 0)
-					return (-1);
-			} while (u == 1 && buf[0] == '0' && buf[u] == '0');
-			if (!vct_ishex(buf[u]))
-				break;
+		while (p + 1 < q && p[0] == '0' && p[1] == '0')
+			p++;
+		for (u = 0; p < q && vct_ishex(*p); u++, p++) {
+			if (u >= sizeof nbr - 1)
+				return (FetchError(wrk,
+				    "chunked header too long"));
+			nbr[u] = *p;
 		}
-
-		if (u >= sizeof buf)
-			return (FetchError(wrk,"chunked header too long"));
+		nbr[u] = '\0';
 
 		/* Skip trailing white space */
-		while(vct_islws(buf[u]) && buf[u] != '\n')
-			if (HTC_Read(wrk, htc, buf + u, 1) <= 0)
-				return (-1);
-
-		if (buf[u] != '\n')
+		while (p < q && vct_islws(*p))
+			p++;
+		if (p != q)
 			return (FetchError(wrk,"chunked header no NL"));
+		b = q + 1;
 
-		buf[u] = '\0';
-		cl = fetch_number(buf, 16);
+		cl = fetch_number(nbr, 16);
 		if (cl < 0)
 			return (FetchError(wrk,"chunked header number syntax"));
 
-		if (cl > 0 && wrk->busyobj->vfp->bytes(wrk, htc, cl) <= 0)
-			return (-1);
+		if (cl > 0) {
+			l = e - b;
+			if (l > cl)
+				l = cl;
+			if (l > 0) {
+				AZ(htc->pipeline.b);
+				htc->pipeline.b = b;
+				htc->pipeline.e = b + l;
+			}
+			if (wrk->busyobj->vfp->bytes(wrk, htc, cl) <= 0)
+				return (-1);
+			AZ(htc->pipeline.b);
+			b += l;
+		}
 
-		i = HTC_Read(wrk, htc, buf, 1);
-		if (i <= 0)
-			return (-1);
-		if (buf[0] == '\r' && HTC_Read(wrk, htc, buf, 1) <= 0)
-			return (-1);
-		if (buf[0] != '\n')
+		/* The NL, optionally preceded by CR, after the payload */
+		while (b == e || (*b == '\r' && e - b < 2))
+			if (fetch_cfill(wrk, htc, buf, &b, &e) <= 0)
+				return (-1);
+		if (*b == '\r')
+			b++;
+		if (*b != '\n')
 			return (FetchError(wrk,"chunked tail no NL"));
+		b++;
 	} while (cl > 0);
+
+	if (b < e) {
+		/* Trailers or junk, don't leave them for the next fetch */
+		WSLB(wrk, SLT_Debug, "chunked: %zd bytes after last chunk",
+		    (ssize_t)(e - b));
+		wrk->busyobj->should_close = 1;
+	}
 	return (0);
 }
 
@@ -324,49 +390,315 @@ fetch_eof(struct worker *wrk, struct http_conn *htc)
 /*--------------------------------------------------------------------
  * Fetch any body attached to the incoming request, and either write it
  * to the backend (if we pass) or discard it (anything else).
- * This is mainly a separate function to isolate the stack buffer and
- * to contain the complexity when we start handling chunked encoding.
+ *
+ * The body is read through a window on the session workspace, as large
+ * as a client request may be, and written on as soon as it comes in,
+ * so the backend sees it while the client is still sending.
+ *
+ * A chunked body is passed on unchanged, we only parse it to find out
+ * where it ends.  Whatever the client sent after that is left in the
+ * pipeline for the next request.
+ *
+ * A body already kept for this request is sent from storage, and one
+ * which was not kept cannot be sent again.
+ *
+ * Returns 0 on success, 1 on client trouble, 2 on backend trouble.
+ */
+
+enum frb_state {
+	FRB_SIZE,		/* Chunk size */
+	FRB_EXT,		/* Rest of the chunk size line */
+	FRB_DATA,		/* Chunk payload */
+	FRB_CR,			/* CRNL after payload */
+	FRB_LF,
+	FRB_TRAILER,		/* Start of a trailer line */
+	FRB_TLINE,		/* Rest of a trailer line */
+	FRB_DONE
+};
+
+struct frb {
+	enum frb_state		state;
+	unsigned		ndig;
+	ssize_t			cl;
+};
+
+/* Returns how many bytes belong to the body, -1 on syntax error */
+
+static ssize_t
+frb_chunked(struct frb *frb, const char *b, const char *e)
+{
+	const char *p;
+	ssize_t l;
+	int x;
+
+	for (p = b; p < e && frb->state != FRB_DONE; ) {
+		switch (frb->state) {
+		case FRB_SIZE:
+			if (vct_ishex(*p)) {
+				x = vct_isdigit(*p) ? *p - '0' :
+				    (*p | 0x20) - 'a' + 10;
+				if (frb->cl > (SSIZE_MAX >> 4))
+					return (-1);
+				frb->cl = (frb->cl << 4) | x;
+				frb->ndig++;
+			} else if (*p == '\n') {
+				/* Tolerate empty lines, like fetch_chunked() */
+				if (frb->ndig > 0)
+					frb->state = frb->cl > 0 ?
+					    FRB_DATA : FRB_TRAILER;
+			} else if (*p == ';' || vct_islws(*p)) {
+				if (frb->ndig > 0)
+					frb->state = FRB_EXT;
+			} else
+				return (-1);
+			p++;
+			break;
+		case FRB_EXT:
+			if (*p == '\n')
+				frb->state = frb->cl > 0 ?
+				    FRB_DATA : FRB_TRAILER;
+			p++;
+			break;
+		case FRB_DATA:
+			l = e - p;
+			if (l > frb->cl)
+				l = frb->cl;
+			p += l;
+			frb->cl -= l;
+			if (frb->cl == 0)
+				frb->state = FRB_CR;
+			break;
+		case FRB_CR:
+			if (*p == '\r')
+				frb->state = FRB_LF;
+			else if (*p == '\n') {
+				frb->state = FRB_SIZE;
+				frb->ndig = 0;
+			} else
+				return (-1);
+			p++;
+			break;
+		case FRB_LF:
+			if (*p != '\n')
+				return (-1);
+			frb->state = FRB_SIZE;
+			frb->ndig = 0;
+			p++;
+			break;
+		case FRB_TRAILER:
+			if (*p == '\n')
+				frb->state = FRB_DONE;
+			else if (*p != '\r')
+				frb->state = FRB_TLINE;
+			p++;
+			break;
+		case FRB_TLINE:
+			if (*p == '\n')
+				frb->state = FRB_TRAILER;
+			p++;
+			break;
+		default:
+			WRONG("Wrong frb state");
+		}
+	}
+	return (p - b);
+}
+
+/*
+ * With param req_body_cache, a copy of the body goes into Transient
+ * storage as it passes through, so that it can be sent again when the
+ * backend request is retried or restarted.  Bodies which turn out to be
+ * larger than that are not kept, and can only be sent once.
  */
 
+static void
+frb_drop(struct req *req)
+{
+	struct storage *st, *stn;
+
+	VTAILQ_FOREACH_SAFE(st, &req->body, list, stn) {
+		CHECK_OBJ_NOTNULL(st, STORAGE_MAGIC);
+		VTAILQ_REMOVE(&req->body, st, list);
+		STV_free(st);
+	}
+}
+
+static int
+frb_keep(struct req *req, ssize_t *room, const char *b, ssize_t l)
+{
+	struct storage *st;
+	ssize_t n;
+
+	if (l > *room)
+		return (-1);
+	*room -= l;
+	while (l > 0) {
+		st = VTAILQ_LAST(&req->body, storagehead);
+		if (st == NULL || st->len == st->space) {
+			n = l + *room;
+			if (n > cache_param->fetch_chunksize)
+				n = cache_param->fetch_chunksize;
+			st = STV_AllocTransient(n);
+			if (st == NULL)
+				return (-1);
+			VTAILQ_INSERT_TAIL(&req->body, st, list);
+		}
+		n = st->space - st->len;
+		if (n > l)
+			n = l;
+		memcpy(st->ptr + st->len, b, n);
+		st->len += n;
+		b += n;
+		l -= n;
+	}
+	return (0);
+}
+
+void
+FetchReqBodyFree(struct req *req)
+{
+
+	CHECK_OBJ_NOTNULL(req, REQ_MAGIC);
+	frb_drop(req);
+	req->reqbody = REQBODY_UNREAD;
+}
+
 int
 FetchReqBody(struct sess *sp)
 {
-	unsigned long content_length;
-	char buf[8192];
-	char *ptr, *endp;
-	int rdcnt;
+	struct http_conn *htc;
+	struct storage *st;
+	struct req *req;
+	struct frb frb;
+	ssize_t cl, l, room;
+	unsigned u;
+	char *ptr, *endp, *w, *b, *e;
+	int chunked, done, keep, send, retval = 0;
 
-	if (http_GetHdr(sp->http, H_Content_Length, &ptr)) {
+	CHECK_OBJ_NOTNULL(sp, SESS_MAGIC);
+	req = sp->req;
+	CHECK_OBJ_NOTNULL(req, REQ_MAGIC);
+	htc = req->htc;
+	CHECK_OBJ_NOTNULL(htc, HTTP_CONN_MAGIC);
 
-		content_length = strtoul(ptr, &endp, 10);
-		/* XXX should check result of conversion */
-		while (content_length) {
-			if (content_length > sizeof buf)
-				rdcnt = sizeof buf;
-			else
-				rdcnt = content_length;
-			rdcnt = HTC_Read(sp->wrk, sp->req->htc, buf, rdcnt);
-			if (rdcnt <= 0)
-				return (1);
-			content_length -= rdcnt;
-			if (!sp->req->sendbody)
-				continue;
-			(void)WRW_Write(sp->wrk, buf, rdcnt); /* XXX: stats ? */
-			if (WRW_Flush(sp->wrk))
-				return (2);
+	chunked = 0;
+	cl = 0;
+	if (http_GetHdr(sp->http, H_Transfer_Encoding, &ptr)) {
+		if (strcasecmp(ptr, "chunked")) {
+			WSP(sp, SLT_Debug, "Transfer-Encoding in request");
+			return (1);
 		}
+		chunked = 1;
+	} else if (http_GetHdr(sp->http, H_Content_Length, &ptr)) {
+		cl = strtoul(ptr, &endp, 10);
+		/* XXX should check result of conversion */
+	}
+	if (!chunked && cl == 0)
+		return (0);
+
+	if (req->reqbody == REQBODY_CACHED) {
+		if (!req->sendbody)
+			return (0);
+		VTAILQ_FOREACH(st, &req->body, list)
+			(void)WRW_Write(sp->wrk, st->ptr, st->len);
+		sp->wrk->stats.backend_reqbody++;
+		return (WRW_Flush(sp->wrk) ? 2 : 0);
 	}
-	if (http_GetHdr(sp->http, H_Transfer_Encoding, NULL)) {
-		/* XXX: Handle chunked encoding. */
-		WSP(sp, SLT_Debug, "Transfer-Encoding in request");
+	if (req->reqbody == REQBODY_TAKEN) {
+		if (!req->sendbody)
+			return (0);
+		WSP(sp, SLT_Debug, "Request body already sent");
 		return (1);
 	}
-	return (0);
+
+	/* Leftovers must fit where HTC_Reinit() puts them */
+	u = WS_Reserve(sp->ws, 0);
+	if (u > cache_param->http_req_size - 1)
+		u = cache_param->http_req_size - 1;
+	if (u < 512) {
+		WS_Release(sp->ws, 0);
+		WSP(sp, SLT_Debug, "No workspace for request body");
+		return (1);
+	}
+	w = sp->ws->f;
+
+	room = cache_param->req_body_cache;
+	keep = room > 0 && (chunked || cl <= room);
+	send = req->sendbody;
+
+	memset(&frb, 0, sizeof frb);
+	b = e = w;
+	while (chunked ? frb.state != FRB_DONE : cl > 0) {
+		if (chunked && htc->pipeline.b != NULL) {
+			/* Parse the pipelined input in place */
+			b = htc->pipeline.b;
+			e = htc->pipeline.e;
+			htc->pipeline.b = htc->pipeline.e = NULL;
+		} else {
+			l = u;
+			if (!chunked && l > cl)
+				l = cl;
+			l = HTC_Read(sp->wrk, htc, w, l);
+			if (l <= 0) {
+				retval = 1;
+				break;
+			}
+			b = w;
+			e = w + l;
+		}
+		if (chunked) {
+			l = frb_chunked(&frb, b, e);
+			if (l < 0) {
+				WSP(sp, SLT_Debug, "Bad chunked request body");
+				retval = 1;
+				break;
+			}
+		} else {
+			l = e - b;
+			cl -= l;
+		}
+		if (keep && frb_keep(req, &room, b, l)) {
+			frb_drop(req);
+			keep = 0;
+		}
+		if (send) {
+			(void)WRW_Write(sp->wrk, b, l); /* XXX: stats ? */
+			if (WRW_Flush(sp->wrk)) {
+				/* Read on if a retry can use what we keep */
+				retval = 2;
+				send = 0;
+			}
+		}
+		b += l;
+		if (retval == 2 && !keep)
+			break;
+	}
+	done = chunked ? frb.state == FRB_DONE : cl == 0;
+
+	if (keep && done) {
+		req->reqbody = REQBODY_CACHED;
+	} else {
+		frb_drop(req);
+		req->reqbody = REQBODY_TAKEN;
+	}
+
+	if (done && b < e) {
+		/* The start of the next request, keep it for later */
+		AZ(htc->pipeline.b);
+		htc->pipeline.b = b;
+		htc->pipeline.e = e;
+		if (b >= w && e <= w + u) {
+			WS_ReleaseP(sp->ws, e);
+			return (retval);
+		}
+	}
+	WS_Release(sp->ws, 0);
+	return (retval);
 }
 
 /*--------------------------------------------------------------------
- * Send request, and receive the HTTP protocol response, but not the
- * response body.
+ * Send request, FetchResp() receives the HTTP protocol response, but not
+ * the response body.
  *
  * Return value:
  *	-1 failure, not retryable
@@ -382,13 +714,11 @@ FetchHdr(struct sess *sp, int need_host_hdr)
 	struct http *hp;
 	int retry = -1;
 	int i;
-	struct http_conn *htc;
 
 	CHECK_OBJ_NOTNULL(sp, SESS_MAGIC);
 	CHECK_OBJ_NOTNULL(sp->wrk, WORKER_MAGIC);
 	wrk = sp->wrk;
 	CHECK_OBJ_NOTNULL(wrk->busyobj, BUSYOBJ_MAGIC);
-	htc = &wrk->busyobj->htc;
 
 	AN(sp->req->director);
 	AZ(sp->wrk->obj);
@@ -436,6 +766,39 @@ FetchHdr(struct sess *sp, int need_host_hdr)
 
 	/* XXX is this the right place? */
 	VSC_C_main->backend_req++;
+	return (0);
+}
+
+/*--------------------------------------------------------------------
+ * Receive the response to what FetchHdr() sent, possibly after the
+ * session has been parked, see FetchPark().  Same return values.
+ */
+
+int
+FetchResp(struct sess *sp)
+{
+	struct vbc *vc;
+	struct worker *wrk;
+	struct http *hp;
+	int retry = -1;
+	int i;
+	struct http_conn *htc;
+
+	CHECK_OBJ_NOTNULL(sp, SESS_MAGIC);
+	CHECK_OBJ_NOTNULL(sp->wrk, WORKER_MAGIC);
+	wrk = sp->wrk;
+	CHECK_OBJ_NOTNULL(wrk->busyobj, BUSYOBJ_MAGIC);
+	htc = &wrk->busyobj->htc;
+	vc = wrk->busyobj->vbc;
+	CHECK_OBJ_NOTNULL(vc, VBC_MAGIC);
+	if (vc->recycled)
+		retry = 1;
+
+	if (wrk->busyobj->first_byte_tmo) {
+		WSP(sp, SLT_FetchError, "first byte timeout");
+		VDI_CloseFd(sp->wrk, &sp->wrk->busyobj->vbc);
+		return (-1);
+	}
 
 	/* Receive response */
 
@@ -481,6 +844,167 @@ FetchHdr(struct sess *sp, int need_host_hdr)
 	return (0);
 }
 
+/*--------------------------------------------------------------------
+ * Park a session which has sent its backend request, until the first
+ * byte of the response arrives, so that slow backends do not hold on
+ * to worker threads (param: fetch_park).
+ *
+ * The busyobj and objcore go with the session, and the bereq is moved
+ * off the worker workspace onto the session workspace.  A single thread
+ * polls the backend connections of all parked sessions, and reschedules
+ * them into STP_FETCH when the backend has something to say, or when
+ * first_byte_timeout runs out.
+ *
+ * The response headers and body are still read by a worker.
+ */
+
+#define NPARK	100
+
+struct fpk {
+	unsigned		magic;
+#define FPK_MAGIC		0x1d0a77c4
+	VTAILQ_ENTRY(fpk)	list;
+	struct sess		*sp;
+	double			deadline;
+};
+
+static VTAILQ_HEAD(, fpk)	fpk_head = VTAILQ_HEAD_INITIALIZER(fpk_head);
+static int			fpk_pipes[2];
+static pthread_t		fpk_thr;
+
+int
+FetchPark(struct sess *sp)
+{
+	struct worker *wrk;
+	struct busyobj *bo;
+	struct fpk *fpk;
+
+	CHECK_OBJ_NOTNULL(sp, SESS_MAGIC);
+	wrk = sp->wrk;
+	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
+	bo = wrk->busyobj;
+	CHECK_OBJ_NOTNULL(bo, BUSYOBJ_MAGIC);
+	CHECK_OBJ_NOTNULL(bo->vbc, VBC_MAGIC);
+	AZ(sp->req->fetch_bo);
+	AZ(sp->req->esi_level);
+
+	if (http_Rehome(bo->bereq, sp->ws))
+		return (-1);
+
+	ALLOC_OBJ(fpk, FPK_MAGIC);
+	if (fpk == NULL)
+		return (-1);
+	fpk->sp = sp;
+	fpk->deadline = VTIM_real() + bo->vbc->first_byte_timeout;
+
+	sp->req->fetch_bo = bo;
+	wrk->busyobj = NULL;
+	sp->req->fetch_oc = wrk->objcore;
+	wrk->objcore = NULL;
+
+	wrk->stats.fetch_park++;
+	SES_Charge(sp);
+	WSL_Flush(wrk, 0);
+	WS_Reset(wrk->ws, NULL);
+	sp->wrk = NULL;
+	assert(sizeof fpk == write(fpk_pipes[1], &fpk, sizeof fpk));
+	return (0);
+}
+
+static void
+fpk_unpark(struct worker *wrk, struct fpk *fpk)
+{
+	struct sess *sp;
+	struct busyobj *bo;
+	struct objcore *oc;
+
+	CHECK_OBJ_NOTNULL(fpk, FPK_MAGIC);
+	sp = fpk->sp;
+	FREE_OBJ(fpk);
+	CHECK_OBJ_NOTNULL(sp, SESS_MAGIC);
+	bo = sp->req->fetch_bo;
+	oc = sp->req->fetch_oc;
+
+	sp->step = STP_FETCH;
+	if (!SES_Schedule(sp))
+		return;
+
+	/* The session was dropped, clean up after it */
+	VDI_CloseFd(wrk, &bo->vbc);
+	if (oc != NULL)
+		AZ(HSH_Deref(wrk, oc, NULL));
+	VBO_DerefBusyObj(wrk, &bo);
+}
+
+static void * __match_proto__(bgthread_t)
+fpk_thread(struct sess *sp, void *priv)
+{
+	struct fpk *fpk, *fpk2, *ff[NPARK];
+	struct busyobj *bo;
+	struct pollfd *fds = NULL;
+	unsigned n = 0, nfds = 0, u;
+	double now;
+	int i;
+
+	CHECK_OBJ_NOTNULL(sp, SESS_MAGIC);
+	(void)priv;
+	while (1) {
+		if (1 + n > nfds) {
+			nfds = 1 + n + NPARK;
+			fds = realloc(fds, nfds * sizeof *fds);
+			XXXAN(fds);
+		}
+		fds[0].fd = fpk_pipes[0];
+		fds[0].events = POLLIN;
+		fds[0].revents = 0;
+		u = 1;
+		VTAILQ_FOREACH(fpk, &fpk_head, list) {
+			bo = fpk->sp->req->fetch_bo;
+			fds[u].fd = bo->vbc->fd;
+			fds[u].events = POLLIN;
+			fds[u].revents = 0;
+			u++;
+		}
+		assert(u == 1 + n);
+		(void)poll(fds, u, 100);
+		now = VTIM_real();
+
+		u = 1;
+		VTAILQ_FOREACH_SAFE(fpk, &fpk_head, list, fpk2) {
+			if (fds[u++].revents == 0) {
+				if (now < fpk->deadline)
+					continue;
+				fpk->sp->req->fetch_bo->first_byte_tmo = 1;
+			}
+			VTAILQ_REMOVE(&fpk_head, fpk, list);
+			n--;
+			fpk_unpark(sp->wrk, fpk);
+		}
+
+		if (fds[0].revents == 0)
+			continue;
+		i = read(fpk_pipes[0], ff, sizeof ff);
+		if (i <= 0)
+			continue;
+		for (u = 0; i >= sizeof ff[0]; u++, i -= sizeof ff[0]) {
+			CHECK_OBJ_NOTNULL(ff[u], FPK_MAGIC);
+			VTAILQ_INSERT_TAIL(&fpk_head, ff[u], list);
+			n++;
+		}
+		assert(i == 0);
+	}
+	NEEDLESS_RETURN(NULL);
+}
+
+void
+Fetch_ParkInit(void)
+{
+
+	AZ(pipe(fpk_pipes));
+	(void)VTCP_nonblocking(fpk_pipes[0]);
+	WRK_BgThread(&fpk_thr, "cache-fetch-park", fpk_thread, NULL);
+}
+
 /*--------------------------------------------------------------------*/
 
 int
@@ -567,9 +1091,10 @@ FetchBody(struct worker *wrk, struct object *obj)
 
 	bo->fetch_obj = NULL;
 
-	WSLB(wrk, SLT_Fetch_Body, "%u(%s) cls %d mklen %d",
+	wrk->stats.fetch_reads += htc->nread;
+	WSLB(wrk, SLT_Fetch_Body, "%u(%s) cls %d mklen %d reads %u",
 	    bo->body_status, body_status(bo->body_status),
-	    cls, mklen);
+	    cls, mklen, htc->nread);
 
 	if (bo->body_status == BS_ERROR) {
 		VDI_CloseFd(wrk, &bo->vbc);
@@ -59,9 +59,11 @@
 #include "cache.h"
 
 #include "hash/hash_slinger.h"
+#include "vfh256.h"
 #include "vsha256.h"
 
 static const struct hash_slinger *hash;
+static unsigned hsh_fast;
 
 /*---------------------------------------------------------------------*/
 /* Precreate an objhead and object for later use */
@@ -144,11 +146,29 @@ HSH_DeleteObjHead(struct worker *wrk, struct objhead *oh)
 
 	AZ(oh->refcnt);
 	assert(VTAILQ_EMPTY(&oh->objcs));
+	AZ(oh->vary_idx);
+	AZ(oh->vary_odd);
 	Lck_Delete(&oh->mtx);
 	wrk->stats.n_objecthead--;
 	FREE_OBJ(oh);
 }
 
+/*---------------------------------------------------------------------
+ * The digest of the hash string, SHA256 unless hash_fast_digest was
+ * set when the child started.
+ */
+
+void
+HSH_DigestInit(struct worker *wrk)
+{
+
+	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
+	if (hsh_fast)
+		VFH256_Init(wrk->vfh256ctx);
+	else
+		SHA256_Init(wrk->sha256ctx);
+}
+
 void
 HSH_AddString(const struct sess *sp, const char *str)
 {
@@ -158,13 +178,29 @@ HSH_AddString(const struct sess *sp, const char *str)
 		str = "";
 	l = strlen(str);
 
-	SHA256_Update(sp->wrk->sha256ctx, str, l);
-	SHA256_Update(sp->wrk->sha256ctx, "#", 1);
+	if (hsh_fast) {
+		VFH256_Update(sp->wrk->vfh256ctx, str, l);
+		VFH256_Update(sp->wrk->vfh256ctx, "#", 1);
+	} else {
+		SHA256_Update(sp->wrk->sha256ctx, str, l);
+		SHA256_Update(sp->wrk->sha256ctx, "#", 1);
+	}
 
 	if (cache_param->log_hash)
 		WSP(sp, SLT_Hash, "%s", str);
 }
 
+void
+HSH_DigestFinal(struct worker *wrk, unsigned char *digest)
+{
+
+	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
+	if (hsh_fast)
+		VFH256_Final(digest, wrk->vfh256ctx);
+	else
+		SHA256_Final(digest, wrk->sha256ctx);
+}
+
 /*---------------------------------------------------------------------
  * This is a debugging hack to enable testing of boundary conditions
  * in the hash algorithm.
@@ -240,6 +276,153 @@ hsh_testmagic(void *result)
 	fprintf(stderr, ">\n");
 }
 
+/*---------------------------------------------------------------------
+ * The variants in an objhead, by the fingerprint of their vary string.
+ *
+ * When all objects in the objhead vary on the same headers, which is
+ * the usual case, HSH_Lookup() only needs to look at those with the
+ * same fingerprint as the request, rather than VRY_Match() every one
+ * of them.  Objects without Vary, with other headers in it, or from
+ * persistent storage, which we cannot look at without loading them, are
+ * only counted in oh->vary_odd, and while there are any, the index is
+ * not used.
+ *
+ * The buckets hold the objects in the same order as oh->objcs, so the
+ * index does not change which object a lookup finds.  Busy objects are
+ * not in it, they are all at the tail of oh->objcs.
+ */
+
+struct hsh_vary {
+	unsigned		magic;
+#define HSH_VARY_MAGIC		0x1e5a08c3
+	unsigned		nbucket;	/* Power of two */
+	unsigned		n;
+	uint8_t			*spec;		/* See VRY_Spec() */
+	VTAILQ_HEAD(hsh_varyhead, objcore) *bucket;
+};
+
+#define HSH_VARY_NBUCKET	16
+
+static struct hsh_varyhead *
+hsh_vary_bucket(const struct hsh_vary *vi, uint32_t fp)
+{
+
+	return (&vi->bucket[fp & (vi->nbucket - 1)]);
+}
+
+static void
+hsh_vary_grow(struct objhead *oh)
+{
+	struct hsh_vary *vi;
+	struct objcore *oc;
+	void *b;
+	unsigned u, nb;
+
+	vi = oh->vary_idx;
+	nb = vi->nbucket * 2;
+	b = calloc(nb, sizeof *vi->bucket);
+	if (b == NULL)
+		return;		/* Longer chains then */
+	free(vi->bucket);
+	vi->bucket = b;
+	vi->nbucket = nb;
+	for (u = 0; u < nb; u++)
+		VTAILQ_INIT(&vi->bucket[u]);
+	VTAILQ_FOREACH(oc, &oh->objcs, list)
+		if (oc->flags & OC_F_VARY)
+			VTAILQ_INSERT_TAIL(hsh_vary_bucket(vi, oc->vary_fp),
+			    oc, vary_list);
+}
+
+/* oc is no longer busy, and was just moved to the head of oh->objcs */
+
+static void
+hsh_vary_insert(struct objhead *oh, struct objcore *oc, const uint8_t *vary)
+{
+	struct hsh_vary *vi;
+	unsigned u;
+
+	Lck_AssertHeld(&oh->mtx);
+	AZ(oc->flags & (OC_F_BUSY | OC_F_VARY));
+	vi = oh->vary_idx;
+	if (vary != NULL && vi == NULL) {
+		ALLOC_OBJ(vi, HSH_VARY_MAGIC);
+		XXXAN(vi);
+		vi->spec = VRY_Spec(vary);
+		XXXAN(vi->spec);
+		vi->nbucket = HSH_VARY_NBUCKET;
+		vi->bucket = calloc(vi->nbucket, sizeof *vi->bucket);
+		XXXAN(vi->bucket);
+		for (u = 0; u < vi->nbucket; u++)
+			VTAILQ_INIT(&vi->bucket[u]);
+		oh->vary_idx = vi;
+	}
+	if (vary == NULL || !VRY_SameHeaders(vi->spec, vary)) {
+		oh->vary_odd++;
+		return;
+	}
+	CHECK_OBJ_NOTNULL(vi, HSH_VARY_MAGIC);
+	oc->vary_fp = VRY_Fingerprint(vary);
+	oc->flags |= OC_F_VARY;
+	VTAILQ_INSERT_HEAD(hsh_vary_bucket(vi, oc->vary_fp), oc, vary_list);
+	if (++vi->n > 2 * vi->nbucket)
+		hsh_vary_grow(oh);
+}
+
+/* oc is about to be removed from oh->objcs */
+
+static void
+hsh_vary_remove(struct objhead *oh, struct objcore *oc)
+{
+	struct hsh_vary *vi;
+
+	Lck_AssertHeld(&oh->mtx);
+	if (oc->flags & OC_F_BUSY)
+		return;
+	if (!(oc->flags & OC_F_VARY)) {
+		assert(oh->vary_odd > 0);
+		oh->vary_odd--;
+		return;
+	}
+	vi = oh->vary_idx;
+	CHECK_OBJ_NOTNULL(vi, HSH_VARY_MAGIC);
+	VTAILQ_REMOVE(hsh_vary_bucket(vi, oc->vary_fp), oc, vary_list);
+	oc->flags &= ~OC_F_VARY;
+	assert(vi->n > 0);
+	if (--vi->n > 0)
+		return;
+	/* Let the next variant decide the headers */
+	free(vi->spec);
+	free(vi->bucket);
+	FREE_OBJ(vi);
+	oh->vary_idx = NULL;
+}
+
+/*
+ * Where the lookup goes after oc: the rest of the bucket, then the busy
+ * objects on the tail of oh->objcs.
+ */
+
+static struct objcore *
+hsh_vary_next(struct objhead *oh, struct objcore *oc)
+{
+	struct objcore *oc2;
+
+	if (oc != NULL && (oc->flags & OC_F_BUSY))
+		return (VTAILQ_NEXT(oc, list));
+	if (oc != NULL) {
+		oc2 = VTAILQ_NEXT(oc, vary_list);
+		if (oc2 != NULL)
+			return (oc2);
+	}
+	oc2 = NULL;
+	for (oc = VTAILQ_LAST(&oh->objcs, objcorehead);
+	    oc != NULL && (oc->flags & OC_F_BUSY);
+	    oc = VTAILQ_PREV(oc, objcorehead, list))
+		oc2 = oc;
+	return (oc2);
+}
+
 /*---------------------------------------------------------------------
  * Insert an object which magically appears out of nowhere or, more likely,
  * comes off some persistent storage device.
@@ -279,6 +462,8 @@ HSH_Insert(const struct sess *sp)
 	AZ(oc->flags & OC_F_BUSY);
 
 	VTAILQ_INSERT_HEAD(&oh->objcs, oc, list);
+	/* We cannot see its Vary: without loading it */
+	oh->vary_odd++;
 	/* NB: do not deref objhead the new object inherits our reference */
 	oc->objhead = oh;
 	Lck_Unlock(&oh->mtx);
@@ -297,6 +482,8 @@ HSH_Lookup(struct sess *sp, struct objhead **poh)
 	struct objcore *oc;
 	struct objcore *busy_oc, *grace_oc;
 	struct object *o;
+	struct hsh_vary *vi;
+	uint32_t fp = 0;
 	double grace_ttl;
 
 	CHECK_OBJ_NOTNULL(sp, SESS_MAGIC);
@@ -332,7 +519,27 @@ HSH_Lookup(struct sess *sp, struct objhead **poh)
 	busy_oc = NULL;
 	grace_oc = NULL;
 	grace_ttl = NAN;
-	VTAILQ_FOREACH(oc, &oh->objcs, list) {
+
+	vi = NULL;
+	if (oh->vary_idx != NULL && oh->vary_odd == 0) {
+		vi = oh->vary_idx;
+		CHECK_OBJ_NOTNULL(vi, HSH_VARY_MAGIC);
+		/* Collect our values for the headers all the variants use */
+		(void)VRY_Match(sp, vi->spec);
+		if (sp->req->vary_l != NULL)
+			fp = VRY_Fingerprint(sp->req->vary_b);
+		else
+			vi = NULL;	/* No room, look at them all */
+	}
+	if (vi != NULL) {
+		oc = VTAILQ_FIRST(hsh_vary_bucket(vi, fp));
+		if (oc == NULL)
+			oc = hsh_vary_next(oh, NULL);
+	} else
+		oc = VTAILQ_FIRST(&oh->objcs);
+
+	for (; oc != NULL;
+	    oc = vi != NULL ? hsh_vary_next(oh, oc) : VTAILQ_NEXT(oc, list)) {
 		/* Must be at least our own ref + the objcore we examine */
 		assert(oh->refcnt > 1);
 		CHECK_OBJ_NOTNULL(oc, OBJCORE_MAGIC);
@@ -350,6 +557,8 @@ HSH_Lookup(struct sess *sp, struct objhead **poh)
 			busy_oc = oc;
 			continue;
 		}
+		if (vi != NULL && oc->vary_fp != fp)
+			continue;
 
 		o = oc_getobj(sp->wrk, oc);
 		CHECK_OBJ_NOTNULL(o, OBJECT_MAGIC);
@@ -621,6 +830,7 @@ HSH_Unbusy(struct worker *wrk)
 	VTAILQ_INSERT_HEAD(&oh->objcs, oc, list);
 	oc->flags &= ~OC_F_BUSY;
 	oc->busyobj = NULL;
+	hsh_vary_insert(oh, oc, o->vary);
 	if (oh->waitinglist != NULL)
 		hsh_rush(oh);
 	AN(oc->ban);
@@ -693,9 +903,10 @@ HSH_Deref(struct worker *wrk, struct objcore *oc, struct object **oo)
 	assert(oh->refcnt > 0);
 	assert(oc->refcnt > 0);
 	r = --oc->refcnt;
-	if (!r)
+	if (!r) {
+		hsh_vary_remove(oh, oc);
 		VTAILQ_REMOVE(&oh->objcs, oc, list);
-	else {
+	} else {
 		/* Must have an object */
 		AN(oc->methods);
 	}
@@ -728,6 +939,9 @@ HSH_Init(const struct hash_slinger *slinger)
 {
 
 	assert(DIGEST_LEN == SHA256_LEN);	/* avoid #include pollution */
+	assert(DIGEST_LEN == VFH256_LEN);
+	/* Mixing digests would make a mess of the hash, so latch it */
+	hsh_fast = cache_param->hash_fast_digest;
 	hash = slinger;
 	if (hash->start != NULL)
 		hash->start();
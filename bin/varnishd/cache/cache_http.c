@@ -104,10 +104,128 @@ http_StatusMessage(unsigned status)
 	return ("Unknown Error");
 }
 
+/*--------------------------------------------------------------------
+ * Header name index
+ *
+ * The struct https we work on carry a small open addressed hash table,
+ * keyed on the case-folded header name, which holds the hd[] slot of
+ * each header.  Slot zero is never a header, so it marks an empty bucket.
+ * Objects do without, so the index costs no storage, their headers are
+ * only looked up by VCL, and indexed again when copied for delivery.
+ * Headers are entered in slot order, so when a name occurs more than
+ * once, probing finds the first of them, just like the linear scan
+ * we used to do.
+ *
+ * Headers are only ever appended to hd[] one at a time, and those are
+ * entered as they go.  Anything which moves headers around rebuilds
+ * the index from scratch, that is no more work than the move itself.
+ */
+
+static unsigned
+http_hixbits(unsigned nhttp)
+{
+	unsigned u;
+
+	/* At most half full, so probe sequences stay short */
+	for (u = 4; (1U << u) < nhttp * 2; u++)
+		continue;
+	return (u);
+}
+
+/* The index lives after hdf[], hixbits tells if it is there at all */
+
+static uint16_t *
+http_hix(const struct http *hp)
+{
+	uintptr_t u;
+
+	if (hp->hixbits == 0)
+		return (NULL);
+	u = (uintptr_t)(hp->hdf + hp->shd);
+	u = (u + sizeof (uint16_t) - 1) & ~(uintptr_t)(sizeof (uint16_t) - 1);
+	return ((void*)u);
+}
+
+static unsigned
+http_hixhash(const char *p, unsigned l)
+{
+	unsigned h = 2166136261U;
+
+	/* FNV-1a, the 0x20 bit folds ASCII case */
+	while (l-- > 0)
+		h = (h ^ (*(const unsigned char *)p++ | 0x20)) * 16777619U;
+	return (h);
+}
+
+static void
+http_hixadd(const struct http *hp, unsigned n)
+{
+	const char *q;
+	uint16_t *hix;
+	unsigned h, m;
+
+	assert(n >= HTTP_HDR_FIRST);
+	hix = http_hix(hp);
+	if (hix == NULL || hp->hd[n].b == NULL)
+		return;
+	q = memchr(hp->hd[n].b, ':', Tlen(hp->hd[n]));
+	if (q == NULL)
+		return;		/* Cannot be found by name anyway */
+	m = (1U << hp->hixbits) - 1;
+	h = http_hixhash(hp->hd[n].b, q - hp->hd[n].b);
+	while (hix[h & m] != 0)
+		h++;
+	hix[h & m] = n;
+}
+
+static void
+http_hixclear(const struct http *hp)
+{
+	uint16_t *hix;
+
+	hix = http_hix(hp);
+	if (hix != NULL)
+		memset(hix, 0, sizeof *hix << hp->hixbits);
+}
+
+static void
+http_hixbuild(const struct http *hp)
+{
+	unsigned u;
+
+	if (hp->hixbits == 0)
+		return;
+	http_hixclear(hp);
+	for (u = HTTP_HDR_FIRST; u < hp->nhd; u++)
+		http_hixadd(hp, u);
+}
+
 /*--------------------------------------------------------------------*/
 
 unsigned
 HTTP_estimate(unsigned nhttp)
+{
+
+	/* Callers lay out several of these back to back */
+	return (PRNDUP(sizeof (struct http) + (sizeof (txt) + 1) * nhttp +
+	    (sizeof (uint16_t) << http_hixbits(nhttp)) + sizeof (uint16_t)));
+}
+
+struct http *
+HTTP_create(void *p, uint16_t nhttp)
+{
+	struct http *hp;
+
+	hp = HTTP_create_noindex(p, nhttp);
+	hp->hixbits = http_hixbits(nhttp);
+	http_hixclear(hp);
+	return (hp);
+}
+
+/* For objects, see above */
+
+unsigned
+HTTP_estimate_noindex(unsigned nhttp)
 {
 
 	/* XXX: We trust the structs to size-aligned as necessary */
@@ -115,7 +233,7 @@ HTTP_estimate(unsigned nhttp)
 }
 
 struct http *
-HTTP_create(void *p, uint16_t nhttp)
+HTTP_create_noindex(void *p, uint16_t nhttp)
 {
 	struct http *hp;
 
@@ -124,6 +242,7 @@ HTTP_create(void *p, uint16_t nhttp)
 	hp->hd = (void*)(hp + 1);
 	hp->shd = nhttp;
 	hp->hdf = (void*)(hp->hd + nhttp);
+	hp->hixbits = 0;
 	return (hp);
 }
 
@@ -135,11 +254,15 @@ http_Setup(struct http *hp, struct ws *ws)
 	uint16_t shd;
 	txt *hd;
 	unsigned char *hdf;
+	uint8_t hixbits;
+	uint16_t gen;
 
 	/* XXX: This is not elegant, is it efficient ? */
 	shd = hp->shd;
 	hd = hp->hd;
 	hdf = hp->hdf;
+	hixbits = hp->hixbits;
+	gen = hp->gen;
 	memset(hp, 0, sizeof *hp);
 	memset(hd, 0, sizeof *hd * shd);
 	memset(hdf, 0, sizeof *hdf * shd);
@@ -149,6 +272,9 @@ http_Setup(struct http *hp, struct ws *ws)
 	hp->shd = shd;
 	hp->hd = hd;
 	hp->hdf = hdf;
+	hp->hixbits = hixbits;
+	hp->gen = gen + 1;
+	http_hixclear(hp);
 }
 
 /*--------------------------------------------------------------------*/
@@ -175,7 +301,7 @@ http_IsHdr(const txt *hh, const char *hdr)
 void
 http_CollectHdr(struct http *hp, const char *hdr)
 {
-	unsigned u, v, ml, f = 0, x;
+	unsigned u, v, ml, f = 0, x, moved = 0;
 	char *b = NULL, *e = NULL;
 
 	for (u = HTTP_HDR_FIRST; u < hp->nhd; u++) {
@@ -216,9 +342,14 @@ http_CollectHdr(struct http *hp, const char *hdr)
 			for (v = u; v < hp->nhd - 1; v++)
 				hp->hd[v] = hp->hd[v + 1];
 			hp->nhd--;
+			moved = 1;
 		}
 
 	}
+	if (moved) {
+		hp->gen++;
+		http_hixbuild(hp);
+	}
 	if (b == NULL)
 		return;
 	AN(e);
@@ -238,9 +369,31 @@ http_CollectHdr(struct http *hp, const char *hdr)
 static unsigned
 http_findhdr(const struct http *hp, unsigned l, const char *hdr)
 {
-	unsigned u;
+	const uint16_t *hix;
+	unsigned h, m, u;
 
-	for (u = HTTP_HDR_FIRST; u < hp->nhd; u++) {
+	hix = http_hix(hp);
+	if (hix == NULL) {
+		for (u = HTTP_HDR_FIRST; u < hp->nhd; u++) {
+			Tcheck(hp->hd[u]);
+			if (hp->hd[u].e < hp->hd[u].b + l + 1)
+				continue;
+			if (hp->hd[u].b[l] != ':')
+				continue;
+			if (strncasecmp(hdr, hp->hd[u].b, l))
+				continue;
+			return (u);
+		}
+		return (0);
+	}
+	m = (1U << hp->hixbits) - 1;
+	for (h = http_hixhash(hdr, l); ; h++) {
+		u = hix[h & m];
+		if (u == 0)
+			return (0);
+		assert(u < hp->nhd);
+		if (hp->hd[u].b == NULL)
+			continue;
 		Tcheck(hp->hd[u]);
 		if (hp->hd[u].e < hp->hd[u].b + l + 1)
 			continue;
@@ -250,7 +403,6 @@ http_findhdr(const struct http *hp, unsigned l, const char *hdr)
 			continue;
 		return (u);
 	}
-	return (0);
 }
 
 int
@@ -493,16 +645,17 @@ http_dissect_hdrs(struct worker *w, struct http *hp, unsigned vsl_id, char *p,
 
 	hp->nhd = HTTP_HDR_FIRST;
 	hp->conds = 0;
+	hp->gen++;
+	http_hixclear(hp);
 	r = NULL;		/* For FlexeLint */
 	for (; p < t.e; p = r) {
 
 		/* Find end of next header */
 		q = r = p;
 		while (r < t.e) {
-			if (!vct_iscrlf(*r)) {
-				r++;
-				continue;
-			}
+			r = VCT_FindCRLF(r, t.e);
+			if (r == t.e)
+				break;
 			q = r;
 			assert(r < t.e);
 			r += vct_skipcrlf(r);
@@ -542,6 +695,7 @@ http_dissect_hdrs(struct worker *w, struct http *hp, unsigned vsl_id, char *p,
 			hp->hd[hp->nhd].b = p;
 			hp->hd[hp->nhd].e = q;
 			WSLH(w, vsl_id, hp, hp->nhd);
+			http_hixadd(hp, hp->nhd);
 			hp->nhd++;
 		} else {
 			VSC_C_main->losthdr++;
@@ -575,10 +729,9 @@ http_splitline(struct worker *w, unsigned vsl_id, struct http *hp,
 
 	/* First field cannot contain SP, CRLF or CTL */
 	q = p;
-	for (; !vct_issp(*p); p++) {
-		if (vct_isctl(*p))
-			return (400);
-	}
+	p = VCT_FindSPCTL(p, htc->rxbuf.e);
+	if (!vct_issp(*p))
+		return (400);
 	hp->hd[h1].b = q;
 	hp->hd[h1].e = p;
 
@@ -590,10 +743,9 @@ http_splitline(struct worker *w, unsigned vsl_id, struct http *hp,
 
 	/* Second field cannot contain LWS or CTL */
 	q = p;
-	for (; !vct_islws(*p); p++) {
-		if (vct_isctl(*p))
-			return (400);
-	}
+	p = VCT_FindSPCTL(p, htc->rxbuf.e);
+	if (!vct_islws(*p))
+		return (400);
 	hp->hd[h2].b = q;
 	hp->hd[h2].e = p;
 
@@ -608,10 +760,13 @@ http_splitline(struct worker *w, unsigned vsl_id, struct http *hp,
 
 	/* Third field is optional and cannot contain CTL */
 	q = p;
-	if (!vct_iscrlf(*p)) {
-		for (; !vct_iscrlf(*p); p++)
-			if (!vct_issep(*p) && vct_isctl(*p))
-				return (400);
+	while (1) {
+		p = VCT_FindSPCTL(p, htc->rxbuf.e);
+		if (vct_iscrlf(*p))
+			break;
+		if (!vct_issep(*p) && vct_isctl(*p))
+			return (400);
+		p++;
 	}
 	hp->hd[h3].b = q;
 	hp->hd[h3].e = p;
@@ -799,6 +954,7 @@ http_copyheader(struct worker *w, unsigned vsl_id, struct http *to,
 	if (to->nhd < to->shd) {
 		to->hd[to->nhd] = fm->hd[n];
 		to->hdf[to->nhd] = 0;
+		http_hixadd(to, to->nhd);
 		to->nhd++;
 	} else  {
 		VSC_C_main->losthdr++;
@@ -806,6 +962,24 @@ http_copyheader(struct worker *w, unsigned vsl_id, struct http *to,
 	}
 }
 
+/*--------------------------------------------------------------------*/
+
+static int
+http_isfiltered(const struct http *fm, unsigned u, unsigned how)
+{
+
+	if (fm->hd[u].b == NULL)
+		return (1);
+	if (fm->hdf[u] & HDF_FILTER)
+		return (1);
+#define HTTPH(a, b, c, d, e, f, g) \
+	if (((e) & how) && http_IsHdr(&fm->hd[u], (b))) \
+		return (1);
+#include "tbl/http_headers.h"
+#undef HTTPH
+	return (0);
+}
+
 /*--------------------------------------------------------------------
  * Estimate how much workspace we need to Filter this header according
  * to 'how'.
@@ -820,15 +994,8 @@ http_EstimateWS(const struct http *fm, unsigned how, uint16_t *nhd)
 	*nhd = HTTP_HDR_FIRST;
 	CHECK_OBJ_NOTNULL(fm, HTTP_MAGIC);
 	for (u = 0; u < fm->nhd; u++) {
-		if (fm->hd[u].b == NULL)
-			continue;
-		if (fm->hdf[u] & HDF_FILTER)
-			continue;
-#define HTTPH(a, b, c, d, e, f, g) \
-		if (((e) & how) && http_IsHdr(&fm->hd[u], (b))) \
+		if (http_isfiltered(fm, u, how))
 			continue;
-#include "tbl/http_headers.h"
-#undef HTTPH
 		l += PRNDUP(Tlen(fm->hd[u]) + 1);
 		(*nhd)++;
 		// fm->hdf[u] |= HDF_COPY;
@@ -848,18 +1015,11 @@ http_FilterFields(struct worker *w, unsigned vsl_id, struct http *to,
 	CHECK_OBJ_NOTNULL(to, HTTP_MAGIC);
 	to->nhd = HTTP_HDR_FIRST;
 	to->status = fm->status;
-	for (u = HTTP_HDR_FIRST; u < fm->nhd; u++) {
-		if (fm->hd[u].b == NULL)
-			continue;
-		if (fm->hdf[u] & HDF_FILTER)
-			continue;
-#define HTTPH(a, b, c, d, e, f, g) \
-		if (((e) & how) && http_IsHdr(&fm->hd[u], (b))) \
-			continue;
-#include "tbl/http_headers.h"
-#undef HTTPH
-		http_copyheader(w, vsl_id, to, fm, u);
-	}
+	to->gen++;
+	http_hixclear(to);
+	for (u = HTTP_HDR_FIRST; u < fm->nhd; u++)
+		if (!http_isfiltered(fm, u, how))
+			http_copyheader(w, vsl_id, to, fm, u);
 }
 
 /*--------------------------------------------------------------------*/
@@ -918,6 +1078,37 @@ http_CopyHome(struct worker *w, unsigned vsl_id, const struct http *hp)
 	}
 }
 
+/*--------------------------------------------------------------------
+ * Copy the headers which live on the workspace of the http to another
+ * workspace, and make that the workspace of the http.
+ */
+
+int
+http_Rehome(struct http *hp, struct ws *ws)
+{
+	unsigned u, l;
+	char *p;
+
+	CHECK_OBJ_NOTNULL(hp, HTTP_MAGIC);
+	AN(hp->ws);
+	for (u = 0; u < hp->nhd; u++) {
+		if (hp->hd[u].b == NULL)
+			continue;
+		if (hp->hd[u].b < hp->ws->s || hp->hd[u].e > hp->ws->e)
+			continue;
+		l = Tlen(hp->hd[u]);
+		p = WS_Alloc(ws, l + 1);
+		if (p == NULL)
+			return (-1);
+		memcpy(p, hp->hd[u].b, l);
+		p[l] = '\0';
+		hp->hd[u].b = p;
+		hp->hd[u].e = p + l;
+	}
+	hp->ws = ws;
+	return (0);
+}
+
 /*--------------------------------------------------------------------*/
 
 void
@@ -929,7 +1120,9 @@ http_ClrHeader(struct http *to)
 	to->status = 0;
 	to->protover = 0;
 	to->conds = 0;
+	to->gen++;
 	memset(to->hd, 0, sizeof *to->hd * to->shd);
+	http_hixclear(to);
 }
 
 /*--------------------------------------------------------------------*/
@@ -945,7 +1138,8 @@ http_SetHeader(struct worker *w, unsigned vsl_id, struct http *to,
 		WSL(w, SLT_LostHeader, vsl_id, "%s", hdr);
 		return;
 	}
-	http_SetH(to, to->nhd++, hdr);
+	http_SetH(to, to->nhd, hdr);
+	http_hixadd(to, to->nhd++);
 }
 
 /*--------------------------------------------------------------------*/
@@ -1024,6 +1218,7 @@ http_PrintfHeader(struct worker *w, unsigned vsl_id, struct http *to,
 		to->hd[to->nhd].e = to->ws->f + n;
 		to->hdf[to->nhd] = 0;
 		WS_Release(to->ws, n + 1);
+		http_hixadd(to, to->nhd);
 		to->nhd++;
 	}
 }
@@ -1045,7 +1240,11 @@ http_Unset(struct http *hp, const char *hdr)
 		}
 		v++;
 	}
-	hp->nhd = v;
+	if (hp->nhd != v) {
+		hp->nhd = v;
+		hp->gen++;
+		http_hixbuild(hp);
+	}
 }
 
 /*--------------------------------------------------------------------*/
@@ -1062,12 +1261,19 @@ HTTP_Copy(struct http *to, const struct http * const fm)
 	assert(fm->nhd <= to->shd);
 	memcpy(to->hd, fm->hd, fm->nhd * sizeof *to->hd);
 	memcpy(to->hdf, fm->hdf, fm->nhd * sizeof *to->hdf);
+	to->gen++;
+	if (to->hixbits != 0 && to->hixbits == fm->hixbits)
+		memcpy(http_hix(to), http_hix(fm),
+		    sizeof (uint16_t) << fm->hixbits);
+	else
+		http_hixbuild(to);
 }
 
 /*--------------------------------------------------------------------*/
 
-unsigned
-http_Write(struct worker *w, unsigned vsl_id, const struct http *hp, int resp)
+static unsigned
+http_write(struct worker *w, unsigned vsl_id, const struct http *hp, int resp,
+    const char *blk, unsigned blklen, unsigned nblk)
 {
 	unsigned u, l;
 
@@ -1095,7 +1301,14 @@ http_Write(struct worker *w, unsigned vsl_id, const struct http *hp, int resp)
 		l += WRW_WriteH(w, &hp->hd[HTTP_HDR_PROTO], "\r\n");
 		WSLH(w, vsl_id, hp, HTTP_HDR_PROTO);
 	}
-	for (u = HTTP_HDR_FIRST; u < hp->nhd; u++) {
+	if (blk != NULL) {
+		/* Still log them one by one, as if we had sent them so */
+		l += WRW_Write(w, blk, blklen);
+		for (u = HTTP_HDR_FIRST; u < nblk; u++)
+			if (hp->hd[u].b != NULL)
+				WSLH(w, vsl_id, hp, u);
+	}
+	for (u = nblk; u < hp->nhd; u++) {
 		if (hp->hd[u].b == NULL)
 			continue;
 		AN(hp->hd[u].b);
@@ -1107,6 +1320,68 @@ http_Write(struct worker *w, unsigned vsl_id, const struct http *hp, int resp)
 	return (l);
 }
 
+unsigned
+http_Write(struct worker *w, unsigned vsl_id, const struct http *hp, int resp)
+{
+
+	return (http_write(w, vsl_id, hp, resp, NULL, 0, HTTP_HDR_FIRST));
+}
+
+/*--------------------------------------------------------------------
+ * Send a response, where the header lines in hd[] slots below nblk
+ * have been serialized into blk already, see http_HdrBlk().
+ */
+
+unsigned
+http_WriteBlk(struct worker *w, unsigned vsl_id, const struct http *hp,
+    const char *blk, unsigned blklen, unsigned nblk)
+{
+
+	AN(blk);
+	assert(nblk >= HTTP_HDR_FIRST && nblk <= hp->nhd);
+	return (http_write(w, vsl_id, hp, 1, blk, blklen, nblk));
+}
+
+/*--------------------------------------------------------------------
+ * Serialize the header lines of hp which survive filtering with 'how',
+ * exactly as http_Write() will send them after http_FilterFields(),
+ * into a single block on the workspace of hp.
+ *
+ * Returns the number of header lines in the block, -1 if out of space.
+ */
+
+int
+http_HdrBlk(const struct http *hp, unsigned how, char **blk, unsigned *len)
+{
+	unsigned u, l, n;
+	char *b, *p;
+
+	CHECK_OBJ_NOTNULL(hp, HTTP_MAGIC);
+	AN(blk);
+	AN(len);
+	l = WS_Reserve(hp->ws, 0);
+	b = p = hp->ws->f;
+	n = 0;
+	for (u = HTTP_HDR_FIRST; u < hp->nhd; u++) {
+		if (http_isfiltered(hp, u, how))
+			continue;
+		Tcheck(hp->hd[u]);
+		if (Tlen(hp->hd[u]) + 2 > l - (p - b)) {
+			WS_Release(hp->ws, 0);
+			return (-1);
+		}
+		memcpy(p, hp->hd[u].b, Tlen(hp->hd[u]));
+		p += Tlen(hp->hd[u]);
+		*p++ = '\r';
+		*p++ = '\n';
+		n++;
+	}
+	WS_ReleaseP(hp->ws, p);
+	*blk = b;
+	*len = p - b;
+	return (n);
+}
+
 /*--------------------------------------------------------------------*/
 
 void
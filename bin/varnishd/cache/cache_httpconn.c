@@ -49,6 +49,9 @@
 /*--------------------------------------------------------------------
  * Check if we have a complete HTTP request or response yet
  *
+ * Each call continues the scan where the previous one gave up, so a
+ * header trickling in is not scanned from the start for every read.
+ *
  * Return values:
  *	-3  All whitespace so far
  *	 0  No, keep trying
@@ -56,31 +59,45 @@
  */
 
 static int
-htc_header_complete(txt *t)
+htc_header_complete(struct http_conn *htc)
 {
-	const char *p;
+	txt *t = &htc->rxbuf;
+	const char *p, *q;
 
 	Tcheck(*t);
 	assert(*t->e == '\0');
-	/* Skip any leading white space */
-	for (p = t->b ; vct_islws(*p); p++)
-		continue;
-	if (p == t->e) {
-		/* All white space */
-		t->e = t->b;
-		*t->e = '\0';
-		return (-3);
+	p = htc->rxscan;
+	if (p == NULL) {
+		/* Skip any leading white space */
+		for (p = t->b ; vct_islws(*p); p++)
+			continue;
+		if (p == t->e) {
+			/* All white space */
+			t->e = t->b;
+			*t->e = '\0';
+			return (-3);
+		}
 	}
+	assert(p >= t->b && p <= t->e);
 	while (1) {
-		p = strchr(p, '\n');
-		if (p == NULL)
+		q = memchr(p, '\n', t->e - p);
+		if (q == NULL) {
+			/* Nothing before here needs looking at again */
+			htc->rxscan = t->e;
 			return (0);
-		p++;
+		}
+		p = q + 1;
 		if (*p == '\r')
 			p++;
 		if (*p == '\n')
 			break;
+		if (p == t->e) {
+			/* The next read may complete an empty line */
+			htc->rxscan = q;
+			return (0);
+		}
 	}
+	htc->rxscan = NULL;
 	p++;
 	return (p - t->b);
 }
@@ -103,8 +120,10 @@ HTC_Init(struct http_conn *htc, struct ws *ws, int fd, unsigned vsl_id,
 	htc->rxbuf.b = ws->f;
 	htc->rxbuf.e = ws->f;
 	*htc->rxbuf.e = '\0';
+	htc->rxscan = NULL;
 	htc->pipeline.b = NULL;
 	htc->pipeline.e = NULL;
+	htc->nread = 0;
 }
 
 /*--------------------------------------------------------------------
@@ -122,6 +141,7 @@ HTC_Reinit(struct http_conn *htc)
 	(void)WS_Reserve(htc->ws, htc->maxbytes);
 	htc->rxbuf.b = htc->ws->f;
 	htc->rxbuf.e = htc->ws->f;
+	htc->rxscan = NULL;
 	if (htc->pipeline.b != NULL) {
 		l = Tlen(htc->pipeline);
 		memmove(htc->rxbuf.b, htc->pipeline.b, l);
@@ -145,7 +165,7 @@ HTC_Complete(struct http_conn *htc)
 	int i;
 
 	CHECK_OBJ_NOTNULL(htc, HTTP_CONN_MAGIC);
-	i = htc_header_complete(&htc->rxbuf);
+	i = htc_header_complete(htc);
 	if (i <= 0)
 		return (i);
 	WS_ReleaseP(htc->ws, htc->rxbuf.e);
@@ -182,6 +202,7 @@ HTC_Rx(struct http_conn *htc)
 		return (-2);
 	}
 	i = read(htc->fd, htc->rxbuf.e, i);
+	htc->nread++;
 	if (i <= 0) {
 		/*
 		 * We wouldn't come here if we had a complete HTTP header
@@ -224,6 +245,7 @@ HTC_Read(struct worker *w, struct http_conn *htc, void *d, size_t len)
 	if (len == 0)
 		return (l);
 	i = read(htc->fd, p, len);
+	htc->nread++;
 	if (i < 0) {
 		WSL(w, SLT_FetchError, htc->vsl_id, "%s", strerror(errno));
 		return (i);
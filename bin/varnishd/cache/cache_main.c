@@ -127,6 +127,9 @@ child_main(void)
 	EXP_Init();
 	HSH_Init(heritage.hash);
 	BAN_Init();
+	Pipe_Init();
+	SND_Init();
+	Fetch_ParkInit();
 
 	VCA_Init();
 
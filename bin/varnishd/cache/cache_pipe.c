@@ -31,8 +31,10 @@
 
 #include "config.h"
 
+#include <fcntl.h>
 #include <poll.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "cache.h"
 
@@ -40,31 +42,304 @@
 #include "vtcp.h"
 #include "vtim.h"
 
+/*--------------------------------------------------------------------
+ * A pipe is two directions, each moving bytes from one socket to the
+ * other.  Whatever has been read, but not yet written, is parked until
+ * the other socket can take it: in a kernel pipe, where we have
+ * splice(2), so it never gets copied into userland, otherwise in a
+ * buffer.  The sockets are non-blocking, so a short write just means
+ * that we poll for POLLOUT next.
+ */
+
+#define VPI_CHUNK	(64 * 1024)
+
+struct vpi_dir {
+	int			rfd;
+	int			wfd;
+	int			pfd[2];		/* For splice(2) */
+	char			*buf;		/* ... or not */
+	size_t			off;
+	size_t			len;		/* Parked bytes */
+	unsigned		done;
+};
+
+struct vpi {
+	unsigned		magic;
+#define VPI_MAGIC		0x5a3c69e1
+	VTAILQ_ENTRY(vpi)	list;
+	int			fd;
+	struct vbc		*vc;
+	double			t_last;
+	struct vpi_dir		dir[2];		/* [0] is from the backend */
+};
+
+static void
+vpi_dir_init(struct vpi_dir *d, int rfd, int wfd)
+{
+
+	d->rfd = rfd;
+	d->wfd = wfd;
+	d->pfd[0] = d->pfd[1] = -1;
+#if defined(HAVE_SPLICE)
+	if (!pipe(d->pfd)) {
+		(void)VTCP_nonblocking(d->pfd[0]);
+		(void)VTCP_nonblocking(d->pfd[1]);
+		return;
+	}
+	d->pfd[0] = d->pfd[1] = -1;
+#endif
+	d->buf = malloc(VPI_CHUNK);
+	XXXAN(d->buf);
+}
+
+static void
+vpi_dir_fini(struct vpi_dir *d)
+{
+
+	if (d->pfd[0] >= 0) {
+		AZ(close(d->pfd[0]));
+		AZ(close(d->pfd[1]));
+	}
+	free(d->buf);
+}
+
+static void
+vpi_dir_end(struct vpi_dir *d)
+{
+
+	(void)shutdown(d->rfd, SHUT_RD);
+	(void)shutdown(d->wfd, SHUT_WR);
+	d->done = 1;
+}
+
+/* Returns -1 on EOF or error */
+
 static int
-rdf(int fd0, int fd1)
+vpi_dir_rx(struct vpi_dir *d)
 {
-	int i, j;
-	char buf[BUFSIZ], *p;
+	ssize_t i;
 
-	i = read(fd0, buf, sizeof buf);
+	AZ(d->len);
+#if defined(HAVE_SPLICE)
+	if (d->buf == NULL)
+		i = splice(d->rfd, NULL, d->pfd[1], NULL, VPI_CHUNK,
+		    SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	else
+#endif
+		i = read(d->rfd, d->buf, VPI_CHUNK);
+	if (i < 0 && (errno == EAGAIN || errno == EINTR))
+		return (0);
 	if (i <= 0)
-		return (1);
-	for (p = buf; i > 0; i -= j, p += j) {
-		j = write(fd1, p, i);
-		if (j <= 0)
-			return (1);
-		if (i != j)
-			(void)usleep(100000);		/* XXX hack */
-	}
+		return (-1);
+	d->off = 0;
+	d->len = i;
 	return (0);
 }
 
+static int
+vpi_dir_tx(struct vpi_dir *d)
+{
+	ssize_t i;
+
+	AN(d->len);
+#if defined(HAVE_SPLICE)
+	if (d->buf == NULL)
+		i = splice(d->pfd[0], NULL, d->wfd, NULL, d->len,
+		    SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	else
+#endif
+		i = write(d->wfd, d->buf + d->off, d->len);
+	if (i < 0 && (errno == EAGAIN || errno == EINTR))
+		return (0);
+	if (i <= 0)
+		return (-1);
+	d->off += i;
+	d->len -= i;
+	return (0);
+}
+
+/*--------------------------------------------------------------------*/
+
+static struct vpi *
+vpi_new(int fd, struct vbc *vc)
+{
+	struct vpi *vpi;
+
+	ALLOC_OBJ(vpi, VPI_MAGIC);
+	XXXAN(vpi);
+	vpi->fd = fd;
+	vpi->vc = vc;
+	(void)VTCP_nonblocking(fd);
+	(void)VTCP_nonblocking(vc->fd);
+	vpi_dir_init(&vpi->dir[0], vc->fd, fd);
+	vpi_dir_init(&vpi->dir[1], fd, vc->fd);
+	return (vpi);
+}
+
+static void
+vpi_free(struct vpi *vpi)
+{
+
+	CHECK_OBJ_NOTNULL(vpi, VPI_MAGIC);
+	vpi_dir_fini(&vpi->dir[0]);
+	vpi_dir_fini(&vpi->dir[1]);
+	FREE_OBJ(vpi);
+}
+
+static int
+vpi_done(const struct vpi *vpi)
+{
+
+	return (vpi->dir[0].done && vpi->dir[1].done);
+}
+
+/*
+ * Set up the pollfds for the two sockets, [0] backend and [1] client.
+ */
+
+static void
+vpi_want(const struct vpi *vpi, struct pollfd *fds)
+{
+	const struct vpi_dir *d;
+	int u;
+
+	fds[0].fd = vpi->vc->fd;
+	fds[1].fd = vpi->fd;
+	fds[0].events = fds[1].events = 0;
+	fds[0].revents = fds[1].revents = 0;
+	for (u = 0; u < 2; u++) {
+		d = &vpi->dir[u];
+		if (d->done)
+			continue;
+		if (d->len > 0)
+			fds[1 - u].events |= POLLOUT;
+		else
+			fds[u].events |= POLLIN;
+	}
+	/* Don't spin on POLLHUP from a socket we are done with */
+	for (u = 0; u < 2; u++)
+		if (fds[u].events == 0)
+			fds[u].fd = -1;
+}
+
+static void
+vpi_work(struct vpi *vpi, const struct pollfd *fds)
+{
+	struct vpi_dir *d;
+	int u;
+
+	for (u = 0; u < 2; u++) {
+		d = &vpi->dir[u];
+		if (d->done)
+			continue;
+		if (d->len == 0) {
+			if (!(fds[u].revents & (POLLIN | POLLERR | POLLHUP)))
+				continue;
+			if (vpi_dir_rx(d)) {
+				vpi_dir_end(d);
+				continue;
+			}
+			if (d->len == 0)
+				continue;
+			/* Chances are it can go right out again */
+		} else if (!(fds[1 - u].revents & (POLLOUT | POLLERR | POLLHUP)))
+			continue;
+		if (vpi_dir_tx(d))
+			vpi_dir_end(d);
+	}
+}
+
+/*--------------------------------------------------------------------
+ * With param pipe_thread, pipes are handed to a single thread which
+ * polls all of them, instead of keeping a worker thread each.
+ *
+ * XXX: The pollfds are rebuilt on every round, poll(2) is O(n) anyway.
+ */
+
+#define NPIPE	100
+
+static VTAILQ_HEAD(, vpi)	vpi_head = VTAILQ_HEAD_INITIALIZER(vpi_head);
+static int			vpi_pipes[2];
+static pthread_t		vpi_thr;
+
+static void
+vpi_close(struct worker *wrk, struct vpi *vpi)
+{
+
+	VTCP_close(&vpi->fd);
+	VDI_CloseFd(wrk, &vpi->vc);
+	vpi_free(vpi);
+}
+
+static void * __match_proto__(bgthread_t)
+vpi_thread(struct sess *sp, void *priv)
+{
+	struct vpi *vpi, *vpi2, *vv[NPIPE];
+	struct pollfd *fds = NULL;
+	unsigned n = 0, nfds = 0, u;
+	double now;
+	int i;
+
+	CHECK_OBJ_NOTNULL(sp, SESS_MAGIC);
+	(void)priv;
+	while (1) {
+		if (1 + 2 * n > nfds) {
+			nfds = 1 + 2 * (n + NPIPE);
+			fds = realloc(fds, nfds * sizeof *fds);
+			XXXAN(fds);
+		}
+		fds[0].fd = vpi_pipes[0];
+		fds[0].events = POLLIN;
+		fds[0].revents = 0;
+		u = 1;
+		VTAILQ_FOREACH(vpi, &vpi_head, list) {
+			vpi_want(vpi, fds + u);
+			u += 2;
+		}
+		assert(u == 1 + 2 * n);
+		(void)poll(fds, u, 1000);
+		now = VTIM_real();
+
+		u = 1;
+		VTAILQ_FOREACH_SAFE(vpi, &vpi_head, list, vpi2) {
+			if (fds[u].revents || fds[u + 1].revents) {
+				vpi_work(vpi, fds + u);
+				vpi->t_last = now;
+			}
+			u += 2;
+			if (vpi_done(vpi) ||
+			    now - vpi->t_last > cache_param->pipe_timeout) {
+				VTAILQ_REMOVE(&vpi_head, vpi, list);
+				n--;
+				vpi_close(sp->wrk, vpi);
+			}
+		}
+
+		if (fds[0].revents == 0)
+			continue;
+		i = read(vpi_pipes[0], vv, sizeof vv);
+		if (i <= 0)
+			continue;
+		for (u = 0; i >= sizeof vv[0]; u++, i -= sizeof vv[0]) {
+			CHECK_OBJ_NOTNULL(vv[u], VPI_MAGIC);
+			vv[u]->t_last = now;
+			VTAILQ_INSERT_TAIL(&vpi_head, vv[u], list);
+			n++;
+		}
+		assert(i == 0);
+	}
+	NEEDLESS_RETURN(NULL);
+}
+
+/*--------------------------------------------------------------------*/
+
 void
 PipeSession(struct sess *sp)
 {
 	struct vbc *vc;
 	struct worker *w;
 	struct pollfd fds[2];
+	struct vpi *vpi;
 	int i;
 
 	CHECK_OBJ_NOTNULL(sp, SESS_MAGIC);
@@ -96,40 +371,40 @@ PipeSession(struct sess *sp)
 
 	sp->req->t_resp = VTIM_real();
 
-	memset(fds, 0, sizeof fds);
-
 	// XXX: not yet (void)VTCP_linger(vc->fd, 0);
-	fds[0].fd = vc->fd;
-	fds[0].events = POLLIN | POLLERR;
-
 	// XXX: not yet (void)VTCP_linger(sp->fd, 0);
-	fds[1].fd = sp->fd;
-	fds[1].events = POLLIN | POLLERR;
+	vpi = vpi_new(sp->fd, vc);
 
-	while (fds[0].fd > -1 || fds[1].fd > -1) {
-		fds[0].revents = 0;
-		fds[1].revents = 0;
+	if (cache_param->pipe_thread) {
+		/* The pipe thread closes both sockets when done */
+		VSL(SLT_SessionClose, sp->vsl_id, "pipe");
+		sp->fd = -1;
+		sp->wrk->busyobj->vbc = NULL;
+		sp->wrk->stats.pipe_handoff++;
+		assert(sizeof vpi == write(vpi_pipes[1], &vpi, sizeof vpi));
+		return;
+	}
+
+	while (!vpi_done(vpi)) {
+		vpi_want(vpi, fds);
 		i = poll(fds, 2, cache_param->pipe_timeout * 1000);
 		if (i < 1)
 			break;
-		if (fds[0].revents && rdf(vc->fd, sp->fd)) {
-			if (fds[1].fd == -1)
-				break;
-			(void)shutdown(vc->fd, SHUT_RD);
-			(void)shutdown(sp->fd, SHUT_WR);
-			fds[0].events = 0;
-			fds[0].fd = -1;
-		}
-		if (fds[1].revents && rdf(sp->fd, vc->fd)) {
-			if (fds[0].fd == -1)
-				break;
-			(void)shutdown(sp->fd, SHUT_RD);
-			(void)shutdown(vc->fd, SHUT_WR);
-			fds[1].events = 0;
-			fds[1].fd = -1;
-		}
+		vpi_work(vpi, fds);
 	}
+	vpi_free(vpi);
 	SES_Close(sp, "pipe");
 	VDI_CloseFd(sp->wrk, &vc);
 	sp->wrk->busyobj->vbc = NULL;
 }
+
+/*--------------------------------------------------------------------*/
+
+void
+Pipe_Init(void)
+{
+
+	AZ(pipe(vpi_pipes));
+	(void)VTCP_nonblocking(vpi_pipes[0]);
+	WRK_BgThread(&vpi_thr, "cache-pipe", vpi_thread, NULL);
+}
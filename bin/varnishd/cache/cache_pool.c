@@ -38,13 +38,46 @@
  * The algorithm for when to create threads needs to be reactive enough
  * to handle startup spikes, but sufficiently attenuated to not cause
  * thread pileups.  This remains subject for improvement.
+ *
+ * Pools can be bound to a set of CPUs (param thread_pool_affinity).
+ * The herder binds itself before it creates any workers, and workers
+ * inherit the binding, so their stacks and the session memory they
+ * allocate are first touched, and therefore placed, on the local NUMA
+ * node.  Since every pool accepts on its own, the connections it takes
+ * in are also handled on the CPUs which accepted them.
+ *
+ * Pools come in two flavours, picked when the pool is created (param
+ * thread_pool_lockfree):  Mutex pools hand sessions and accepted
+ * connections to workers under pp->mtx, lock-free pools use an atomic
+ * queue and parked workers instead, see below.
+ *
+ * Idle workers steal queued sessions from sibling pools, and a pool
+ * with no idle workers offers new sessions to an idle sibling before
+ * it queues them (param thread_pool_steal).  Sessions always go back
+ * to the pool which owns their memory.
+ *
+ * Every pool measures how long sessions wait between Pool_Schedule()
+ * and a worker picking them up.  With param thread_pool_herder set to
+ * "latency", the herder sizes the pool to keep that below a target,
+ * instead of looking at the length of the queue.
  */
 
 #include "config.h"
 
 #include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
 
+#ifdef HAVE_SCHED_GETAFFINITY
+#  include <sched.h>
+#endif
+
+#ifdef HAVE_LINUX_FUTEX_H
+#  include <linux/futex.h>
+#  include <sys/syscall.h>
+#  include <unistd.h>
+#endif
+
 #include "cache.h"
 #include "common/heritage.h"
 
@@ -87,6 +120,12 @@ struct poolsock {
 #define POOLSOCK_MAGIC			0x1b0a2d38
 	VTAILQ_ENTRY(poolsock)		list;
 	struct listen_sock		*lsock;
+	volatile unsigned		busy;	/* lock-free pools */
+};
+
+struct poolq_cell {
+	volatile unsigned long		seq;
+	struct sess			*sp;
 };
 
 /* Number of work requests queued in excess of worker threads available */
@@ -110,11 +149,243 @@ struct pool {
 	uintmax_t		ndropped;
 	uintmax_t		nqueued;
 	struct sesspool		*sesspool;
+
+	/* Queue latency, in microseconds */
+#define POOL_LAT_BUCKETS	25	/* [n]: below 2^n us */
+	uint64_t		lat_hist[POOL_LAT_BUCKETS];
+	uint64_t		lat_sum;
+	uint64_t		lat_n;
+	uint64_t		lat_last_hist[POOL_LAT_BUCKETS];
+	uint64_t		lat_last_sum;
+	uint64_t		lat_last_n;
+	double			lat_last;
+	double			lat_ewma;
+	uint64_t		lat_p95;
+
+	struct VSC_C_pool	*vsc;
+	unsigned		ncpu;
+#ifdef HAVE_SCHED_GETAFFINITY
+	cpu_set_t		cpuset;
+#endif
+
+	unsigned		lockfree;
+#ifdef HAVE_SYNC_BUILTINS
+	struct {
+		unsigned long		mask;
+		struct poolq_cell	*cell;
+		volatile unsigned long	head;
+		char			pad[64];
+		volatile unsigned long	tail;
+	}			lfq;
+	volatile unsigned	ev_seq;
+	volatile unsigned	nidle;
+	volatile unsigned	nretire;
+	pthread_cond_t		ev_cond;
+	struct lock		ev_mtx;
+#endif
 };
 
+/* Counters which lock-free pools update without holding pp->mtx */
+#ifdef HAVE_SYNC_BUILTINS
+#define POOL_ADD(pp, var, n)					\
+	do {							\
+		if ((pp)->lockfree)				\
+			(void)__sync_fetch_and_add(&(var), n);	\
+		else						\
+			(var) += (n);				\
+	} while (0)
+#else
+#define POOL_ADD(pp, var, n)	do { (var) += (n); } while (0)
+#endif
+
 static struct lock		pool_mtx;
 static pthread_t		thr_pool_herder;
 
+/* Pools are never removed, so this can be walked without locking */
+static VTAILQ_HEAD(,pool)	pools = VTAILQ_HEAD_INITIALIZER(pools);
+
+static struct sess *pool_steal(const struct pool *pp);
+static int pool_kick(const struct pool *pp, struct sess *sp);
+
+#ifdef HAVE_SCHED_GETAFFINITY
+static cpu_set_t		pool_cpus;	/* What we are allowed to use */
+
+/*--------------------------------------------------------------------
+ * Find the CPUs of a NUMA node, from a cpulist like "0-3,8-11"
+ */
+
+static int
+pool_numa_node(unsigned node_no, cpu_set_t *cs)
+{
+	char buf[128], line[BUFSIZ], *p;
+	unsigned long lo, hi;
+	FILE *fi;
+
+	bprintf(buf, "/sys/devices/system/node/node%u/cpulist", node_no);
+	fi = fopen(buf, "r");
+	if (fi == NULL)
+		return (-1);
+	p = fgets(line, sizeof line, fi);
+	AZ(fclose(fi));
+	if (p == NULL)
+		return (-1);
+	CPU_ZERO(cs);
+	while (*p != '\0' && *p != '\n') {
+		lo = hi = strtoul(p, &p, 10);
+		if (*p == '-')
+			hi = strtoul(p + 1, &p, 10);
+		for (; lo <= hi && lo < CPU_SETSIZE; lo++)
+			CPU_SET(lo, cs);
+		if (*p == ',')
+			p++;
+		else if (*p != '\0' && *p != '\n')
+			return (-1);
+	}
+	CPU_AND(cs, cs, &pool_cpus);
+	return (CPU_COUNT(cs) > 0 ? 0 : -1);
+}
+
+/*--------------------------------------------------------------------
+ * Decide which CPUs a pool gets.
+ *
+ * In "cpu" mode, the CPUs are sliced evenly between the pools, if there
+ * are more pools than CPUs they share round-robin.  In "numa" mode the
+ * pools are spread round-robin over the nodes.
+ */
+
+static void
+pool_cpuset(struct pool *pp, unsigned pool_no)
+{
+	unsigned u, n, ncpu, npool, lo, hi;
+	cpu_set_t cs;
+
+	CPU_ZERO(&pp->cpuset);
+	pp->ncpu = 0;
+	if (cache_param->wthread_affinity == WTHREAD_AFFINITY_OFF)
+		return;
+
+	if (cache_param->wthread_affinity == WTHREAD_AFFINITY_NUMA) {
+		for (n = 0; pool_numa_node(n, &cs) == 0; n++)
+			continue;
+		if (n > 0 && pool_numa_node(pool_no % n, &cs) == 0) {
+			pp->cpuset = cs;
+			pp->ncpu = CPU_COUNT(&cs);
+			return;
+		}
+		/* No NUMA topology, fall back to slicing CPUs */
+	}
+
+	ncpu = CPU_COUNT(&pool_cpus);
+	if (ncpu == 0)
+		return;
+	npool = cache_param->wthread_pools;
+	if (pool_no >= npool)
+		npool = pool_no + 1;
+	if (npool > ncpu) {
+		lo = pool_no % ncpu;
+		hi = lo + 1;
+	} else {
+		lo = (pool_no * ncpu) / npool;
+		hi = ((pool_no + 1) * ncpu) / npool;
+	}
+	for (u = n = 0; u < CPU_SETSIZE && n < hi; u++) {
+		if (!CPU_ISSET(u, &pool_cpus))
+			continue;
+		if (n >= lo)
+			CPU_SET(u, &pp->cpuset);
+		n++;
+	}
+	pp->ncpu = CPU_COUNT(&pp->cpuset);
+}
+
+/*--------------------------------------------------------------------
+ * Bind the calling thread to the pools CPUs
+ */
+
+static void
+pool_bind(const struct pool *pp)
+{
+
+	if (pp->ncpu == 0)
+		return;
+	if (sched_setaffinity(0, sizeof pp->cpuset, &pp->cpuset))
+		VSL(SLT_Debug, 0, "Pool CPU binding failed %d %s",
+		    errno, strerror(errno));
+}
+#endif
+
+/*--------------------------------------------------------------------
+ * Account if a session is picked up on one of the pools CPUs
+ */
+
+static void
+pool_locality(struct pool *pp)
+{
+#if defined(HAVE_SCHED_GETAFFINITY) && defined(HAVE_SCHED_GETCPU)
+	int i;
+
+	if (pp->ncpu == 0)
+		return;
+	i = sched_getcpu();
+	if (i >= 0 && i < CPU_SETSIZE && CPU_ISSET(i, &pp->cpuset))
+		POOL_ADD(pp, pp->vsc->sess_local, 1);
+	else
+		POOL_ADD(pp, pp->vsc->sess_remote, 1);
+#else
+	(void)pp;
+#endif
+}
+
+/*--------------------------------------------------------------------
+ * Account how long a session waited for a worker.
+ */
+
+static void
+pool_latency(struct pool *pp, struct sess *sp)
+{
+	uint64_t us;
+	unsigned b;
+	double d;
+
+	CHECK_OBJ_NOTNULL(sp, SESS_MAGIC);
+	if (isnan(sp->t_sched))
+		return;
+	d = VTIM_mono() - sp->t_sched;
+	sp->t_sched = NAN;
+	us = d > 0. ? (uint64_t)(d * 1e6) : 0;
+	for (b = 0; b < POOL_LAT_BUCKETS - 1 && us >= (1ULL << b); b++)
+		continue;
+	POOL_ADD(pp, pp->lat_hist[b], 1);
+	POOL_ADD(pp, pp->lat_sum, us);
+	POOL_ADD(pp, pp->lat_n, 1);
+	if (us < 100)
+		POOL_ADD(pp, pp->vsc->qlat_100us, 1);
+	else if (us < 1000)
+		POOL_ADD(pp, pp->vsc->qlat_1ms, 1);
+	else if (us < 10000)
+		POOL_ADD(pp, pp->vsc->qlat_10ms, 1);
+	else if (us < 100000)
+		POOL_ADD(pp, pp->vsc->qlat_100ms, 1);
+	else if (us < 1000000)
+		POOL_ADD(pp, pp->vsc->qlat_1s, 1);
+	else
+		POOL_ADD(pp, pp->vsc->qlat_slow, 1);
+}
+
+/*--------------------------------------------------------------------
+ * Take the pool lock, counting how often somebody else had it.
+ */
+
+static void
+pool_lock(struct pool *pp)
+{
+
+	if (Lck_Trylock(&pp->mtx)) {
+		Lck_Lock(&pp->mtx);
+		pp->vsc->contended++;
+	}
+}
+
 /*--------------------------------------------------------------------
  * Nobody is accepting on this socket, so we do.
  *
@@ -149,7 +420,7 @@ pool_accept(struct pool *pp, struct worker *w, const struct poolsock *ps)
 
 		if (ps->lsock->sock < 0) {
 			/* Socket Shutdown */
-			Lck_Lock(&pp->mtx);
+			pool_lock(pp);
 			return (-1);
 		}
 		if (VCA_Accept(ps->lsock, wa) < 0) {
@@ -159,7 +430,7 @@ pool_accept(struct pool *pp, struct worker *w, const struct poolsock *ps)
 			continue;
 		}
 
-		Lck_Lock(&pp->mtx);
+		pool_lock(pp);
 		if (VTAILQ_EMPTY(&pp->idle))
 			return (0);
 		w2 = VTAILQ_FIRST(&pp->idle);
@@ -174,19 +445,108 @@ pool_accept(struct pool *pp, struct worker *w, const struct poolsock *ps)
 }
 
 /*--------------------------------------------------------------------
- * This is the work function for worker threads in the pool.
+ * Drain up to accept_batch - 1 more connections from the listen socket
+ * we just accepted on, and schedule them like sessions coming back from
+ * the waiter.
  */
 
-void
-Pool_Work_Thread(void *priv, struct worker *w)
+static void
+pool_accept_batch(struct pool *pp, struct worker *w, struct listen_sock *ls)
+{
+	struct wrk_accept wa;
+	struct sess *sp;
+	unsigned u;
+
+	for (u = 1; u < cache_param->accept_batch; u++) {
+		memset(&wa, 0, sizeof wa);
+		wa.magic = WRK_ACCEPT_MAGIC;
+		if (VCA_AcceptMore(ls, &wa) < 0)
+			break;
+		sp = SES_New(w, pp->sesspool);
+		if (sp == NULL) {
+			VCA_FailSess(w, &wa);
+			break;
+		}
+		VCA_SetupSess(w, sp, &wa);
+		sp->step = STP_FIRST;
+		if (Pool_Schedule(pp, sp)) {
+			w->stats.sess_drop++;
+			SES_Delete(sp, "dropped", NAN);
+			break;
+		}
+	}
+}
+
+/*--------------------------------------------------------------------
+ * Do what the worker was told to do
+ */
+
+static void
+pool_work(struct pool *pp, struct worker *w)
+{
+	struct wrk_accept *wa;
+
+	if (w->do_what == pool_do_accept) {
+		/* Turn accepted socket into a session */
+		AZ(w->sp);
+		AN(w->ws->r);
+		CAST_OBJ_NOTNULL(wa, (void*)w->ws->f, WRK_ACCEPT_MAGIC);
+		w->sp = SES_New(w, pp->sesspool);
+		if (w->sp == NULL) {
+			VCA_FailSess(w, wa);
+			w->do_what = pool_do_nothing;
+		} else {
+			VCA_SetupSess(w, w->sp, wa);
+			w->sp->step = STP_FIRST;
+			w->do_what = pool_do_sess;
+			if (cache_param->accept_batch > 1)
+				pool_accept_batch(pp, w, w->sp->mylsock);
+		}
+		WS_Release(w->ws, 0);
+	}
+
+	if (w->do_what == pool_do_sess) {
+		CHECK_OBJ_NOTNULL(w->sp, SESS_MAGIC);
+		AZ(w->ws->r);
+
+		w->lastused = NAN;
+		w->storage_hint = NULL;
+
+		AZ(w->sp->wrk);
+		THR_SetSession(w->sp);
+		w->sp->wrk = w;
+		CNT_Session(w->sp);
+		THR_SetSession(NULL);
+		w->sp = NULL;
+
+		WS_Assert(w->ws);
+		AZ(w->busyobj);
+		AZ(w->resp->ws);
+		AZ(w->wrw.wfd);
+		AZ(w->storage_hint);
+		assert(w->wlp == w->wlb);
+		if (cache_param->diag_bitmap & 0x00040000) {
+			if (w->vcl != NULL)
+				VCL_Rel(&w->vcl);
+		}
+	} else if (w->do_what == pool_do_nothing) {
+		/* we already did */
+	} else {
+		WRONG("Invalid w->do_what");
+	}
+}
+
+/*--------------------------------------------------------------------
+ * The worker loop of mutex pools.
+ */
+
+static void
+pool_work_locked(struct pool *pp, struct worker *w)
 {
-	struct pool *pp;
 	int stats_clean, i;
 	struct poolsock *ps;
 
-	CAST_OBJ_NOTNULL(pp, priv, POOL_MAGIC);
-	w->pool = pp;
-	Lck_Lock(&pp->mtx);
+	pool_lock(pp);
 	stats_clean = 1;
 	while (1) {
 
@@ -205,6 +565,7 @@ Pool_Work_Thread(void *priv, struct worker *w)
 			VTAILQ_REMOVE(&pp->queue, w->sp, poollist);
 			w->do_what = pool_do_sess;
 			pp->lqueue--;
+			pp->vsc->queue_len = pp->lqueue;
 		} else if (!VTAILQ_EMPTY(&pp->socks)) {
 			/* Accept on a socket */
 			ps = VTAILQ_FIRST(&pp->socks);
@@ -219,6 +580,11 @@ Pool_Work_Thread(void *priv, struct worker *w)
 			}
 			VTAILQ_INSERT_TAIL(&pp->socks, ps, list);
 			w->do_what = pool_do_accept;
+		} else if (cache_param->wthread_steal &&
+		    (w->sp = pool_steal(pp)) != NULL) {
+			/* Help out a sibling pool */
+			pp->vsc->steals++;
+			w->do_what = pool_do_sess;
 		} else if (VTAILQ_EMPTY(&pp->socks)) {
 			/* Nothing to do: To sleep, perchance to dream ... */
 			if (isnan(w->lastused))
@@ -232,59 +598,20 @@ Pool_Work_Thread(void *priv, struct worker *w)
 		if (w->do_what == pool_do_die)
 			break;
 
+		if (w->do_what == pool_do_sess)
+			pool_latency(pp, w->sp);
+		if (w->do_what == pool_do_sess ||
+		    w->do_what == pool_do_accept)
+			pool_locality(pp);
+
 		Lck_Unlock(&pp->mtx);
 
-		if (w->do_what == pool_do_accept) {
-			/* Turn accepted socket into a session */
-			AZ(w->sp);
-			AN(w->ws->r);
-			w->sp = SES_New(w, pp->sesspool);
-			if (w->sp == NULL) {
-				VCA_FailSess(w);
-				w->do_what = pool_do_nothing;
-			} else {
-				VCA_SetupSess(w);
-				w->sp->step = STP_FIRST;
-				w->do_what = pool_do_sess;
-			}
-			WS_Release(w->ws, 0);
-		}
+		pool_work(pp, w);
 
-		if (w->do_what == pool_do_sess) {
-			CHECK_OBJ_NOTNULL(w->sp, SESS_MAGIC);
-			AZ(w->ws->r);
-
-			stats_clean = 0;
-			w->lastused = NAN;
-			w->storage_hint = NULL;
-
-			AZ(w->sp->wrk);
-			THR_SetSession(w->sp);
-			w->sp->wrk = w;
-			CNT_Session(w->sp);
-			THR_SetSession(NULL);
-			w->sp = NULL;
-
-			WS_Assert(w->ws);
-			AZ(w->busyobj);
-			AZ(w->resp->ws);
-			AZ(w->wrw.wfd);
-			AZ(w->storage_hint);
-			assert(w->wlp == w->wlb);
-			if (cache_param->diag_bitmap & 0x00040000) {
-				if (w->vcl != NULL)
-					VCL_Rel(&w->vcl);
-			}
-		} else if (w->do_what == pool_do_nothing) {
-			/* we already did */
-		} else {
-			WRONG("Invalid w->do_what");
-		}
 		stats_clean = WRK_TrySumStat(w);
-		Lck_Lock(&pp->mtx);
+		pool_lock(pp);
 	}
 	Lck_Unlock(&pp->mtx);
-	w->pool = NULL;
 }
 
 /*--------------------------------------------------------------------
@@ -298,7 +625,7 @@ pool_queue(struct pool *pp, struct sess *sp)
 {
 	struct worker *w;
 
-	Lck_Lock(&pp->mtx);
+	pool_lock(pp);
 
 	/* If there are idle threads, we tickle the first one into action */
 	w = VTAILQ_FIRST(&pp->idle);
@@ -311,9 +638,18 @@ pool_queue(struct pool *pp, struct sess *sp)
 		return (0);
 	}
 
+	/* See if a sibling has idle threads */
+	if (cache_param->wthread_steal) {
+		Lck_Unlock(&pp->mtx);
+		if (!pool_kick(pp, sp))
+			return (0);
+		pool_lock(pp);
+	}
+
 	/* If we have too much in the queue already, refuse. */
 	if (pp->lqueue > (cache_param->queue_max * pp->nthr) / 100) {
 		pp->ndropped++;
+		pp->vsc->sess_dropped++;
 		Lck_Unlock(&pp->mtx);
 		return (-1);
 	}
@@ -321,11 +657,500 @@ pool_queue(struct pool *pp, struct sess *sp)
 	VTAILQ_INSERT_TAIL(&pp->queue, sp, poollist);
 	pp->nqueued++;
 	pp->lqueue++;
+	pp->vsc->sess_queued++;
+	pp->vsc->queue_len = pp->lqueue;
 	Lck_Unlock(&pp->mtx);
 	AZ(pthread_cond_signal(&pp->herder_cond));
 	return (0);
 }
 
+#ifdef HAVE_SYNC_BUILTINS
+
+/*--------------------------------------------------------------------
+ * Lock-free pools
+ *
+ * Sessions are handed to the workers through a bounded MPMC ring, after
+ * Dmitry Vyukovs design:  Every cell carries a sequence number which
+ * tells producers and consumers whose turn it is, so the only shared
+ * writes are one CAS on the head or tail index.
+ *
+ * Idle workers park on an eventcount: they sample the sequence, announce
+ * themselves in nidle, look for work once more and then sleep until the
+ * sequence changes.  Producers bump the sequence after they publish work
+ * and only make a system call if somebody is parked.
+ *
+ * Accepting is leader/follower: a worker claims a listen socket, and
+ * once it has a connection it releases the claim and wakes a parked
+ * worker to take over while it handles the connection itself.
+ *
+ * There is no idle list for the herder to reap from, workers which
+ * have been parked for thread_pool_timeout retire on their own.
+ */
+
+static void
+pool_lf_init(struct pool *pp)
+{
+	unsigned long u, n;
+	pthread_condattr_t cv_attr;
+
+	n = (unsigned long)cache_param->queue_max * cache_param->wthread_max;
+	n /= 100;
+	if (n < 256)
+		n = 256;
+	if (n > 65536)
+		n = 65536;
+	for (u = 1; u < n; u <<= 1)
+		continue;
+	pp->lfq.mask = u - 1;
+	pp->lfq.cell = calloc(u, sizeof *pp->lfq.cell);
+	XXXAN(pp->lfq.cell);
+	for (n = 0; n < u; n++)
+		pp->lfq.cell[n].seq = n;
+
+	AZ(pthread_condattr_init(&cv_attr));
+	AZ(pthread_condattr_setclock(&cv_attr, CLOCK_MONOTONIC));
+	AZ(pthread_cond_init(&pp->ev_cond, &cv_attr));
+	AZ(pthread_condattr_destroy(&cv_attr));
+	Lck_New(&pp->ev_mtx, lck_wq);
+}
+
+static int
+pool_lf_enq(struct pool *pp, struct sess *sp)
+{
+	struct poolq_cell *c;
+	unsigned long pos;
+	long d;
+
+	pos = pp->lfq.head;
+	while (1) {
+		c = &pp->lfq.cell[pos & pp->lfq.mask];
+		d = (long)(c->seq - pos);
+		if (d == 0) {
+			if (__sync_bool_compare_and_swap(&pp->lfq.head,
+			    pos, pos + 1))
+				break;
+			POOL_ADD(pp, pp->vsc->contended, 1);
+		} else if (d < 0)
+			return (-1);		/* Full */
+		pos = pp->lfq.head;
+	}
+	c->sp = sp;
+	__sync_synchronize();
+	c->seq = pos + 1;
+	return (0);
+}
+
+static struct sess *
+pool_lf_deq(struct pool *pp)
+{
+	struct poolq_cell *c;
+	struct sess *sp;
+	unsigned long pos;
+	long d;
+
+	pos = pp->lfq.tail;
+	while (1) {
+		c = &pp->lfq.cell[pos & pp->lfq.mask];
+		d = (long)(c->seq - (pos + 1));
+		if (d == 0) {
+			if (__sync_bool_compare_and_swap(&pp->lfq.tail,
+			    pos, pos + 1))
+				break;
+			POOL_ADD(pp, pp->vsc->contended, 1);
+		} else if (d < 0)
+			return (NULL);		/* Empty */
+		pos = pp->lfq.tail;
+	}
+	sp = c->sp;
+	__sync_synchronize();
+	c->seq = pos + pp->lfq.mask + 1;
+	return (sp);
+}
+
+static unsigned
+pool_lf_len(const struct pool *pp)
+{
+	unsigned long h, t;
+
+	t = pp->lfq.tail;
+	h = pp->lfq.head;
+	return (h > t ? (unsigned)(h - t) : 0);
+}
+
+/*--------------------------------------------------------------------
+ * Eventcount for parking idle workers.
+ */
+
+static void
+pool_ev_wake(struct pool *pp)
+{
+
+	(void)__sync_fetch_and_add(&pp->ev_seq, 1);
+	if (pp->nidle == 0)
+		return;
+#ifdef HAVE_LINUX_FUTEX_H
+	(void)syscall(SYS_futex, &pp->ev_seq, FUTEX_WAKE_PRIVATE, 1,
+	    NULL, NULL, 0);
+#else
+	Lck_Lock(&pp->ev_mtx);
+	AZ(pthread_cond_signal(&pp->ev_cond));
+	Lck_Unlock(&pp->ev_mtx);
+#endif
+}
+
+static int
+pool_ev_wait(struct pool *pp, unsigned key)
+{
+	struct timespec ts;
+	int i;
+
+#ifdef HAVE_LINUX_FUTEX_H
+	ts.tv_sec = cache_param->wthread_timeout;
+	ts.tv_nsec = 0;
+	i = syscall(SYS_futex, &pp->ev_seq, FUTEX_WAIT_PRIVATE, key,
+	    &ts, NULL, 0);
+	if (i < 0 && errno == ETIMEDOUT)
+		return (ETIMEDOUT);
+	return (0);
+#else
+	AZ(clock_gettime(CLOCK_MONOTONIC, &ts));
+	ts.tv_sec += cache_param->wthread_timeout;
+	i = 0;
+	Lck_Lock(&pp->ev_mtx);
+	if (pp->ev_seq == key)
+		i = Lck_CondWait(&pp->ev_cond, &pp->ev_mtx, &ts);
+	Lck_Unlock(&pp->ev_mtx);
+	return (i);
+#endif
+}
+
+/*--------------------------------------------------------------------
+ * Claim a listen socket nobody is accepting on.
+ */
+
+static int
+pool_lf_idle(const struct pool *pp)
+{
+	const struct poolsock *ps;
+
+	if (pp->lfq.head != pp->lfq.tail)
+		return (0);
+	VTAILQ_FOREACH(ps, &pp->socks, list)
+		if (!ps->busy && ps->lsock->sock >= 0)
+			return (0);
+	return (1);
+}
+
+static struct poolsock *
+pool_lf_claim(struct pool *pp)
+{
+	struct poolsock *ps;
+
+	VTAILQ_FOREACH(ps, &pp->socks, list) {
+		if (ps->busy || ps->lsock->sock < 0)
+			continue;
+		if (__sync_bool_compare_and_swap(&ps->busy, 0, 1))
+			return (ps);
+		POOL_ADD(pp, pp->vsc->contended, 1);
+	}
+	return (NULL);
+}
+
+static int
+pool_lf_accept(struct pool *pp, struct worker *w, struct poolsock *ps)
+{
+	struct wrk_accept *wa;
+
+	CHECK_OBJ_NOTNULL(ps, POOLSOCK_MAGIC);
+	CHECK_OBJ_NOTNULL(ps->lsock, LISTEN_SOCK_MAGIC);
+	assert(sizeof *wa == WS_Reserve(w->ws, sizeof *wa));
+	wa = (void*)w->ws->f;
+	while (1) {
+		memset(wa, 0, sizeof *wa);
+		wa->magic = WRK_ACCEPT_MAGIC;
+
+		if (ps->lsock->sock < 0) {
+			/* Socket Shutdown, leave it claimed forever */
+			return (-1);
+		}
+		if (VCA_Accept(ps->lsock, wa) >= 0)
+			break;
+		w->stats.sess_fail++;
+		(void)WRK_TrySumStat(w);
+	}
+	__sync_lock_release(&ps->busy);
+	pool_ev_wake(pp);
+	return (0);
+}
+
+/*--------------------------------------------------------------------
+ * Retire a worker, unless it would take us below thread_pool_min.
+ */
+
+static int
+pool_lf_retire(struct pool *pp)
+{
+	unsigned u;
+
+	do {
+		u = pp->nthr;
+		if (u <= cache_param->wthread_min)
+			return (0);
+	} while (!__sync_bool_compare_and_swap(&pp->nthr, u, u - 1));
+	pp->vsc->threads = u - 1;
+	Lck_Lock(&pool_mtx);
+	VSC_C_main->threads--;
+	VSC_C_main->threads_destroyed++;
+	Lck_Unlock(&pool_mtx);
+	return (1);
+}
+
+/*--------------------------------------------------------------------
+ * Has the herder asked somebody to retire ?
+ */
+
+static int
+pool_lf_retire_req(struct pool *pp)
+{
+	unsigned u;
+
+	do {
+		u = pp->nretire;
+		if (u == 0)
+			return (0);
+	} while (!__sync_bool_compare_and_swap(&pp->nretire, u, u - 1));
+	return (1);
+}
+
+/*--------------------------------------------------------------------
+ * The worker loop of lock-free pools.
+ */
+
+static void
+pool_work_lockfree(struct pool *pp, struct worker *w)
+{
+	struct poolsock *ps;
+	unsigned key;
+	int stats_clean, i;
+
+	stats_clean = 1;
+	while (1) {
+		w->do_what = pool_do_inval;
+
+		CHECK_OBJ_NOTNULL(w, WORKER_MAGIC);
+		CHECK_OBJ_NOTNULL(w->resp, HTTP_MAGIC);
+
+		WS_Reset(w->ws, NULL);
+
+		w->sp = pool_lf_deq(pp);
+		if (w->sp != NULL) {
+			w->do_what = pool_do_sess;
+		} else if ((ps = pool_lf_claim(pp)) != NULL) {
+			if (pool_lf_accept(pp, w, ps)) {
+				WS_Release(w->ws, 0);
+				continue;
+			}
+			w->do_what = pool_do_accept;
+		} else if (cache_param->wthread_steal &&
+		    (w->sp = pool_steal(pp)) != NULL) {
+			/* Help out a sibling pool */
+			POOL_ADD(pp, pp->vsc->steals, 1);
+			w->do_what = pool_do_sess;
+		} else {
+			/* Nothing to do: To sleep, perchance to dream ... */
+			if (!stats_clean) {
+				WRK_SumStat(w);
+				stats_clean = 1;
+			}
+			key = pp->ev_seq;
+			(void)__sync_fetch_and_add(&pp->nidle, 1);
+			i = 0;
+			if (pool_lf_idle(pp))
+				i = pool_ev_wait(pp, key);
+			(void)__sync_fetch_and_sub(&pp->nidle, 1);
+			if ((i == ETIMEDOUT ||
+			    pp->nthr > cache_param->wthread_max ||
+			    pool_lf_retire_req(pp)) &&
+			    pool_lf_retire(pp))
+				break;
+			continue;
+		}
+
+		if (w->do_what == pool_do_sess)
+			pool_latency(pp, w->sp);
+		pool_locality(pp);
+		pool_work(pp, w);
+		stats_clean = WRK_TrySumStat(w);
+	}
+}
+
+/*--------------------------------------------------------------------*/
+
+static int
+pool_lf_queue(struct pool *pp, struct sess *sp)
+{
+
+	/* If we have too much in the queue already, refuse. */
+	if (pp->nidle == 0 && cache_param->wthread_steal &&
+	    !pool_kick(pp, sp))
+		return (0);
+	if (pp->nidle == 0 &&
+	    pool_lf_len(pp) > (cache_param->queue_max * pp->nthr) / 100) {
+		(void)__sync_fetch_and_add(&pp->ndropped, 1);
+		return (-1);
+	}
+	if (pool_lf_enq(pp, sp)) {
+		(void)__sync_fetch_and_add(&pp->ndropped, 1);
+		return (-1);
+	}
+	if (pp->nidle == 0) {
+		(void)__sync_fetch_and_add(&pp->nqueued, 1);
+		AZ(pthread_cond_signal(&pp->herder_cond));
+	}
+	pool_ev_wake(pp);
+	return (0);
+}
+
+/*--------------------------------------------------------------------
+ * The herder rolls up the lock-free counters.
+ */
+
+static void
+pool_lf_stats(struct pool *pp)
+{
+	uintmax_t u;
+
+	pp->lqueue = pool_lf_len(pp);
+	pp->vsc->queue_len = pp->lqueue;
+	u = pp->nqueued;
+	(void)__sync_fetch_and_sub(&pp->nqueued, u);
+	pp->vsc->sess_queued += u;
+	Lck_Lock(&pool_mtx);
+	VSC_C_main->sess_queued += u;
+	Lck_Unlock(&pool_mtx);
+	u = pp->ndropped;
+	(void)__sync_fetch_and_sub(&pp->ndropped, u);
+	pp->vsc->sess_dropped += u;
+	Lck_Lock(&pool_mtx);
+	VSC_C_main->sess_dropped += u;
+	Lck_Unlock(&pool_mtx);
+}
+
+#endif /* HAVE_SYNC_BUILTINS */
+
+/*--------------------------------------------------------------------
+ * Steal a queued session from a sibling pool.
+ *
+ * We never wait for a siblings lock, if it is busy, it is likely busy
+ * dequeuing the session we are after.  pool_mtx keeps the list of pools
+ * still while the pool herder adds to it, and it is never held while
+ * waiting for a pools lock, so it is safe to take it under our own.
+ */
+
+static struct sess *
+pool_steal(const struct pool *pp)
+{
+	struct pool *qp;
+	struct sess *sp;
+
+	sp = NULL;
+	Lck_Lock(&pool_mtx);
+	VTAILQ_FOREACH(qp, &pools, list) {
+		if (qp == pp || qp->lqueue == 0)
+			continue;
+#ifdef HAVE_SYNC_BUILTINS
+		if (qp->lockfree) {
+			sp = pool_lf_deq(qp);
+			if (sp != NULL)
+				break;
+			continue;
+		}
+#endif
+		if (Lck_Trylock(&qp->mtx))
+			continue;
+		sp = VTAILQ_FIRST(&qp->queue);
+		if (sp != NULL) {
+			VTAILQ_REMOVE(&qp->queue, sp, poollist);
+			qp->lqueue--;
+			qp->vsc->queue_len = qp->lqueue;
+		}
+		Lck_Unlock(&qp->mtx);
+		if (sp != NULL)
+			break;
+	}
+	Lck_Unlock(&pool_mtx);
+	return (sp);
+}
+
+/*--------------------------------------------------------------------
+ * Hand a session to an idle thread in a sibling pool.
+ *
+ * The idle thread rechecks do_what under its pools lock when it wakes
+ * up, so it must be told what to do before we let go of that lock.
+ *
+ * Return zero if somebody took it.
+ */
+
+static int
+pool_kick(const struct pool *pp, struct sess *sp)
+{
+	struct pool *qp;
+	struct worker *w;
+
+	Lck_Lock(&pool_mtx);
+	VTAILQ_FOREACH(qp, &pools, list) {
+		if (qp == pp)
+			continue;
+#ifdef HAVE_SYNC_BUILTINS
+		if (qp->lockfree) {
+			if (qp->nidle == 0 || pool_lf_enq(qp, sp))
+				continue;
+			POOL_ADD(qp, qp->vsc->steals, 1);
+			pool_ev_wake(qp);
+			Lck_Unlock(&pool_mtx);
+			return (0);
+		}
+#endif
+		if (VTAILQ_EMPTY(&qp->idle) || Lck_Trylock(&qp->mtx))
+			continue;
+		w = VTAILQ_FIRST(&qp->idle);
+		if (w == NULL) {
+			Lck_Unlock(&qp->mtx);
+			continue;
+		}
+		VTAILQ_REMOVE(&qp->idle, w, list);
+		qp->vsc->steals++;
+		w->sp = sp;
+		w->do_what = pool_do_sess;
+		AZ(pthread_cond_signal(&w->cond));
+		Lck_Unlock(&qp->mtx);
+		Lck_Unlock(&pool_mtx);
+		return (0);
+	}
+	Lck_Unlock(&pool_mtx);
+	return (-1);
+}
+
+/*--------------------------------------------------------------------
+ * This is the work function for worker threads in the pool.
+ */
+
+void
+Pool_Work_Thread(void *priv, struct worker *w)
+{
+	struct pool *pp;
+
+	CAST_OBJ_NOTNULL(pp, priv, POOL_MAGIC);
+	w->pool = pp;
+#ifdef HAVE_SYNC_BUILTINS
+	if (pp->lockfree)
+		pool_work_lockfree(pp, w);
+	else
+#endif
+		pool_work_locked(pp, w);
+	w->pool = NULL;
+}
+
 /*--------------------------------------------------------------------*/
 
 int
@@ -334,9 +1159,50 @@ Pool_Schedule(struct pool *pp, struct sess *sp)
 
 	CHECK_OBJ_NOTNULL(sp, SESS_MAGIC);
 	AZ(sp->wrk);
+	sp->t_sched = VTIM_mono();
+#ifdef HAVE_SYNC_BUILTINS
+	if (pp->lockfree)
+		return (pool_lf_queue(pp, sp));
+#endif
 	return(pool_queue(pp, sp));
 }
 
+/*--------------------------------------------------------------------
+ * Create another thread, if possible
+ *
+ * Return zero if we did.
+ */
+
+static int
+pool_spawn(struct pool *qp, const pthread_attr_t *tp_attr)
+{
+	pthread_t tp;
+
+	if (qp->nthr > cache_param->wthread_max) {
+		Lck_Lock(&pool_mtx);
+		VSC_C_main->threads_limited++;
+		Lck_Unlock(&pool_mtx);
+		return (-1);
+	}
+	if (pthread_create(&tp, tp_attr, WRK_thread, qp)) {
+		VSL(SLT_Debug, 0, "Create worker thread failed %d %s",
+		    errno, strerror(errno));
+		Lck_Lock(&pool_mtx);
+		VSC_C_main->threads_limited++;
+		Lck_Unlock(&pool_mtx);
+		VTIM_sleep(cache_param->wthread_fail_delay * 1e-3);
+		return (-1);
+	}
+	AZ(pthread_detach(tp));
+	POOL_ADD(qp, qp->nthr, 1);
+	qp->vsc->threads = qp->nthr;
+	Lck_Lock(&pool_mtx);
+	VSC_C_main->threads++;
+	VSC_C_main->threads_created++;
+	Lck_Unlock(&pool_mtx);
+	return (0);
+}
+
 /*--------------------------------------------------------------------
  * Create another thread, if necessary & possible
  */
@@ -344,7 +1210,6 @@ Pool_Schedule(struct pool *pp, struct sess *sp)
 static void
 pool_breed(struct pool *qp, const pthread_attr_t *tp_attr)
 {
-	pthread_t tp;
 
 	/*
 	 * If we need more threads, and have space, create
@@ -353,27 +1218,106 @@ pool_breed(struct pool *qp, const pthread_attr_t *tp_attr)
 	if (qp->nthr < cache_param->wthread_min || /* Not enough threads yet */
 	    (qp->lqueue > cache_param->wthread_add_threshold && /* need more  */
 	    qp->lqueue > qp->last_lqueue)) { /* not getting better since last */
-		if (qp->nthr > cache_param->wthread_max) {
-			Lck_Lock(&pool_mtx);
-			VSC_C_main->threads_limited++;
-			Lck_Unlock(&pool_mtx);
-		} else if (pthread_create(&tp, tp_attr, WRK_thread, qp)) {
-			VSL(SLT_Debug, 0, "Create worker thread failed %d %s",
-			    errno, strerror(errno));
-			Lck_Lock(&pool_mtx);
-			VSC_C_main->threads_limited++;
-			Lck_Unlock(&pool_mtx);
-			VTIM_sleep(cache_param->wthread_fail_delay * 1e-3);
-		} else {
-			AZ(pthread_detach(tp));
+		if (!pool_spawn(qp, tp_attr))
 			VTIM_sleep(cache_param->wthread_add_delay * 1e-3);
-			qp->nthr++;
-			Lck_Lock(&pool_mtx);
-			VSC_C_main->threads++;
-			VSC_C_main->threads_created++;
-			Lck_Unlock(&pool_mtx);
+	}
+	qp->last_lqueue = qp->lqueue;
+}
+
+/*--------------------------------------------------------------------
+ * Roll up the queue latency of the last interval.
+ *
+ * We keep an EWMA of the mean, and estimate the 95th percentile as the
+ * upper bound of the histogram bucket it falls in.  Since the buckets
+ * are powers of two, this errs on the high side by less than a factor
+ * two, which is good enough to steer by.
+ */
+
+static void
+pool_latency_eval(struct pool *pp)
+{
+	uint64_t n, sum, want, cum, d;
+	unsigned b;
+	double now;
+
+	now = VTIM_mono();
+	if (now - pp->lat_last < 0.01)
+		return;
+	pp->lat_last = now;
+
+	n = pp->lat_n - pp->lat_last_n;
+	sum = pp->lat_sum - pp->lat_last_sum;
+	pp->lat_last_n += n;
+	pp->lat_last_sum += sum;
+
+	if (n == 0) {
+		/* Nobody waited, let the estimates decay */
+		pp->lat_ewma *= 0.75;
+		pp->lat_p95 /= 2;
+		memcpy(pp->lat_last_hist, pp->lat_hist,
+		    sizeof pp->lat_last_hist);
+	} else {
+		pp->lat_ewma = 0.75 * pp->lat_ewma + 0.25 * sum / n;
+		want = n - n / 20;
+		cum = 0;
+		for (b = 0; b < POOL_LAT_BUCKETS; b++) {
+			d = pp->lat_hist[b] - pp->lat_last_hist[b];
+			pp->lat_last_hist[b] += d;
+			if (cum < want && cum + d >= want)
+				pp->lat_p95 = 1ULL << b;
+			cum += d;
 		}
 	}
+	pp->vsc->qlat_ewma = (uint64_t)pp->lat_ewma;
+	pp->vsc->qlat_p95 = pp->lat_p95;
+}
+
+/*--------------------------------------------------------------------
+ * How long has the session at the head of the queue been waiting ?
+ */
+
+static double
+pool_head_age(struct pool *pp)
+{
+	struct sess *sp;
+	double d = 0.;
+
+	if (pp->lockfree || pp->lqueue == 0)
+		return (d);
+	pool_lock(pp);
+	sp = VTAILQ_FIRST(&pp->queue);
+	if (sp != NULL && !isnan(sp->t_sched))
+		d = VTIM_mono() - sp->t_sched;
+	Lck_Unlock(&pp->mtx);
+	return (d);
+}
+
+/*--------------------------------------------------------------------
+ * Create threads to hold the queue latency target
+ *
+ * If sessions wait too long we add a thread per queued session, a
+ * handful at a time, without the thread_pool_add_delay pause, and let
+ * the next measurement tell if it was enough.
+ */
+
+static void
+pool_breed_latency(struct pool *qp, const pthread_attr_t *tp_attr)
+{
+	unsigned n;
+	double target;
+
+	target = cache_param->wthread_lat_target * 1e-6;
+	if (qp->nthr < cache_param->wthread_min)
+		n = cache_param->wthread_min - qp->nthr;
+	else if (qp->lqueue > 0 &&
+	    (qp->lat_p95 * 1e-6 > target || pool_head_age(qp) > target))
+		n = qp->lqueue;
+	else
+		n = 0;
+	if (n > 16)
+		n = 16;
+	while (n-- > 0 && !pool_spawn(qp, tp_attr))
+		continue;
 	qp->last_lqueue = qp->lqueue;
 }
 
@@ -400,9 +1344,13 @@ pool_herder(void *priv)
 	struct timespec ts;
 	double t_idle;
 	struct worker *w;
-	int i;
+	unsigned u;
+	int i, latency, shrink;
 
 	CAST_OBJ_NOTNULL(pp, priv, POOL_MAGIC);
+#ifdef HAVE_SCHED_GETAFFINITY
+	pool_bind(pp);
+#endif
 	AZ(pthread_attr_init(&tp_attr));
 
 	while (1) {
@@ -415,15 +1363,27 @@ pool_herder(void *priv)
 			AZ(pthread_attr_init(&tp_attr));
 		}
 
-		pool_breed(pp, &tp_attr);
+#ifdef HAVE_SYNC_BUILTINS
+		if (pp->lockfree)
+			pool_lf_stats(pp);
+#endif
+		pool_latency_eval(pp);
+		latency = cache_param->wthread_herder == WTHREAD_HERDER_LATENCY;
+		if (latency)
+			pool_breed_latency(pp, &tp_attr);
+		else
+			pool_breed(pp, &tp_attr);
 
 		if (pp->nthr < cache_param->wthread_min)
 			continue;
 
+		/* Keep an eye on the queue if we steer by latency */
+		u = cache_param->wthread_purge_delay;
+		if (latency && pp->lqueue > 0 && u > 10)
+			u = 10;
 		AZ(clock_gettime(CLOCK_MONOTONIC, &ts));
-		ts.tv_sec += cache_param->wthread_purge_delay / 1000;
-		ts.tv_nsec +=
-		    (cache_param->wthread_purge_delay % 1000) * 1000000;
+		ts.tv_sec += u / 1000;
+		ts.tv_nsec += (u % 1000) * 1000000;
 		if (ts.tv_nsec >= 1000000000) {
 			ts.tv_sec++;
 			ts.tv_nsec -= 1000000000;
@@ -435,18 +1395,37 @@ pool_herder(void *priv)
 		if (!i)
 			continue;
 
+		/*
+		 * When steering by latency, shed threads which are not
+		 * needed to hold the target, without waiting for them to
+		 * reach thread_pool_timeout.
+		 */
+		shrink = latency && pp->lqueue == 0 &&
+		    pp->lat_ewma * 4 < cache_param->wthread_lat_target;
+
 		if (pp->nthr <= cache_param->wthread_min)
 			continue;
 
+#ifdef HAVE_SYNC_BUILTINS
+		/* Lock-free workers retire on their own, when asked */
+		if (pp->lockfree) {
+			if (shrink && pp->nidle > 0) {
+				(void)__sync_fetch_and_add(&pp->nretire, 1);
+				pool_ev_wake(pp);
+			}
+			continue;
+		}
+#endif
+
 		t_idle = VTIM_real() - cache_param->wthread_timeout;
 
-		Lck_Lock(&pp->mtx);
+		pool_lock(pp);
 		VSC_C_main->sess_queued += pp->nqueued;
 		VSC_C_main->sess_dropped += pp->ndropped;
 		pp->nqueued = pp->ndropped = 0;
 		w = VTAILQ_LAST(&pp->idle, workerhead);
 		if (w != NULL &&
-		    (w->lastused < t_idle ||
+		    (w->lastused < t_idle || shrink ||
 		    pp->nthr > cache_param->wthread_max)) {
 			VTAILQ_REMOVE(&pp->idle, w, list);
 		} else
@@ -456,6 +1435,7 @@ pool_herder(void *priv)
 		/* And give it a kiss on the cheek... */
 		if (w != NULL) {
 			pp->nthr--;
+			pp->vsc->threads = pp->nthr;
 			Lck_Lock(&pool_mtx);
 			VSC_C_main->threads--;
 			VSC_C_main->threads_destroyed++;
@@ -479,11 +1459,27 @@ pool_mkpool(unsigned pool_no)
 	struct listen_sock *ls;
 	struct poolsock *ps;
 	pthread_condattr_t cv_attr;
+	char buf[8];
+	unsigned u;
 
 	ALLOC_OBJ(pp, POOL_MAGIC);
 	XXXAN(pp);
 	Lck_New(&pp->mtx, lck_wq);
 
+	bprintf(buf, "%u", pool_no);
+	pp->vsc = VSM_Alloc(sizeof *pp->vsc, VSC_CLASS, VSC_TYPE_POOL, buf);
+	AN(pp->vsc);
+#ifdef HAVE_SCHED_GETAFFINITY
+	pool_cpuset(pp, pool_no);
+#endif
+	pp->vsc->cpus = pp->ncpu;
+#ifdef HAVE_SYNC_BUILTINS
+	if (cache_param->wthread_lockfree) {
+		pp->lockfree = 1;
+		pool_lf_init(pp);
+	}
+#endif
+
 	VTAILQ_INIT(&pp->queue);
 	VTAILQ_INIT(&pp->idle);
 	VTAILQ_INIT(&pp->socks);
@@ -495,7 +1491,10 @@ pool_mkpool(unsigned pool_no)
 			continue;
 		ALLOC_OBJ(ps, POOLSOCK_MAGIC);
 		XXXAN(ps);
-		ps->lsock = ls;
+		/* With SO_REUSEPORT shards, each pool gets its own socket */
+		u = pool_no % (ls->nshard + 1);
+		ps->lsock = u == 0 ? ls : ls->shard[u - 1];
+		CHECK_OBJ_NOTNULL(ps->lsock, LISTEN_SOCK_MAGIC);
 		VTAILQ_INSERT_TAIL(&pp->socks, ps, list);
 	}
 
@@ -518,7 +1517,6 @@ static void *
 pool_poolherder(void *priv)
 {
 	unsigned nwq;
-	VTAILQ_HEAD(,pool)	pools = VTAILQ_HEAD_INITIALIZER(pools);
 	struct pool *pp;
 	uint64_t u;
 
@@ -530,7 +1528,9 @@ pool_poolherder(void *priv)
 		if (nwq < cache_param->wthread_pools) {
 			pp = pool_mkpool(nwq);
 			if (pp != NULL) {
+				Lck_Lock(&pool_mtx);
 				VTAILQ_INSERT_TAIL(&pools, pp, list);
+				Lck_Unlock(&pool_mtx);
 				VSC_C_main->pools++;
 				nwq++;
 				continue;
@@ -555,5 +1555,9 @@ Pool_Init(void)
 {
 
 	Lck_New(&pool_mtx, lck_wq);
+#ifdef HAVE_SCHED_GETAFFINITY
+	if (sched_getaffinity(0, sizeof pool_cpus, &pool_cpus))
+		CPU_ZERO(&pool_cpus);
+#endif
 	AZ(pthread_create(&thr_pool_herder, NULL, pool_poolherder, NULL));
 }
@@ -102,10 +102,23 @@ res_dorange(const struct sess *sp, const char *r, ssize_t *plow, ssize_t *phigh)
 
 /*--------------------------------------------------------------------*/
 
+static const struct hdrblk *
+res_hdrblk(const struct object *o)
+{
+
+	if (o->objcore == NULL || o->objcore->hdrblk == NULL)
+		return (NULL);
+	CHECK_OBJ(o->objcore->hdrblk, HDRBLK_MAGIC);
+	return (o->objcore->hdrblk);
+}
+
+/*--------------------------------------------------------------------*/
+
 void
 RES_BuildHttp(const struct sess *sp)
 {
 	char time_str[30];
+	const struct hdrblk *hb;
 
 	CHECK_OBJ_NOTNULL(sp, SESS_MAGIC);
 
@@ -116,6 +129,21 @@ RES_BuildHttp(const struct sess *sp)
 	http_FilterFields(sp->wrk, sp->vsl_id, sp->wrk->resp,
 	    sp->wrk->obj->http, HTTPH_A_DELIVER);
 
+	/*
+	 * If the object headers are unchanged since RES_HdrBlk() and all
+	 * of them made it, we can send the prebuilt block for them, as
+	 * long as nobody removes or moves any of them from here on.
+	 */
+	hb = res_hdrblk(sp->wrk->obj);
+	sp->wrk->res_hdrblk = 0;
+	if (hb != NULL &&
+	    sp->wrk->obj->http->gen == hb->gen &&
+	    sp->wrk->obj->http->nhd == hb->nhd &&
+	    sp->wrk->resp->nhd == HTTP_HDR_FIRST + hb->n) {
+		sp->wrk->res_hdrblk = sp->wrk->resp->nhd;
+		sp->wrk->res_hdrgen = sp->wrk->resp->gen;
+	}
+
 	if (!(sp->wrk->res_mode & RES_LEN)) {
 		http_Unset(sp->wrk->resp, H_Content_Length);
 	} else if (cache_param->http_range_support) {
@@ -145,6 +173,59 @@ RES_BuildHttp(const struct sess *sp)
 	    sp->req->doclose ? "close" : "keep-alive");
 }
 
+/*--------------------------------------------------------------------
+ * Serialize the object headers which go out with every delivery, so
+ * hits can send them in one go, see RES_BuildHttp().  This must happen
+ * before the object becomes visible to other workers.
+ *
+ * The block takes object workspace, which cnt_fetchbody() only sets
+ * aside with param obj_hdrblk, if it is not there we do without.
+ */
+
+void
+RES_HdrBlk(struct object *o)
+{
+	struct hdrblk *hb;
+	int n;
+
+	CHECK_OBJ_NOTNULL(o, OBJECT_MAGIC);
+	CHECK_OBJ_NOTNULL(o->objcore, OBJCORE_MAGIC);
+	AZ(o->objcore->hdrblk);
+	if (!cache_param->obj_hdrblk)
+		return;
+	hb = (void*)WS_Alloc(o->ws_o, sizeof *hb);
+	if (hb == NULL)
+		return;
+	memset(hb, 0, sizeof *hb);
+	hb->magic = HDRBLK_MAGIC;
+	n = http_HdrBlk(o->http, HTTPH_A_DELIVER, &hb->blk, &hb->len);
+	if (n < 0)
+		return;
+	hb->n = (uint16_t)n;
+	hb->nhd = o->http->nhd;
+	hb->gen = o->http->gen;
+	o->objcore->hdrblk = hb;
+}
+
+/*--------------------------------------------------------------------*/
+
+static unsigned
+res_WriteHttp(const struct sess *sp)
+{
+	struct worker *wrk;
+	const struct hdrblk *hb;
+
+	wrk = sp->wrk;
+	if (wrk->res_hdrblk != 0 && wrk->resp->gen == wrk->res_hdrgen) {
+		hb = res_hdrblk(wrk->obj);
+		AN(hb);
+		VSC_C_main->n_objhdrblk++;
+		return (http_WriteBlk(wrk, sp->vsl_id, wrk->resp,
+		    hb->blk, hb->len, wrk->res_hdrblk));
+	}
+	return (http_Write(wrk, sp->vsl_id, wrk->resp, 1));
+}
+
 /*--------------------------------------------------------------------
  * We have a gzip'ed object and need to ungzip it for a client which
  * does not understand gzip.
@@ -246,13 +327,17 @@ res_WriteDirObj(const struct sess *sp, ssize_t low, ssize_t high)
 /*--------------------------------------------------------------------
  * Deliver an object.
  * Attempt optimizations like 304 and 206 here.
+ *
+ * Returns 1 if the body was left for the sender (param:
+ * send_async_threshold), in which case the session is no longer ours.
  */
 
-void
+int
 RES_WriteObj(struct sess *sp)
 {
 	char *r;
 	ssize_t low, high;
+	int async = 0;
 
 	CHECK_OBJ_NOTNULL(sp, SESS_MAGIC);
 
@@ -291,8 +376,7 @@ RES_WriteObj(struct sess *sp)
 	 * Send HTTP protocol header, unless interior ESI object
 	 */
 	if (!(sp->wrk->res_mode & RES_ESI_CHILD))
-		sp->wrk->acct_tmp.hdrbytes +=
-		    http_Write(sp->wrk, sp->vsl_id, sp->wrk->resp, 1);
+		sp->wrk->acct_tmp.hdrbytes += res_WriteHttp(sp);
 
 	if (!sp->req->wantbody)
 		sp->wrk->res_mode &= ~RES_CHUNKED;
@@ -313,6 +397,13 @@ RES_WriteObj(struct sess *sp)
 		res_WriteGunzipObj(sp);
 	} else if (sp->wrk->res_mode & RES_GUNZIP) {
 		res_WriteGunzipObj(sp);
+	} else if (cache_param->send_async_threshold > 0 &&
+	    1 + high - low >= cache_param->send_async_threshold &&
+	    (sp->wrk->res_mode & RES_LEN) &&
+	    !(sp->wrk->res_mode & (RES_ESI_CHILD|RES_CHUNKED)) &&
+	    sp->wrk->obj->objcore != NULL) {
+		/* A cached object, send the body from the sender */
+		async = 1;
 	} else {
 		res_WriteDirObj(sp, low, high);
 	}
@@ -321,8 +412,15 @@ RES_WriteObj(struct sess *sp)
 	    !(sp->wrk->res_mode & RES_ESI_CHILD))
 		WRW_EndChunk(sp->wrk);
 
-	if (WRW_FlushRelease(sp->wrk) && sp->fd >= 0)
+	if (WRW_FlushRelease(sp->wrk) && sp->fd >= 0) {
 		SES_Close(sp, "remote closed");
+		return (0);
+	}
+	if (!async || sp->fd < 0)
+		return (0);
+	sp->wrk->acct_tmp.bodybytes += 1 + high - low;
+	SND_Deliver(sp, low, high);
+	return (1);
 }
 
 /*--------------------------------------------------------------------*/
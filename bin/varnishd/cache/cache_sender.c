@@ -0,0 +1,278 @@
+/*-
+ * Copyright (c) 2006 Verdens Gang AS
+ * Copyright (c) 2006-2011 Varnish Software AS
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * The sender moves the body of a cached object to slow clients, so that
+ * a worker thread does not have to sit in writev(2) for the duration.
+ *
+ * Once the worker has sent the headers, it takes another reference to
+ * the object and passes the session to the sender, which polls all the
+ * sessions it has, and writes to them as they can take it.  When all of
+ * the body is out, or the client gives up, the session is rescheduled,
+ * and a worker picks it up again in cnt_done().
+ *
+ * XXX: We could use sendfile(2) for file storage here.
+ */
+
+#include "config.h"
+
+#include <poll.h>
+#include <stdlib.h>
+#include <sys/uio.h>
+
+#include "cache.h"
+
+#include "hash/hash_slinger.h"
+#include "vtcp.h"
+#include "vtim.h"
+
+#define SND_NIOV	64
+#define NSND		100
+
+struct snd {
+	unsigned		magic;
+#define SND_MAGIC		0x3b5e1c07
+	VTAILQ_ENTRY(snd)	list;
+	struct sess		*sp;
+	struct object		*obj;
+	struct storage		*st;
+	size_t			off;
+	ssize_t			len;		/* Bytes left to send */
+	double			t_last;
+};
+
+static VTAILQ_HEAD(, snd)	snd_head = VTAILQ_HEAD_INITIALIZER(snd_head);
+static int			snd_pipes[2];
+static pthread_t		snd_thr;
+
+/*--------------------------------------------------------------------
+ * Write as much as the socket will take.
+ *
+ * Returns:
+ *	-1 error
+ *	 0 more to send
+ *	 1 done
+ */
+
+static int
+snd_write(struct snd *snd)
+{
+	struct iovec iov[SND_NIOV];
+	struct storage *st;
+	size_t off;
+	ssize_t i, l;
+	int n;
+
+	st = snd->st;
+	off = snd->off;
+	l = snd->len;
+	for (n = 0; n < SND_NIOV && l > 0; n++) {
+		CHECK_OBJ_NOTNULL(st, STORAGE_MAGIC);
+		iov[n].iov_base = st->ptr + off;
+		iov[n].iov_len = st->len - off;
+		if (iov[n].iov_len > l)
+			iov[n].iov_len = l;
+		l -= iov[n].iov_len;
+		st = VTAILQ_NEXT(st, list);
+		off = 0;
+	}
+	i = writev(snd->sp->fd, iov, n);
+	if (i < 0 && (errno == EAGAIN || errno == EINTR))
+		return (0);
+	if (i <= 0)
+		return (-1);
+	snd->len -= i;
+	while (i > 0) {
+		CHECK_OBJ_NOTNULL(snd->st, STORAGE_MAGIC);
+		l = snd->st->len - snd->off;
+		if (i < l) {
+			snd->off += i;
+			break;
+		}
+		i -= l;
+		snd->st = VTAILQ_NEXT(snd->st, list);
+		snd->off = 0;
+	}
+	return (snd->len == 0);
+}
+
+/*--------------------------------------------------------------------
+ * Give the session back to a worker, which will find it in STP_DONE.
+ */
+
+static void
+snd_done(struct worker *wrk, struct snd *snd, const char *reason)
+{
+	struct sess *sp;
+
+	CHECK_OBJ_NOTNULL(snd, SND_MAGIC);
+	sp = snd->sp;
+	CHECK_OBJ_NOTNULL(sp, SESS_MAGIC);
+	(void)HSH_Deref(wrk, NULL, &snd->obj);
+	FREE_OBJ(snd);
+
+	(void)VTCP_blocking(sp->fd);
+	if (reason != NULL)
+		sp->req->doclose = reason;
+	sp->step = STP_DONE;
+	(void)SES_Schedule(sp);
+}
+
+static void * __match_proto__(bgthread_t)
+snd_thread(struct sess *sp, void *priv)
+{
+	struct snd *snd, *snd2, *ss[NSND];
+	struct pollfd *fds = NULL;
+	unsigned n = 0, nfds = 0, u;
+	const char *reason;
+	double now;
+	int i;
+
+	CHECK_OBJ_NOTNULL(sp, SESS_MAGIC);
+	(void)priv;
+	while (1) {
+		if (1 + n > nfds) {
+			nfds = 1 + n + NSND;
+			fds = realloc(fds, nfds * sizeof *fds);
+			XXXAN(fds);
+		}
+		fds[0].fd = snd_pipes[0];
+		fds[0].events = POLLIN;
+		fds[0].revents = 0;
+		u = 1;
+		VTAILQ_FOREACH(snd, &snd_head, list) {
+			fds[u].fd = snd->sp->fd;
+			fds[u].events = POLLOUT;
+			fds[u].revents = 0;
+			u++;
+		}
+		assert(u == 1 + n);
+		(void)poll(fds, u, 1000);
+		now = VTIM_real();
+
+		u = 1;
+		VTAILQ_FOREACH_SAFE(snd, &snd_head, list, snd2) {
+			i = 0;
+			if (fds[u++].revents) {
+				i = snd_write(snd);
+				snd->t_last = now;
+			}
+			if (i == 0 && now - snd->sp->req->t_resp >
+			    cache_param->send_timeout)
+				reason = "send timeout";
+			else if (i == 0 && now - snd->t_last >
+			    cache_param->idle_send_timeout)
+				reason = "idle send timeout";
+			else if (i < 0)
+				reason = "remote closed";
+			else if (i == 0)
+				continue;
+			else
+				reason = NULL;
+			VTAILQ_REMOVE(&snd_head, snd, list);
+			n--;
+			snd_done(sp->wrk, snd, reason);
+		}
+
+		if (fds[0].revents == 0)
+			continue;
+		i = read(snd_pipes[0], ss, sizeof ss);
+		if (i <= 0)
+			continue;
+		for (u = 0; i >= sizeof ss[0]; u++, i -= sizeof ss[0]) {
+			snd = ss[u];
+			CHECK_OBJ_NOTNULL(snd, SND_MAGIC);
+			/* Most of the time the first write goes right out */
+			switch (snd_write(snd)) {
+			case 0:
+				snd->t_last = now;
+				VTAILQ_INSERT_TAIL(&snd_head, snd, list);
+				n++;
+				break;
+			case 1:
+				snd_done(sp->wrk, snd, NULL);
+				break;
+			default:
+				snd_done(sp->wrk, snd, "remote closed");
+				break;
+			}
+		}
+		assert(i == 0);
+	}
+	NEEDLESS_RETURN(NULL);
+}
+
+/*--------------------------------------------------------------------
+ * Hand the rest of the body, bytes low to high of the object, to the
+ * sender.  After this the session belongs to the sender.
+ */
+
+void
+SND_Deliver(struct sess *sp, ssize_t low, ssize_t high)
+{
+	struct snd *snd;
+	struct storage *st;
+	ssize_t ptr;
+
+	CHECK_OBJ_NOTNULL(sp, SESS_MAGIC);
+	CHECK_OBJ_NOTNULL(sp->wrk, WORKER_MAGIC);
+	CHECK_OBJ_NOTNULL(sp->wrk->obj, OBJECT_MAGIC);
+	assert(low <= high);
+
+	ALLOC_OBJ(snd, SND_MAGIC);
+	XXXAN(snd);
+	snd->obj = sp->wrk->obj;
+	HSH_Ref(snd->obj->objcore);
+
+	ptr = 0;
+	VTAILQ_FOREACH(st, &snd->obj->store, list) {
+		CHECK_OBJ_NOTNULL(st, STORAGE_MAGIC);
+		if (ptr + st->len > low)
+			break;
+		ptr += st->len;
+	}
+	AN(st);
+	snd->st = st;
+	snd->off = low - ptr;
+	snd->len = 1 + high - low;
+
+	VSC_C_main->n_objsendasync++;
+	SES_Charge(sp);
+	sp->wrk = NULL;
+	snd->sp = sp;
+	(void)VTCP_nonblocking(sp->fd);
+	assert(sizeof snd == write(snd_pipes[1], &snd, sizeof snd));
+}
+
+/*--------------------------------------------------------------------*/
+
+void
+SND_Init(void)
+{
+
+	AZ(pipe(snd_pipes));
+	(void)VTCP_nonblocking(snd_pipes[0]);
+	WRK_BgThread(&snd_thr, "cache-sender", snd_thread, NULL);
+}
@@ -31,10 +31,19 @@
  * This is a little bit of a mixed back, containing both memory management
  * and various state-change functions.
  *
+ * Session memory is carved from per-pool slabs.  Free sessions are cached
+ * in two magazines per worker thread, so a worker which both accepts and
+ * closes connections never takes a lock for them.  Only when both of its
+ * magazines are empty, or both are full, does the worker trade one with
+ * the depot of its pool, under the pool lock.  Sessions freed outside a
+ * worker of the pool, for instance by the waiter, go on the pool freelist.
+ *
  */
 
 #include "config.h"
 
+#include <sys/mman.h>
+
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -46,11 +55,27 @@
 
 /*--------------------------------------------------------------------*/
 
+#define SESSLAB_SIZE		(2 * 1024 * 1024)
+#define SESSMAG_SIZE		16
+
+struct sesslab {
+	unsigned		magic;
+#define SESSLAB_MAGIC		0x4c1d2b37
+	unsigned char		*base;
+	size_t			len;
+	unsigned		hugepages;
+	unsigned		objsize;
+	unsigned		nobj;
+	unsigned		ncarved;
+	unsigned		nlive;
+};
+
 struct sessmem {
 	unsigned		magic;
 #define SESSMEM_MAGIC		0x555859c5
 
 	struct sesspool		*pool;
+	struct sesslab		*slab;
 
 	unsigned		workspace;
 	uint16_t		nhttp;
@@ -65,12 +90,37 @@ struct sesspool {
 	unsigned		magic;
 #define SESSPOOL_MAGIC		0xd916e202
 	struct pool		*pool;
+	unsigned		pool_no;
 	VTAILQ_HEAD(,sessmem)	freelist;
+	/* Depot: magazines with sessions (not necessarily full), and empty */
+	VTAILQ_HEAD(,sessmag)	full;
+	VTAILQ_HEAD(,sessmag)	empty;
+	struct sesslab		*slab;
 	struct lock		mtx;
 	unsigned		nsess;
 	unsigned		dly_free_cnt;
+	unsigned		dly_alloc_cnt;
 	unsigned		req_size;
 	struct mempool		*mpl_req;
+	unsigned		sess_size;
+	struct mempool		*mpl_sess;
+	struct VSC_C_sessmem	*vsc;
+};
+
+struct sessmag {
+	unsigned		magic;
+#define SESSMAG_MAGIC		0x7e6b0c11
+	unsigned		n;
+	VTAILQ_ENTRY(sessmag)	list;
+	struct sessmem		*sm[SESSMAG_SIZE];
+};
+
+struct sesscache {
+	unsigned		magic;
+#define SESSCACHE_MAGIC		0x2d5a96f0
+	struct sesspool		*pool;
+	struct sessmag		*loaded;
+	struct sessmag		*prev;
 };
 
 /*--------------------------------------------------------------------
@@ -92,15 +142,120 @@ SES_Charge(struct sess *sp)
 #undef ACCT
 }
 
+/*--------------------------------------------------------------------
+ * Slabs.  The pool carves sessmem structures from its current slab, and
+ * a slab is freed when the last structure carved from it is, and it is
+ * no longer the current one.  The pool lock protects all of it.
+ */
+
+static void *
+ses_slab_map(size_t len)
+{
+	unsigned char *p, *a;
+	size_t l;
+
+	/* Over-allocate, so we can align to a huge page boundary */
+	l = len + SESSLAB_SIZE;
+	p = mmap(NULL, l, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON,
+	    -1, 0);
+	if (p == MAP_FAILED)
+		return (NULL);
+	a = (void*)RUP2((uintptr_t)p, SESSLAB_SIZE);
+	if (a > p)
+		AZ(munmap(p, a - p));
+	if (a + len < p + l)
+		AZ(munmap(a + len, (p + l) - (a + len)));
+#ifdef MADV_HUGEPAGE
+	(void)madvise(a, len, MADV_HUGEPAGE);
+#endif
+	return (a);
+}
+
+static struct sesslab *
+ses_slab_new(struct sesspool *pp, unsigned objsize)
+{
+	struct sesslab *sl;
+	size_t len;
+
+	Lck_AssertHeld(&pp->mtx);
+	ALLOC_OBJ(sl, SESSLAB_MAGIC);
+	if (sl == NULL)
+		return (NULL);
+	sl->objsize = objsize;
+	sl->nobj = SESSLAB_SIZE / objsize;
+	if (sl->nobj == 0)
+		sl->nobj = 1;
+	len = (size_t)sl->nobj * objsize;
+	if (cache_param->sess_hugepages) {
+		len = RUP2(len, SESSLAB_SIZE);
+		sl->nobj = len / objsize;
+		sl->base = ses_slab_map(len);
+		sl->hugepages = 1;
+	} else
+		sl->base = malloc(len);
+	if (sl->base == NULL) {
+		FREE_OBJ(sl);
+		return (NULL);
+	}
+	sl->len = len;
+	pp->vsc->slabs++;
+	pp->vsc->slab_bytes += len;
+	return (sl);
+}
+
+static void
+ses_slab_free(struct sesspool *pp, struct sesslab *sl)
+{
+
+	Lck_AssertHeld(&pp->mtx);
+	CHECK_OBJ_NOTNULL(sl, SESSLAB_MAGIC);
+	AZ(sl->nlive);
+	pp->vsc->slabs--;
+	pp->vsc->slab_bytes -= sl->len;
+	if (sl->hugepages)
+		AZ(munmap(sl->base, sl->len));
+	else
+		free(sl->base);
+	FREE_OBJ(sl);
+}
+
+static void *
+ses_slab_carve(struct sesspool *pp, unsigned objsize, struct sesslab **slp)
+{
+	struct sesslab *sl;
+	void *p;
+
+	Lck_AssertHeld(&pp->mtx);
+	sl = pp->slab;
+	if (sl != NULL && (sl->objsize != objsize || sl->ncarved == sl->nobj)) {
+		/* Retire it, it goes away with its last session */
+		pp->slab = NULL;
+		if (sl->nlive == 0)
+			ses_slab_free(pp, sl);
+	}
+	if (pp->slab == NULL)
+		pp->slab = ses_slab_new(pp, objsize);
+	sl = pp->slab;
+	if (sl == NULL)
+		return (NULL);
+	p = sl->base + (size_t)sl->ncarved++ * sl->objsize;
+	sl->nlive++;
+	pp->vsc->slab_live++;
+	*slp = sl;
+	return (p);
+}
+
 /*--------------------------------------------------------------------
  * This function allocates a session + assorted peripheral data
- * structures in one single malloc operation.
+ * structures in one single chunk, from the slabs of the pool if it
+ * has one.
  */
 
 static struct sessmem *
-ses_sm_alloc(void)
+ses_sm_alloc(struct sesspool *pp)
 {
 	struct sessmem *sm;
+	struct sesslab *sl;
 	unsigned char *p, *q;
 	unsigned nws;
 	uint16_t nhttp;
@@ -117,7 +272,14 @@ ses_sm_alloc(void)
 	hl = HTTP_estimate(nhttp);
 	l = sizeof *sm + nws + 2 * hl;
 	VSC_C_main->sessmem_size = l;
-	p = malloc(l);
+	sl = NULL;
+	if (pp == NULL) {
+		p = malloc(l);
+	} else {
+		Lck_Lock(&pp->mtx);
+		p = ses_slab_carve(pp, RUP2(l, 64), &sl);
+		Lck_Unlock(&pp->mtx);
+	}
 	if (p == NULL)
 		return (NULL);
 	q = p + l;
@@ -129,6 +291,7 @@ ses_sm_alloc(void)
 	p += sizeof *sm;
 
 	sm->magic = SESSMEM_MAGIC;
+	sm->slab = sl;
 	sm->workspace = nws;
 	sm->nhttp = nhttp;
 
@@ -146,6 +309,143 @@ ses_sm_alloc(void)
 	return (sm);
 }
 
+static void
+ses_sm_free(struct sesspool *pp, struct sessmem *sm)
+{
+	struct sesslab *sl;
+
+	Lck_AssertHeld(&pp->mtx);
+	CHECK_OBJ_NOTNULL(sm, SESSMEM_MAGIC);
+	sl = sm->slab;
+	if (sl == NULL) {
+		FREE_OBJ(sm);
+		return;
+	}
+	CHECK_OBJ_NOTNULL(sl, SESSLAB_MAGIC);
+	sm->magic = 0;
+	AN(sl->nlive);
+	sl->nlive--;
+	pp->vsc->slab_live--;
+	if (sl->nlive == 0 && sl != pp->slab)
+		ses_slab_free(pp, sl);
+}
+
+/*--------------------------------------------------------------------
+ * Per worker magazines and the depot.
+ */
+
+static struct sessmag *
+ses_mag_new(void)
+{
+	struct sessmag *mag;
+
+	ALLOC_OBJ(mag, SESSMAG_MAGIC);
+	return (mag);
+}
+
+static struct sesscache *
+ses_getcache(struct worker *wrk, struct sesspool *pp)
+{
+	struct sesscache *sc;
+
+	if (wrk == NULL)
+		return (NULL);
+	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
+	sc = wrk->nsesscache;
+	if (sc == NULL) {
+		if (wrk->pool != pp->pool)
+			return (NULL);
+		ALLOC_OBJ(sc, SESSCACHE_MAGIC);
+		if (sc == NULL)
+			return (NULL);
+		sc->pool = pp;
+		sc->loaded = ses_mag_new();
+		sc->prev = ses_mag_new();
+		if (sc->loaded == NULL || sc->prev == NULL) {
+			free(sc->loaded);
+			free(sc->prev);
+			FREE_OBJ(sc);
+			return (NULL);
+		}
+		wrk->nsesscache = sc;
+	}
+	CHECK_OBJ_NOTNULL(sc, SESSCACHE_MAGIC);
+	if (sc->pool != pp)
+		return (NULL);		/* Stolen from another pool */
+	return (sc);
+}
+
+static struct sessmem *
+ses_cache_get(struct sesscache *sc)
+{
+	struct sessmag *mag;
+
+	if (sc->loaded->n == 0 && sc->prev->n > 0) {
+		mag = sc->loaded;
+		sc->loaded = sc->prev;
+		sc->prev = mag;
+	}
+	mag = sc->loaded;
+	if (mag->n == 0)
+		return (NULL);
+	return (mag->sm[--mag->n]);
+}
+
+static int
+ses_cache_put(struct sesscache *sc, struct sessmem *sm)
+{
+	struct sessmag *mag;
+
+	if (sc->loaded->n == SESSMAG_SIZE && sc->prev->n < SESSMAG_SIZE) {
+		mag = sc->loaded;
+		sc->loaded = sc->prev;
+		sc->prev = mag;
+	}
+	mag = sc->loaded;
+	if (mag->n == SESSMAG_SIZE)
+		return (0);
+	mag->sm[mag->n++] = sm;
+	return (1);
+}
+
+static void
+ses_depot_put(struct sesspool *pp, struct sessmag *mag)
+{
+
+	Lck_AssertHeld(&pp->mtx);
+	CHECK_OBJ_NOTNULL(mag, SESSMAG_MAGIC);
+	if (mag->n > 0) {
+		VTAILQ_INSERT_HEAD(&pp->full, mag, list);
+		pp->vsc->depot += mag->n;
+	} else
+		VTAILQ_INSERT_HEAD(&pp->empty, mag, list);
+}
+
+/*--------------------------------------------------------------------
+ * Give back the magazines of a worker thread which is going away.
+ */
+
+void
+SES_Cleanup(struct worker *wrk)
+{
+	struct sesscache *sc;
+	struct sesspool *pp;
+
+	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
+	sc = wrk->nsesscache;
+	if (sc == NULL)
+		return;
+	wrk->nsesscache = NULL;
+	CHECK_OBJ_NOTNULL(sc, SESSCACHE_MAGIC);
+	pp = sc->pool;
+	CHECK_OBJ_NOTNULL(pp, SESSPOOL_MAGIC);
+	Lck_Lock(&pp->mtx);
+	ses_depot_put(pp, sc->loaded);
+	ses_depot_put(pp, sc->prev);
+	Lck_Unlock(&pp->mtx);
+	FREE_OBJ(sc);
+}
+
 /*--------------------------------------------------------------------
  * This prepares a session for use, based on its sessmem structure.
  */
@@ -164,12 +464,14 @@ ses_setup(struct sessmem *sm)
 
 	sp->magic = SESS_MAGIC;
 	sp->mem = sm;
+	sp->sesspool = sm->pool;
 	sp->sockaddrlen = sizeof(sp->sockaddr);
 	sp->mysockaddrlen = sizeof(sp->mysockaddr);
 	sp->sockaddr.ss_family = sp->mysockaddr.ss_family = PF_UNSPEC;
 	sp->t_open = NAN;
 	sp->t_idle = NAN;
 	sp->t_req = NAN;
+	sp->t_sched = NAN;
 
 	WS_Init(sp->ws, "sess", sm->wsp, sm->workspace);
 	sp->http = sm->http[0];
@@ -177,42 +479,166 @@ ses_setup(struct sessmem *sm)
 }
 
 /*--------------------------------------------------------------------
- * Get a new session, preferably by recycling an already ready one
+ * Get a sessmem, preferably by recycling an already ready one.
+ *
+ * With limit, fail rather than having more than max_sess.  wrk can be
+ * NULL, then its statistics are charged to the next worker through.
  */
 
-struct sess *
-SES_New(struct worker *wrk, struct sesspool *pp)
+static struct sessmem *
+ses_sm_get(struct worker *wrk, struct sesspool *pp, int limit)
 {
+	struct sesscache *sc;
 	struct sessmem *sm;
-	struct sess *sp;
+	struct sessmag *mag;
 	int do_alloc;
 
 	CHECK_OBJ_NOTNULL(pp, SESSPOOL_MAGIC);
 
+	sc = ses_getcache(wrk, pp);
+	sm = NULL;
+	if (sc != NULL)
+		sm = ses_cache_get(sc);
+	if (sm != NULL)
+		return (sm);
+
 	do_alloc = 0;
 	Lck_Lock(&pp->mtx);
-	sm = VTAILQ_FIRST(&pp->freelist);
-	if (sm != NULL) {
-		VTAILQ_REMOVE(&pp->freelist, sm, list);
-	} else if (pp->nsess < cache_param->max_sess) {
-		pp->nsess++;
-		do_alloc = 1;
+	if (!VTAILQ_EMPTY(&pp->full)) {
+		mag = VTAILQ_FIRST(&pp->full);
+		if (sc != NULL) {
+			/* Both our magazines are empty, trade for a loaded */
+			VTAILQ_REMOVE(&pp->full, mag, list);
+			pp->vsc->depot -= mag->n;
+			pp->vsc->depot_swaps++;
+			VTAILQ_INSERT_HEAD(&pp->empty, sc->prev, list);
+			sc->prev = sc->loaded;
+			sc->loaded = mag;
+			sm = ses_cache_get(sc);
+		} else {
+			sm = mag->sm[--mag->n];
+			pp->vsc->depot--;
+			if (mag->n == 0) {
+				VTAILQ_REMOVE(&pp->full, mag, list);
+				VTAILQ_INSERT_HEAD(&pp->empty, mag, list);
+			}
+		}
+		AN(sm);
+	} else {
+		sm = VTAILQ_FIRST(&pp->freelist);
+		if (sm != NULL) {
+			VTAILQ_REMOVE(&pp->freelist, sm, list);
+			pp->vsc->depot--;
+		} else if (!limit || pp->nsess < cache_param->max_sess) {
+			pp->nsess++;
+			pp->vsc->sessmem = pp->nsess;
+			do_alloc = 1;
+		}
+	}
+	if (wrk != NULL) {
+		wrk->stats.sessmem_free += pp->dly_free_cnt;
+		pp->dly_free_cnt = 0;
+		wrk->stats.sessmem_alloc += pp->dly_alloc_cnt;
+		pp->dly_alloc_cnt = 0;
 	}
-	wrk->stats.sessmem_free += pp->dly_free_cnt;
-	pp->dly_free_cnt = 0;
 	Lck_Unlock(&pp->mtx);
 	if (do_alloc) {
-		sm = ses_sm_alloc();
+		sm = ses_sm_alloc(pp);
 		if (sm != NULL) {
-			wrk->stats.sessmem_alloc++;
 			sm->pool = pp;
 			ses_setup(sm);
-		} else {
+			if (wrk != NULL)
+				wrk->stats.sessmem_alloc++;
+		} else if (wrk != NULL)
 			wrk->stats.sessmem_fail++;
+		if (sm == NULL || wrk == NULL) {
+			Lck_Lock(&pp->mtx);
+			if (sm == NULL) {
+				pp->nsess--;
+				pp->vsc->sessmem = pp->nsess;
+			} else
+				pp->dly_alloc_cnt++;
+			Lck_Unlock(&pp->mtx);
 		}
-	} else if (sm == NULL) {
+	} else if (sm == NULL && wrk != NULL) {
 		wrk->stats.sessmem_limit++;
 	}
+	return (sm);
+}
+
+/*--------------------------------------------------------------------
+ * Recycle a sessmem, or free it if it has the wrong size or there are
+ * too many.
+ *
+ * XXX: We should also check nhttp
+ */
+
+static void
+ses_sm_put(struct worker *wrk, struct sesspool *pp, struct sessmem *sm)
+{
+	struct sesscache *sc;
+	struct sessmag *mag;
+
+	CHECK_OBJ_NOTNULL(sm, SESSMEM_MAGIC);
+	if (sm->workspace != cache_param->sess_workspace ||
+	    sm->nhttp != (uint16_t)cache_param->http_max_hdr ||
+	    pp->nsess > cache_param->max_sess) {
+		Lck_Lock(&pp->mtx);
+		ses_sm_free(pp, sm);
+		if (wrk != NULL)
+			wrk->stats.sessmem_free++;
+		else
+			pp->dly_free_cnt++;
+		pp->nsess--;
+		pp->vsc->sessmem = pp->nsess;
+		Lck_Unlock(&pp->mtx);
+		return;
+	}
+
+	/* Clean and prepare for reuse */
+	ses_setup(sm);
+	sc = ses_getcache(wrk, pp);
+	if (sc != NULL && ses_cache_put(sc, sm))
+		return;
+	Lck_Lock(&pp->mtx);
+	if (wrk != NULL) {
+		wrk->stats.sessmem_free += pp->dly_free_cnt;
+		pp->dly_free_cnt = 0;
+	}
+	mag = NULL;
+	if (sc != NULL) {
+		/* Both our magazines are full, trade one for an empty one */
+		mag = VTAILQ_FIRST(&pp->empty);
+		if (mag != NULL)
+			VTAILQ_REMOVE(&pp->empty, mag, list);
+		else
+			mag = ses_mag_new();
+	}
+	if (mag != NULL) {
+		ses_depot_put(pp, sc->prev);
+		pp->vsc->depot_swaps++;
+		sc->prev = sc->loaded;
+		sc->loaded = mag;
+		AN(ses_cache_put(sc, sm));
+	} else {
+		VTAILQ_INSERT_HEAD(&pp->freelist, sm, list);
+		pp->vsc->depot++;
+	}
+	Lck_Unlock(&pp->mtx);
+}
+
+/*--------------------------------------------------------------------
+ * Get a new session
+ */
+
+struct sess *
+SES_New(struct worker *wrk, struct sesspool *pp)
+{
+	struct sessmem *sm;
+	struct sess *sp;
+
+	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
+	sm = ses_sm_get(wrk, pp, 1);
 	if (sm == NULL)
 		return (NULL);
 	sp = &sm->sess;
@@ -230,7 +656,7 @@ SES_Alloc(void)
 	struct sess *sp;
 	struct sessmem *sm;
 
-	sm = ses_sm_alloc();
+	sm = ses_sm_alloc(NULL);
 	AN(sm);
 	ses_setup(sm);
 	sp = &sm->sess;
@@ -245,17 +671,25 @@ SES_Alloc(void)
 static struct sesspool *
 ses_getpool(const struct sess *sp)
 {
-	struct sessmem *sm;
 	struct sesspool *pp;
 
 	CHECK_OBJ_NOTNULL(sp, SESS_MAGIC);
-	sm = sp->mem;
-	CHECK_OBJ_NOTNULL(sm, SESSMEM_MAGIC);
-	pp = sm->pool;
+	pp = sp->sesspool;
 	CHECK_OBJ_NOTNULL(pp, SESSPOOL_MAGIC);
 	return (pp);
 }
 
+/*--------------------------------------------------------------------
+ * Which pool a session belongs to, for waiters which shard by pool.
+ */
+
+unsigned
+SES_PoolNo(const struct sess *sp)
+{
+
+	return (ses_getpool(sp)->pool_no);
+}
+
 /*--------------------------------------------------------------------
  * Schedule a session back on a work-thread from its pool
  */
@@ -293,7 +727,15 @@ SES_Schedule(struct sess *sp)
 void
 SES_Handle(struct sess *sp, double now)
 {
+	struct sess *nsp;
 
+	nsp = SES_Attach(sp);
+	if (nsp == NULL) {
+		VSC_C_main->client_drop_late++;
+		SES_Delete(sp, "no memory", now);
+		return;
+	}
+	sp = nsp;
 	sp->step = STP_WAIT;
 	sp->t_req = now;
 	(void)SES_Schedule(sp);
@@ -319,11 +761,6 @@ SES_Close(struct sess *sp, const char *reason)
 
 /*--------------------------------------------------------------------
  * (Close &) Free or Recycle a session.
- *
- * If the workspace has changed, deleted it, otherwise wash it, and put
- * it up for adoption.
- *
- * XXX: We should also check nhttp
  */
 
 void
@@ -337,7 +774,7 @@ SES_Delete(struct sess *sp, const char *reason, double now)
 	pp = ses_getpool(sp);
 
 	sm = sp->mem;
-	CHECK_OBJ_NOTNULL(sm, SESSMEM_MAGIC);
+	CHECK_OBJ_ORNULL(sm, SESSMEM_MAGIC);
 	wrk = sp->wrk;
 	CHECK_OBJ_ORNULL(wrk, WORKER_MAGIC);
 
@@ -366,28 +803,69 @@ SES_Delete(struct sess *sp, const char *reason, double now)
 	    b->sess, b->req, b->pipe, b->pass,
 	    b->fetch, b->hdrbytes, b->bodybytes);
 
-	if (sm->workspace != cache_param->sess_workspace ||
-	    sm->nhttp != (uint16_t)cache_param->http_max_hdr ||
-	    pp->nsess > cache_param->max_sess) {
-		free(sm);
-		Lck_Lock(&pp->mtx);
-		if (wrk != NULL)
-			wrk->stats.sessmem_free++;
-		else
-			pp->dly_free_cnt++;
-		pp->nsess--;
-		Lck_Unlock(&pp->mtx);
-	} else {
-		/* Clean and prepare for reuse */
-		ses_setup(sm);
-		Lck_Lock(&pp->mtx);
-		if (wrk != NULL) {
-			wrk->stats.sessmem_free += pp->dly_free_cnt;
-			pp->dly_free_cnt = 0;
-		}
-		VTAILQ_INSERT_HEAD(&pp->freelist, sm, list);
-		Lck_Unlock(&pp->mtx);
+	if (sm == NULL) {
+		/* Idle session, see SES_Detach() */
+		MPL_Free(pp->mpl_sess, sp);
+		return;
 	}
+	ses_sm_put(wrk, pp, sm);
+}
+
+/*--------------------------------------------------------------------
+ * Idle sessions.
+ *
+ * A session going to the waiter gives its sessmem, with the workspace
+ * and the http structures, back to the pool, and only a copy of the
+ * struct sess waits, with its fd, addresses, timestamps and accounting.
+ * There are no pipelined bytes to keep: a session only goes to the
+ * waiter once its receive buffer is drained.  The session gets a sessmem
+ * again, at a new address, when the waiter hands it back.
+ */
+
+struct sess *
+SES_Detach(struct sess *sp)
+{
+	struct sesspool *pp;
+	struct sessmem *sm;
+	struct sess *isp;
+
+	pp = ses_getpool(sp);
+	sm = sp->mem;
+	CHECK_OBJ_NOTNULL(sm, SESSMEM_MAGIC);
+	AZ(sp->req);
+	isp = MPL_Get(pp->mpl_sess, NULL);
+	AN(isp);
+	*isp = *sp;
+	isp->mem = NULL;
+	isp->http = NULL;
+	isp->http0 = NULL;
+	memset(isp->ws, 0, sizeof isp->ws);
+	ses_sm_put(sp->wrk, pp, sm);
+	return (isp);
+}
+
+struct sess *
+SES_Attach(struct sess *isp)
+{
+	struct sesspool *pp;
+	struct sessmem *sm;
+	struct sess *sp;
+
+	pp = ses_getpool(isp);
+	if (isp->mem != NULL)
+		return (isp);
+	/* The client is already in, so max_sess does not apply */
+	sm = ses_sm_get(isp->wrk, pp, 0);
+	if (sm == NULL)
+		return (NULL);
+	sp = &sm->sess;
+	*sp = *isp;
+	sp->mem = sm;
+	WS_Init(sp->ws, "sess", sm->wsp, sm->workspace);
+	sp->http = sm->http[0];
+	sp->http0 = sm->http[1];
+	MPL_Free(pp->mpl_sess, isp);
+	return (sp);
 }
 
 /*--------------------------------------------------------------------
@@ -404,6 +882,7 @@ SES_GetReq(struct sess *sp)
 	sp->req = MPL_Get(pp->mpl_req, NULL);
 	AN(sp->req);
 	sp->req->magic = REQ_MAGIC;
+	VTAILQ_INIT(&sp->req->body);
 }
 
 void
@@ -413,6 +892,7 @@ SES_ReleaseReq(struct sess *sp)
 
 	pp = ses_getpool(sp);
 	CHECK_OBJ_NOTNULL(sp->req, REQ_MAGIC);
+	FetchReqBodyFree(sp->req);
 	MPL_AssertSane(sp->req);
 	MPL_Free(pp->mpl_req, sp->req);
 	sp->req = NULL;
@@ -431,11 +911,21 @@ SES_NewPool(struct pool *wp, unsigned pool_no)
 	ALLOC_OBJ(pp, SESSPOOL_MAGIC);
 	AN(pp);
 	pp->pool = wp;
+	pp->pool_no = pool_no;
 	VTAILQ_INIT(&pp->freelist);
+	VTAILQ_INIT(&pp->full);
+	VTAILQ_INIT(&pp->empty);
 	Lck_New(&pp->mtx, lck_sessmem);
+	bprintf(nb, "%u", pool_no);
+	pp->vsc = VSM_Alloc(sizeof *pp->vsc,
+	    VSC_CLASS, VSC_TYPE_SESSMEM, nb);
+	AN(pp->vsc);
 	bprintf(nb, "req%u", pool_no);
 	pp->req_size = sizeof (struct req);
 	pp->mpl_req = MPL_New(nb, &cache_param->req_pool, &pp->req_size);
+	bprintf(nb, "sess%u", pool_no);
+	pp->sess_size = sizeof (struct sess);
+	pp->mpl_sess = MPL_New(nb, &cache_param->sess_pool, &pp->sess_size);
 	return (pp);
 }
 
@@ -443,21 +933,44 @@ void
 SES_DeletePool(struct sesspool *pp, struct worker *wrk)
 {
 	struct sessmem *sm;
+	struct sessmag *mag;
+	struct sesslab *sl;
 
 	CHECK_OBJ_NOTNULL(pp, SESSPOOL_MAGIC);
 	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
 	Lck_Lock(&pp->mtx);
+	while (!VTAILQ_EMPTY(&pp->full)) {
+		mag = VTAILQ_FIRST(&pp->full);
+		CHECK_OBJ_NOTNULL(mag, SESSMAG_MAGIC);
+		VTAILQ_REMOVE(&pp->full, mag, list);
+		while (mag->n > 0) {
+			VTAILQ_INSERT_HEAD(&pp->freelist,
+			    mag->sm[--mag->n], list);
+		}
+		VTAILQ_INSERT_HEAD(&pp->empty, mag, list);
+	}
+	while (!VTAILQ_EMPTY(&pp->empty)) {
+		mag = VTAILQ_FIRST(&pp->empty);
+		VTAILQ_REMOVE(&pp->empty, mag, list);
+		FREE_OBJ(mag);
+	}
 	while (!VTAILQ_EMPTY(&pp->freelist)) {
 		sm = VTAILQ_FIRST(&pp->freelist);
 		CHECK_OBJ_NOTNULL(sm, SESSMEM_MAGIC);
 		VTAILQ_REMOVE(&pp->freelist, sm, list);
-		FREE_OBJ(sm);
+		ses_sm_free(pp, sm);
 		wrk->stats.sessmem_free++;
 		pp->nsess--;
 	}
 	AZ(pp->nsess);
+	sl = pp->slab;
+	pp->slab = NULL;
+	if (sl != NULL)
+		ses_slab_free(pp, sl);
 	Lck_Unlock(&pp->mtx);
 	Lck_Delete(&pp->mtx);
 	MPL_Destroy(&pp->mpl_req);
+	MPL_Destroy(&pp->mpl_sess);
+	VSM_Free(pp->vsc);
 	FREE_OBJ(pp);
 }
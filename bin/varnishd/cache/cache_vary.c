@@ -54,6 +54,8 @@
 
 #include "config.h"
 
+#include <stdlib.h>
+
 #include "cache.h"
 
 #include "vct.h"
@@ -246,6 +248,86 @@ VRY_Match(struct sess *sp, const uint8_t *vary)
 	return (retval);
 }
 
+/*
+ * The headers of a vary string without their values, which is still a
+ * valid vary string, so VRY_Match() can pick the request values for the
+ * same headers out of it.
+ */
+
+uint8_t *
+VRY_Spec(const uint8_t *vary)
+{
+	const uint8_t *v;
+	uint8_t *spec, *p;
+	unsigned l;
+
+	for (v = vary, l = 3; v[2]; v += vry_len(v))
+		l += 2 + v[2] + 2;
+	spec = malloc(l);
+	if (spec == NULL)
+		return (NULL);
+	for (v = vary, p = spec; v[2]; v += vry_len(v)) {
+		vbe16enc(p, 0xffff);
+		memcpy(p + 2, v + 2, v[2] + 2);
+		p += 2 + v[2] + 2;
+	}
+	p[0] = 0xff;
+	p[1] = 0xff;
+	p[2] = 0;
+	assert(p + 3 == spec + l);
+	return (spec);
+}
+
+/*
+ * Are the same headers in the same order in both vary strings ?
+ */
+
+int
+VRY_SameHeaders(const uint8_t *v1, const uint8_t *v2)
+{
+
+	while (v1[2] && v2[2]) {
+		if (memcmp(v1 + 2, v2 + 2, v1[2] + 2))
+			return (0);
+		v1 += vry_len(v1);
+		v2 += vry_len(v2);
+	}
+	return (v1[2] == v2[2]);
+}
+
+/*
+ * A fingerprint of the values in a vary string, for the variant index in
+ * the objhead.  Accept-Encoding is left out, because VRY_Match() may
+ * ignore it, so vary strings which match always have the same
+ * fingerprint, but not the other way around.
+ */
+
+static uint32_t
+vry_fnv(uint32_t h, const uint8_t *p, unsigned l)
+{
+
+	while (l-- > 0)
+		h = (h ^ *p++) * 16777619U;
+	return (h);
+}
+
+uint32_t
+VRY_Fingerprint(const uint8_t *vary)
+{
+	uint32_t h = 2166136261U;		/* FNV-1a */
+	unsigned l;
+
+	for (; vary[2]; vary += vry_len(vary)) {
+		if (!strcasecmp(H_Accept_Encoding, (const char*)vary + 2))
+			continue;
+		/* The length, and the value after the header */
+		l = 2 + vary[2] + 2;
+		h = vry_fnv(h, vary, 2);
+		h = vry_fnv(h, vary + l, vry_len(vary) - l);
+	}
+	return (h);
+}
+
 void
 VRY_Validate(const uint8_t *vary)
 {
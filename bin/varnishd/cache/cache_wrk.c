@@ -37,6 +37,7 @@
 #include "cache.h"
 
 #include "hash/hash_slinger.h"
+#include "vfh256.h"
 #include "vsha256.h"
 
 static struct lock		wstat_mtx;
@@ -142,6 +143,7 @@ wrk_thread_real(void *priv, unsigned shm_workspace, unsigned sess_workspace,
 	unsigned char http2[http_space];
 	struct iovec iov[siov];
 	struct SHA256Context sha256;
+	struct VFH256Context vfh256;
 
 	THR_SetName("cache-worker");
 	w = &ww;
@@ -151,6 +153,7 @@ wrk_thread_real(void *priv, unsigned shm_workspace, unsigned sess_workspace,
 	w->wlb = w->wlp = wlog;
 	w->wle = wlog + (sizeof wlog) / 4;
 	w->sha256ctx = &sha256;
+	w->vfh256ctx = &vfh256;
 	w->resp = HTTP_create(http2, nhttp);
 	w->wrw.iov = iov;
 	w->wrw.siov = siov;
@@ -169,6 +172,7 @@ wrk_thread_real(void *priv, unsigned shm_workspace, unsigned sess_workspace,
 		VCL_Rel(&w->vcl);
 	AZ(pthread_cond_destroy(&w->cond));
 	HSH_Cleanup(w);
+	SES_Cleanup(w);
 	WRK_SumStat(w);
 	return (NULL);
 }
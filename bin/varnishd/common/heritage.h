@@ -38,6 +38,14 @@ struct listen_sock {
 	int				sock;
 	char				*name;
 	struct vss_addr			*addr;
+
+	/* SO_REUSEPORT clones of sock, see param listen_reuseport */
+	unsigned			nshard;
+	struct listen_sock		**shard;
+
+	/* Local address of connections, unless bound to a wildcard */
+	struct sockaddr_storage		*myaddr;
+	unsigned			myaddrlen;
 };
 
 VTAILQ_HEAD(listen_sock_head, listen_sock);
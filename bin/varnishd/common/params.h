@@ -71,16 +71,28 @@ struct params {
 	unsigned		wthread_stats_rate;
 	unsigned		wthread_stacksize;
 	unsigned		wthread_workspace;
+	unsigned		wthread_affinity;
+#define WTHREAD_AFFINITY_OFF	0
+#define WTHREAD_AFFINITY_CPU	1
+#define WTHREAD_AFFINITY_NUMA	2
+	unsigned		wthread_lockfree;
+	unsigned		wthread_steal;
+	unsigned		wthread_herder;
+#define WTHREAD_HERDER_QUEUE	0
+#define WTHREAD_HERDER_LATENCY	1
+	unsigned		wthread_lat_target;
 
 	unsigned		queue_max;
 
 	/* Memory allocation hints */
 	unsigned		sess_workspace;
+	unsigned		sess_hugepages;
 	unsigned		shm_workspace;
 	unsigned		http_req_size;
 	unsigned		http_req_hdr_len;
 	unsigned		http_resp_size;
 	unsigned		http_resp_hdr_len;
+	unsigned		req_body_cache;
 	unsigned		http_max_hdr;
 
 	unsigned		shm_reclen;
@@ -89,8 +101,11 @@ struct params {
 	double			timeout_idle;
 	double			timeout_req;
 	unsigned		pipe_timeout;
+	unsigned		pipe_thread;
+	unsigned		fetch_park;
 	unsigned		send_timeout;
 	unsigned		idle_send_timeout;
+	unsigned		send_async_threshold;
 
 	/* Management hints */
 	unsigned		auto_restart;
@@ -114,6 +129,13 @@ struct params {
 	/* Listen depth */
 	unsigned		listen_depth;
 
+	/* A listen socket per thread pool */
+	unsigned		listen_reuseport;
+
+	/* Listen socket options */
+	unsigned		listen_defer_accept;
+	unsigned		listen_fastopen;
+
 	/* CLI related */
 	unsigned		cli_timeout;
 	unsigned		cli_limit;
@@ -150,6 +172,9 @@ struct params {
 	/* Log hash string to shm */
 	unsigned		log_hash;
 
+	/* Digest the hash string with VFH256 rather than SHA256 */
+	unsigned		hash_fast_digest;
+
 	/* Log local socket address to shm */
 	unsigned		log_local_addr;
 
@@ -167,6 +192,12 @@ struct params {
 	double			acceptor_sleep_incr;
 	double			acceptor_sleep_decay;
 
+	/* Connections accepted per wake-up */
+	unsigned		accept_batch;
+
+	/* Waiter threads */
+	unsigned		waiter_shards;
+
 	/* Get rid of duplicate bans */
 	unsigned		ban_dups;
 
@@ -180,6 +211,8 @@ struct params {
 
 	unsigned		http_range_support;
 
+	unsigned		obj_hdrblk;
+
 	unsigned		http_gzip_support;
 	unsigned		gzip_stack_buffer;
 	unsigned		gzip_tmp_space;
@@ -201,4 +234,5 @@ struct params {
 
 	struct poolparam	vbc_pool;
 	struct poolparam	req_pool;
+	struct poolparam	sess_pool;
 };
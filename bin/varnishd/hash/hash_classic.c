@@ -27,6 +27,18 @@
  * SUCH DAMAGE.
  *
  * A classic bucketed hash
+ *
+ * The table grows and shrinks with the number of objheads, one bucket at
+ * a time, by linear hashing: with m <= n < 2m buckets in use, a digest
+ * goes in bucket digest % 2m, unless that is not in use yet, in which
+ * case it goes in digest % m.  Adding bucket n splits bucket n - m, and
+ * removing it merges it back.  The buckets live in fixed size segments,
+ * so they never move, and their locks stay put.
+ *
+ * Only the two buckets involved are locked for a split or merge, so
+ * lookups go on in the rest of the table.  Whoever locks a bucket checks
+ * that the number of buckets did not change under it in a way which
+ * sends the digest elsewhere, and tries again if it did.
  */
 
 #include "config.h"
@@ -37,6 +49,7 @@
 #include "cache/cache.h"
 
 #include "hash/hash_slinger.h"
+#include "vmb.h"
 
 /*--------------------------------------------------------------------*/
 
@@ -47,8 +60,189 @@ struct hcl_hd {
 	struct lock		mtx;
 };
 
+#define HCL_SEG			1024		/* Buckets per segment */
+#define HCL_NSEG		65536
+#define HCL_GROW		2		/* Average chain to grow at */
+#define HCL_SHRINK		2		/* 1/average chain to shrink at */
+#define HCL_STEP		4		/* Splits or merges per go */
+
 static unsigned			hcl_nhash = 16383;
-static struct hcl_hd		*hcl_head;
+static struct hcl_hd		*hcl_seg[HCL_NSEG];
+static unsigned			hcl_n;		/* Buckets in use */
+static unsigned			hcl_nobj;
+static unsigned			hcl_nfull;	/* Non-empty buckets */
+static struct lock		hcl_resize_mtx;
+
+static struct hcl_hd *
+hcl_hd(unsigned u)
+{
+	struct hcl_hd *hp;
+
+	hp = &hcl_seg[u / HCL_SEG][u % HCL_SEG];
+	CHECK_OBJ_NOTNULL(hp, HCL_HEAD_MAGIC);
+	return (hp);
+}
+
+/* The size of the table before the current round of splits */
+
+static unsigned
+hcl_m(unsigned n)
+{
+	unsigned m, u;
+
+	m = hcl_nhash;
+	for (u = n / hcl_nhash; u > 1; u >>= 1)
+		m <<= 1;
+	return (m);
+}
+
+static struct hcl_hd *
+hcl_bucket(unsigned digest, unsigned n)
+{
+	unsigned m, u;
+
+	m = hcl_m(n);
+	u = digest % (2 * m);
+	if (u >= n)
+		u = digest % m;
+	return (hcl_hd(u));
+}
+
+static void
+hcl_stats(void)
+{
+	unsigned n, nobj, nfull;
+
+	n = hcl_n;
+	nobj = hcl_nobj;
+	nfull = hcl_nfull;
+	VSC_C_main->hcl_buckets = n;
+	VSC_C_main->hcl_load = nobj * 100ULL / n;
+	VSC_C_main->hcl_chain = nfull > 0 ? nobj * 100ULL / nfull : 0;
+}
+
+static void
+hcl_seg_alloc(unsigned s)
+{
+	struct hcl_hd *hp;
+	unsigned u;
+
+	assert(s < HCL_NSEG);
+	AZ(hcl_seg[s]);
+	hp = calloc(sizeof *hp, HCL_SEG);
+	XXXAN(hp);
+	for (u = 0; u < HCL_SEG; u++) {
+		VTAILQ_INIT(&hp[u].head);
+		Lck_New(&hp[u].mtx, lck_hcl);
+		hp[u].magic = HCL_HEAD_MAGIC;
+	}
+	hcl_seg[s] = hp;
+}
+
+/*--------------------------------------------------------------------
+ * Add bucket n, taking the objheads which belong there from n - m.
+ */
+
+static void
+hcl_split(void)
+{
+	struct hcl_hd *src, *dst;
+	struct objhead *oh, *oh2;
+	unsigned n, m, digest;
+
+	n = hcl_n;
+	m = hcl_m(n);
+	if (hcl_seg[n / HCL_SEG] == NULL)
+		hcl_seg_alloc(n / HCL_SEG);
+	src = hcl_hd(n - m);
+	dst = hcl_hd(n);
+
+	Lck_Lock(&src->mtx);
+	Lck_Lock(&dst->mtx);
+	AN(VTAILQ_EMPTY(&dst->head));
+	VTAILQ_FOREACH_SAFE(oh, &src->head, hoh_list, oh2) {
+		memcpy(&digest, oh->digest, sizeof digest);
+		if (digest % (2 * m) == n - m)
+			continue;
+		assert(digest % (2 * m) == n);
+		/* Same order as the source, so still sorted */
+		VTAILQ_REMOVE(&src->head, oh, hoh_list);
+		VTAILQ_INSERT_TAIL(&dst->head, oh, hoh_list);
+		oh->hoh_head = dst;
+	}
+	if (!VTAILQ_EMPTY(&dst->head) && !VTAILQ_EMPTY(&src->head))
+		(void)__sync_fetch_and_add(&hcl_nfull, 1);
+	/* The new segment must be visible before the bucket is */
+	VWMB();
+	hcl_n = n + 1;
+	Lck_Unlock(&dst->mtx);
+	Lck_Unlock(&src->mtx);
+}
+
+/*--------------------------------------------------------------------
+ * Remove the last bucket, merging its objheads back into its buddy.
+ */
+
+static void
+hcl_merge(void)
+{
+	struct hcl_hd *src, *dst;
+	struct objhead *oh, *oh2;
+	unsigned n, m;
+
+	n = hcl_n - 1;
+	m = hcl_m(n);
+	dst = hcl_hd(n - m);
+	src = hcl_hd(n);
+
+	Lck_Lock(&dst->mtx);
+	Lck_Lock(&src->mtx);
+	if (!VTAILQ_EMPTY(&src->head) && !VTAILQ_EMPTY(&dst->head))
+		(void)__sync_fetch_and_sub(&hcl_nfull, 1);
+	oh2 = VTAILQ_FIRST(&dst->head);
+	while (!VTAILQ_EMPTY(&src->head)) {
+		oh = VTAILQ_FIRST(&src->head);
+		VTAILQ_REMOVE(&src->head, oh, hoh_list);
+		while (oh2 != NULL &&
+		    memcmp(oh2->digest, oh->digest, sizeof oh->digest) < 0)
+			oh2 = VTAILQ_NEXT(oh2, hoh_list);
+		if (oh2 != NULL)
+			VTAILQ_INSERT_BEFORE(oh2, oh, hoh_list);
+		else
+			VTAILQ_INSERT_TAIL(&dst->head, oh, hoh_list);
+		oh->hoh_head = dst;
+	}
+	hcl_n = n;
+	Lck_Unlock(&src->mtx);
+	Lck_Unlock(&dst->mtx);
+}
+
+/*--------------------------------------------------------------------
+ * Take a few steps towards the size we want, unless someone else is
+ * already at it.
+ */
+
+static void
+hcl_resize(void)
+{
+	unsigned u;
+
+	if (Lck_Trylock(&hcl_resize_mtx))
+		return;
+	for (u = 0; u < HCL_STEP; u++) {
+		if (hcl_nobj > hcl_n * HCL_GROW &&
+		    hcl_n < HCL_SEG * HCL_NSEG - 1)
+			hcl_split();
+		else if (hcl_n > hcl_nhash &&
+		    hcl_nobj * HCL_SHRINK < hcl_n)
+			hcl_merge();
+		else
+			break;
+	}
+	Lck_Unlock(&hcl_resize_mtx);
+	if (u > 0)
+		hcl_stats();
+}
 
 /*--------------------------------------------------------------------
  * The ->init method allows the management process to pass arguments
@@ -76,6 +270,8 @@ hcl_init(int ac, char * const *av)
 		    " hash bucket.\n");
 		u--;
 	}
+	if (u > HCL_SEG * (HCL_NSEG / 2))
+		ARGV_ERR("(-hclassic) too many buckets\n");
 	hcl_nhash = u;
 	fprintf(stderr, "Classic hash: %u buckets\n", hcl_nhash);
 	return;
@@ -91,14 +287,11 @@ hcl_start(void)
 {
 	unsigned u;
 
-	hcl_head = calloc(sizeof *hcl_head, hcl_nhash);
-	XXXAN(hcl_head);
-
-	for (u = 0; u < hcl_nhash; u++) {
-		VTAILQ_INIT(&hcl_head[u].head);
-		Lck_New(&hcl_head[u].mtx, lck_hcl);
-		hcl_head[u].magic = HCL_HEAD_MAGIC;
-	}
+	Lck_New(&hcl_resize_mtx, lck_hcl);
+	for (u = 0; u * HCL_SEG < hcl_nhash; u++)
+		hcl_seg_alloc(u);
+	hcl_n = hcl_nhash;
+	hcl_stats();
 }
 
 /*--------------------------------------------------------------------
@@ -115,7 +308,7 @@ hcl_lookup(const struct sess *sp, struct objhead *noh)
 {
 	struct objhead *oh;
 	struct hcl_hd *hp;
-	unsigned u1, digest;
+	unsigned n, digest;
 	int i;
 
 	CHECK_OBJ_NOTNULL(sp, SESS_MAGIC);
@@ -123,10 +316,17 @@ hcl_lookup(const struct sess *sp, struct objhead *noh)
 
 	assert(sizeof noh->digest > sizeof digest);
 	memcpy(&digest, noh->digest, sizeof digest);
-	u1 = digest % hcl_nhash;
-	hp = &hcl_head[u1];
+	while (1) {
+		n = hcl_n;
+		VRMB();
+		hp = hcl_bucket(digest, n);
+		Lck_Lock(&hp->mtx);
+		if (hcl_n == n || hcl_bucket(digest, hcl_n) == hp)
+			break;
+		/* Split or merged under us */
+		Lck_Unlock(&hp->mtx);
+	}
 
-	Lck_Lock(&hp->mtx);
 	VTAILQ_FOREACH(oh, &hp->head, hoh_list) {
 		i = memcmp(oh->digest, noh->digest, sizeof oh->digest);
 		if (i < 0)
@@ -138,6 +338,8 @@ hcl_lookup(const struct sess *sp, struct objhead *noh)
 		return (oh);
 	}
 
+	if (VTAILQ_EMPTY(&hp->head))
+		(void)__sync_fetch_and_add(&hcl_nfull, 1);
 	if (oh != NULL)
 		VTAILQ_INSERT_BEFORE(oh, noh, hoh_list);
 	else
@@ -146,6 +348,12 @@ hcl_lookup(const struct sess *sp, struct objhead *noh)
 	noh->hoh_head = hp;
 
 	Lck_Unlock(&hp->mtx);
+
+	(void)__sync_fetch_and_add(&hcl_nobj, 1);
+	if (hcl_nobj > hcl_n * HCL_GROW)
+		hcl_resize();
+	else
+		hcl_stats();
 	return (noh);
 }
 
@@ -160,15 +368,30 @@ hcl_deref(struct objhead *oh)
 	int ret;
 
 	CHECK_OBJ_NOTNULL(oh, OBJHEAD_MAGIC);
-	CAST_OBJ_NOTNULL(hp, oh->hoh_head, HCL_HEAD_MAGIC);
 	assert(oh->refcnt > 0);
-	Lck_Lock(&hp->mtx);
+	while (1) {
+		CAST_OBJ_NOTNULL(hp, oh->hoh_head, HCL_HEAD_MAGIC);
+		Lck_Lock(&hp->mtx);
+		if (oh->hoh_head == hp)
+			break;
+		/* Moved by a split or merge */
+		Lck_Unlock(&hp->mtx);
+	}
 	if (--oh->refcnt == 0) {
 		VTAILQ_REMOVE(&hp->head, oh, hoh_list);
+		if (VTAILQ_EMPTY(&hp->head))
+			(void)__sync_fetch_and_sub(&hcl_nfull, 1);
 		ret = 0;
 	} else
 		ret = 1;
 	Lck_Unlock(&hp->mtx);
+	if (ret == 0) {
+		(void)__sync_fetch_and_sub(&hcl_nobj, 1);
+		if (hcl_n > hcl_nhash && hcl_nobj * HCL_SHRINK < hcl_n)
+			hcl_resize();
+		else
+			hcl_stats();
+	}
 	return (ret);
 }
 
@@ -26,12 +26,21 @@
  * SUCH DAMAGE.
  *
  * A Crit Bit tree based hash
+ *
+ * The digest space is split by its top bits between a number of trees,
+ * each with its own lock for inserts and deletes.  Lookups walk the trees
+ * without locks, so what is deleted from a tree is only freed once no
+ * lookup can still be looking at it: each thread which walks a tree
+ * announces the epoch it started in, and the cleaner frees what was
+ * deleted two epochs ago once every walk in progress has seen the
+ * current one.
  */
 
 // #define PHK
 
 #include "config.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 
 #include "cache/cache.h"
@@ -41,8 +50,6 @@
 #include "vmb.h"
 #include "vtim.h"
 
-static struct lock hcb_mtx;
-
 /*---------------------------------------------------------------------
  * Table for finding out how many bits two bytes have in common,
  * counting from the MSB towards the LSB.
@@ -104,12 +111,122 @@ struct hcb_root {
 	volatile uintptr_t	origo;
 };
 
-static struct hcb_root	hcb_root;
+struct hcb_shard {
+	unsigned		magic;
+#define HCB_SHARD_MAGIC		0x3a6f1d58
+	struct lock		mtx;
+	struct hcb_root		root;
+	/* What was deleted in epoch e, on list e % 3 */
+	VSTAILQ_HEAD(, hcb_y)	dead_y[3];
+	VTAILQ_HEAD(, objhead)	dead_h[3];
+	struct VSC_C_hcb	*vsc;
+};
 
-static VSTAILQ_HEAD(, hcb_y)	cool_y = VSTAILQ_HEAD_INITIALIZER(cool_y);
-static VSTAILQ_HEAD(, hcb_y)	dead_y = VSTAILQ_HEAD_INITIALIZER(dead_y);
-static VTAILQ_HEAD(, objhead)	cool_h = VTAILQ_HEAD_INITIALIZER(cool_h);
-static VTAILQ_HEAD(, objhead)	dead_h = VTAILQ_HEAD_INITIALIZER(dead_h);
+static unsigned			hcb_nshard = 16;
+static unsigned			hcb_shift;
+static struct hcb_shard		*hcb_shard;
+
+static struct hcb_shard *
+hcb_shard_of(const struct objhead *oh)
+{
+	struct hcb_shard *sh;
+
+	sh = &hcb_shard[oh->digest[0] >> hcb_shift];
+	CHECK_OBJ_NOTNULL(sh, HCB_SHARD_MAGIC);
+	return (sh);
+}
+
+/*---------------------------------------------------------------------
+ * Epochs
+ *
+ * Every thread which walks the trees has a slot, where it puts the
+ * epoch it saw while it is in a tree.  The epoch only moves on when all
+ * threads in a tree have seen the current one, and then nobody can be
+ * looking at what was deleted before the previous one.
+ */
+
+struct hcb_ep {
+	unsigned		magic;
+#define HCB_EP_MAGIC		0x51c2e8a0
+	volatile unsigned	state;	/* (epoch << 1) | 1 when in a tree */
+	unsigned		idle;	/* Thread is gone, slot is free */
+	VTAILQ_ENTRY(hcb_ep)	list;
+};
+
+static volatile unsigned	hcb_epoch;
+static VTAILQ_HEAD(, hcb_ep)	hcb_eps = VTAILQ_HEAD_INITIALIZER(hcb_eps);
+static struct lock		hcb_ep_mtx;
+static pthread_key_t		hcb_ep_key;
+
+static void
+hcb_ep_free(void *priv)
+{
+	struct hcb_ep *ep;
+
+	CAST_OBJ_NOTNULL(ep, priv, HCB_EP_MAGIC);
+	Lck_Lock(&hcb_ep_mtx);
+	ep->state = 0;
+	ep->idle = 1;
+	Lck_Unlock(&hcb_ep_mtx);
+}
+
+static struct hcb_ep *
+hcb_ep_get(void)
+{
+	struct hcb_ep *ep;
+
+	ep = pthread_getspecific(hcb_ep_key);
+	if (ep != NULL) {
+		CHECK_OBJ(ep, HCB_EP_MAGIC);
+		return (ep);
+	}
+	Lck_Lock(&hcb_ep_mtx);
+	VTAILQ_FOREACH(ep, &hcb_eps, list)
+		if (ep->idle)
+			break;
+	if (ep == NULL) {
+		ALLOC_OBJ(ep, HCB_EP_MAGIC);
+		XXXAN(ep);
+		VTAILQ_INSERT_TAIL(&hcb_eps, ep, list);
+	}
+	ep->idle = 0;
+	Lck_Unlock(&hcb_ep_mtx);
+	AZ(pthread_setspecific(hcb_ep_key, ep));
+	return (ep);
+}
+
+static void
+hcb_ep_enter(struct hcb_ep *ep)
+{
+
+	unsigned e;
+
+	AZ(ep->state);
+	/* The cleaner may move on before it sees our slot, so look again */
+	do {
+		e = hcb_epoch;
+		ep->state = (e << 1) | 1;
+		VMB();
+	} while (e != hcb_epoch);
+}
+
+static void
+hcb_ep_leave(struct hcb_ep *ep)
+{
+
+	VMB();
+	ep->state = 0;
+}
+
+/* Call with the shard lock held, after unlinking from the tree */
+
+static unsigned
+hcb_ep_retire(void)
+{
+
+	VMB();
+	return (hcb_epoch % 3);
+}
 
 /*---------------------------------------------------------------------
  * Pointer accessor functions
@@ -269,11 +386,12 @@ hcb_insert(struct worker *wrk, struct hcb_root *root, struct objhead *oh,
 /*--------------------------------------------------------------------*/
 
 static void
-hcb_delete(struct hcb_root *r, struct objhead *oh)
+hcb_delete(struct hcb_shard *sh, struct objhead *oh)
 {
+	struct hcb_root *r = &sh->root;
 	struct hcb_y *y;
 	volatile uintptr_t *p;
-	unsigned s;
+	unsigned s, e;
 
 	if (r->origo == hcb_r_node(oh)) {
 		r->origo = 0;
@@ -291,7 +409,8 @@ hcb_delete(struct hcb_root *r, struct objhead *oh)
 		assert(s < 2);
 		if (y->leaf[s] == hcb_r_node(oh)) {
 			*p = y->leaf[1 - s];
-			VSTAILQ_INSERT_TAIL(&cool_y, y, list);
+			e = hcb_ep_retire();
+			VSTAILQ_INSERT_TAIL(&sh->dead_y[e], y, list);
 			return;
 		}
 		p = &y->leaf[s];
@@ -330,11 +449,16 @@ static void
 hcb_dump(struct cli *cli, const char * const *av, void *priv)
 {
 
+	unsigned u;
+
 	(void)priv;
 	(void)av;
 	VCLI_Out(cli, "HCB dump:\n");
-	dumptree(cli, hcb_root.origo, 0);
-	VCLI_Out(cli, "Coollist:\n");
+	for (u = 0; u < hcb_nshard; u++) {
+		VCLI_Out(cli, "Shard %u:\n", u);
+		dumptree(cli, hcb_shard[u].root.origo, 0);
+	}
+	VCLI_Out(cli, "Epoch: %u\n", hcb_epoch);
 }
 
 static struct cli_proto hcb_cmds[] = {
@@ -347,9 +471,14 @@ static struct cli_proto hcb_cmds[] = {
 static void *
 hcb_cleaner(void *priv)
 {
+	VSTAILQ_HEAD(, hcb_y) dead_y;
+	VTAILQ_HEAD(, objhead) dead_h;
+	struct hcb_shard *sh;
 	struct hcb_y *y, *y2;
+	struct hcb_ep *ep;
 	struct worker ww;
 	struct objhead *oh, *oh2;
+	unsigned e, s, u;
 
 	memset(&ww, 0, sizeof ww);
 	ww.magic = WORKER_MAGIC;
@@ -357,6 +486,32 @@ hcb_cleaner(void *priv)
 	THR_SetName("hcb_cleaner");
 	(void)priv;
 	while (1) {
+		VTIM_sleep(cache_param->critbit_cooloff);
+
+		/* Has every thread in a tree seen the current epoch ? */
+		e = hcb_epoch;
+		Lck_Lock(&hcb_ep_mtx);
+		VTAILQ_FOREACH(ep, &hcb_eps, list) {
+			s = ep->state;
+			if ((s & 1) && (s >> 1) != (e & (~0U >> 1)))
+				break;
+		}
+		Lck_Unlock(&hcb_ep_mtx);
+		if (ep != NULL)
+			continue;
+		hcb_epoch = e + 1;
+		VMB();
+
+		/* Then nobody can see what was deleted in e - 1 */
+		VSTAILQ_INIT(&dead_y);
+		VTAILQ_INIT(&dead_h);
+		for (u = 0; u < hcb_nshard; u++) {
+			sh = &hcb_shard[u];
+			Lck_Lock(&sh->mtx);
+			VSTAILQ_CONCAT(&dead_y, &sh->dead_y[(e + 2) % 3]);
+			VTAILQ_CONCAT(&dead_h, &sh->dead_h[(e + 2) % 3], hoh_list);
+			Lck_Unlock(&sh->mtx);
+		}
 		VSTAILQ_FOREACH_SAFE(y, &dead_y, list, y2) {
 			VSTAILQ_REMOVE_HEAD(&dead_y, list);
 			FREE_OBJ(y);
@@ -365,51 +520,93 @@ hcb_cleaner(void *priv)
 			VTAILQ_REMOVE(&dead_h, oh, hoh_list);
 			HSH_DeleteObjHead(&ww, oh);
 		}
-		Lck_Lock(&hcb_mtx);
-		VSTAILQ_CONCAT(&dead_y, &cool_y);
-		VTAILQ_CONCAT(&dead_h, &cool_h, hoh_list);
-		Lck_Unlock(&hcb_mtx);
 		WRK_SumStat(&ww);
-		VTIM_sleep(cache_param->critbit_cooloff);
 	}
 	NEEDLESS_RETURN(NULL);
 }
 
+/*--------------------------------------------------------------------
+ * The ->init method allows the management process to pass arguments
+ */
+
+static void
+hcb_init(int ac, char * const *av)
+{
+	unsigned u;
+
+	if (ac == 0)
+		return;
+	if (ac > 1)
+		ARGV_ERR("(-hcritbit) too many arguments\n");
+	if (sscanf(av[0], "%u", &u) != 1 || u == 0 || u > 256 ||
+	    (u & (u - 1)))
+		ARGV_ERR("(-hcritbit) shards must be a power of two"
+		    " no larger than 256\n");
+	hcb_nshard = u;
+}
+
 /*--------------------------------------------------------------------*/
 
 static void
 hcb_start(void)
 {
-	struct objhead *oh = NULL;
+	struct hcb_shard *sh;
 	pthread_t tp;
+	char buf[8];
+	unsigned u, e;
 
-	(void)oh;
 	CLI_AddFuncs(hcb_cmds);
-	Lck_New(&hcb_mtx, lck_hcb);
-	AZ(pthread_create(&tp, NULL, hcb_cleaner, NULL));
-	memset(&hcb_root, 0, sizeof hcb_root);
+	Lck_New(&hcb_ep_mtx, lck_hcb);
+	AZ(pthread_key_create(&hcb_ep_key, hcb_ep_free));
+	for (hcb_shift = 8; (1U << (8 - hcb_shift)) < hcb_nshard; hcb_shift--)
+		continue;
+	hcb_shard = calloc(sizeof *hcb_shard, hcb_nshard);
+	XXXAN(hcb_shard);
+	for (u = 0; u < hcb_nshard; u++) {
+		sh = &hcb_shard[u];
+		sh->magic = HCB_SHARD_MAGIC;
+		Lck_New(&sh->mtx, lck_hcb);
+		for (e = 0; e < 3; e++) {
+			VSTAILQ_INIT(&sh->dead_y[e]);
+			VTAILQ_INIT(&sh->dead_h[e]);
+		}
+		bprintf(buf, "%u", u);
+		sh->vsc = VSM_Alloc(sizeof *sh->vsc, VSC_CLASS, VSC_TYPE_HCB,
+		    buf);
+		AN(sh->vsc);
+	}
 	hcb_build_bittbl();
+	AZ(pthread_create(&tp, NULL, hcb_cleaner, NULL));
 }
 
 static int
 hcb_deref(struct objhead *oh)
 {
+	struct hcb_shard *sh;
+	struct hcb_ep *ep;
+	unsigned e;
 	int r;
 
 	r = 1;
 	CHECK_OBJ_NOTNULL(oh, OBJHEAD_MAGIC);
+	/* The cleaner must not free oh before we let go of oh->mtx */
+	ep = hcb_ep_get();
+	hcb_ep_enter(ep);
 	Lck_Lock(&oh->mtx);
 	assert(oh->refcnt > 0);
 	oh->refcnt--;
 	if (oh->refcnt == 0) {
-		Lck_Lock(&hcb_mtx);
-		hcb_delete(&hcb_root, oh);
-		VTAILQ_INSERT_TAIL(&cool_h, oh, hoh_list);
-		Lck_Unlock(&hcb_mtx);
+		sh = hcb_shard_of(oh);
+		Lck_Lock(&sh->mtx);
+		hcb_delete(sh, oh);
+		e = hcb_ep_retire();
+		VTAILQ_INSERT_TAIL(&sh->dead_h[e], oh, hoh_list);
+		Lck_Unlock(&sh->mtx);
 		assert(VTAILQ_EMPTY(&oh->objcs));
 		AZ(oh->waitinglist);
 	}
 	Lck_Unlock(&oh->mtx);
+	hcb_ep_leave(ep);
 #ifdef PHK
 	fprintf(stderr, "hcb_defef %d %d <%s>\n", __LINE__, r, oh->hash);
 #endif
@@ -420,35 +617,43 @@ static struct objhead *
 hcb_lookup(const struct sess *sp, struct objhead *noh)
 {
 	struct objhead *oh;
+	struct hcb_shard *sh;
+	struct hcb_ep *ep;
 	struct hcb_y *y;
 	unsigned u;
 	unsigned with_lock;
 
 	(void)sp;
 
+	sh = hcb_shard_of(noh);
+	ep = hcb_ep_get();
 	with_lock = 0;
 	while (1) {
+		/* Until we hold a reference, oh is only safe in the epoch */
+		hcb_ep_enter(ep);
 		if (with_lock) {
 			CAST_OBJ_NOTNULL(y, sp->wrk->nhashpriv, HCB_Y_MAGIC);
-			Lck_Lock(&hcb_mtx);
-			VSC_C_main->hcb_lock++;
+			Lck_Lock(&sh->mtx);
+			sh->vsc->lock++;
 			assert(noh->refcnt == 1);
-			oh = hcb_insert(sp->wrk, &hcb_root, noh, 1);
-			Lck_Unlock(&hcb_mtx);
+			oh = hcb_insert(sp->wrk, &sh->root, noh, 1);
+			Lck_Unlock(&sh->mtx);
 		} else {
-			VSC_C_main->hcb_nolock++;
-			oh = hcb_insert(sp->wrk, &hcb_root, noh, 0);
+			sh->vsc->nolock++;
+			oh = hcb_insert(sp->wrk, &sh->root, noh, 0);
 		}
 
 		if (oh != NULL && oh == noh) {
+			hcb_ep_leave(ep);
 			/* Assert that we only muck with the tree with a lock */
 			assert(with_lock);
-			VSC_C_main->hcb_insert++;
+			sh->vsc->insert++;
 			assert(oh->refcnt > 0);
 			return (oh);
 		}
 
 		if (oh == NULL) {
+			hcb_ep_leave(ep);
 			assert(!with_lock);
 			/* Try again, with lock */
 			with_lock = 1;
@@ -467,6 +672,7 @@ hcb_lookup(const struct sess *sp, struct objhead *noh)
 		else
 			with_lock = 1;
 		Lck_Unlock(&oh->mtx);
+		hcb_ep_leave(ep);
 		if (u > 0)
 			return (oh);
 	}
@@ -486,6 +692,7 @@ hcb_prep(const struct sess *sp)
 const struct hash_slinger hcb_slinger = {
 	.magic  =	SLINGER_MAGIC,
 	.name   =	"critbit",
+	.init   =	hcb_init,
 	.start  =	hcb_start,
 	.lookup =	hcb_lookup,
 	.prep =		hcb_prep,
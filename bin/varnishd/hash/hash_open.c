@@ -0,0 +1,408 @@
+/*-
+ * Copyright (c) 2006 Verdens Gang AS
+ * Copyright (c) 2006-2011 Varnish Software AS
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * An open addressing hash
+ *
+ * The digest is already a good hash, so we take its bits apart: the first
+ * two bytes pick one of a power of two number of shards, each with its
+ * own lock and table, the next four bytes the home bucket in the table,
+ * and one more byte is kept as a tag next to each objhead pointer.
+ *
+ * A bucket is one cache line: seven tags, an overflow count and seven
+ * pointers.  A lookup compares all the tags of a bucket in one go, and
+ * only looks at the objheads whose tag matches, so a hit costs the lock,
+ * one bucket and the objhead.  Entries which find their home bucket full
+ * go to the next one, and the overflow count of every bucket they pass
+ * tells lookups whether to keep looking.
+ *
+ * Tables double when they are 3/4 full and halve when they drop below
+ * 1/8, and the entries are moved over a few buckets per operation, so
+ * lookups keep going while that happens.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
+#include "cache/cache.h"
+
+#include "hash/hash_slinger.h"
+
+#define HOP_NSLOT	7
+#define HOP_MIGRATE	4	/* Buckets moved per operation */
+
+struct hop_bucket {
+	uint8_t			tag[HOP_NSLOT];
+	uint8_t			ovf;	/* Entries which went past, sticky */
+	struct objhead		*oh[HOP_NSLOT];
+};
+
+struct hop_shard {
+	unsigned		magic;
+#define HOP_SHARD_MAGIC		0x4e07c1a5
+	struct lock		mtx;
+	unsigned		nentry;
+
+	struct hop_bucket	*tbl;
+	unsigned		mask;
+
+	/* The table we are moving away from, if any */
+	struct hop_bucket	*otbl;
+	unsigned		omask;
+	unsigned		onext;
+};
+
+static unsigned			hop_nshard = 64;
+static unsigned			hop_nbucket = 16;
+static struct hop_shard		*hop_shard;
+
+#define HOP_TAG(d)		((d)[6] | 0x80)
+
+static unsigned
+hop_home(const unsigned char *digest)
+{
+	uint32_t u;
+
+	memcpy(&u, digest + 2, sizeof u);
+	return (u);
+}
+
+static struct hop_shard *
+hop_shard_of(const unsigned char *digest)
+{
+	struct hop_shard *sh;
+
+	sh = &hop_shard[((digest[0] << 8) | digest[1]) & (hop_nshard - 1)];
+	CHECK_OBJ_NOTNULL(sh, HOP_SHARD_MAGIC);
+	return (sh);
+}
+
+/*--------------------------------------------------------------------
+ * Which slots of a bucket have this tag.  Tag zero finds free slots.
+ */
+
+static unsigned
+hop_match(const struct hop_bucket *bp, uint8_t tag)
+{
+#ifdef __SSE2__
+	__m128i v;
+
+	/* The overflow count comes along, and is masked off */
+	v = _mm_loadl_epi64((const void *)bp->tag);
+	return (_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(tag))) &
+	    ((1U << HOP_NSLOT) - 1));
+#else
+	unsigned u, m;
+
+	for (m = u = 0; u < HOP_NSLOT; u++)
+		if (bp->tag[u] == tag)
+			m |= 1U << u;
+	return (m);
+#endif
+}
+
+static struct hop_bucket *
+hop_alloc(unsigned nbucket)
+{
+	void *p = NULL;
+
+	XXXAZ(posix_memalign(&p, 64, nbucket * sizeof(struct hop_bucket)));
+	memset(p, 0, nbucket * sizeof(struct hop_bucket));
+	return (p);
+}
+
+/*--------------------------------------------------------------------
+ * Find a digest in a table, returns the bucket and slot it is in.
+ */
+
+static int
+hop_find(const struct hop_bucket *tbl, unsigned mask,
+    const unsigned char *digest, unsigned *pb, unsigned *ps)
+{
+	const struct hop_bucket *bp;
+	unsigned b, n, m, s;
+
+	if (tbl == NULL)
+		return (-1);
+	b = hop_home(digest) & mask;
+	for (n = 0; n <= mask; n++) {
+		bp = &tbl[b];
+		for (m = hop_match(bp, HOP_TAG(digest)); m != 0; m &= m - 1) {
+			s = __builtin_ctz(m);
+			CHECK_OBJ_NOTNULL(bp->oh[s], OBJHEAD_MAGIC);
+			if (!memcmp(bp->oh[s]->digest, digest, DIGEST_LEN)) {
+				*pb = b;
+				*ps = s;
+				return (0);
+			}
+		}
+		if (bp->ovf == 0)
+			break;
+		b = (b + 1) & mask;
+	}
+	return (-1);
+}
+
+static void
+hop_place(struct hop_bucket *tbl, unsigned mask, struct objhead *oh)
+{
+	struct hop_bucket *bp;
+	unsigned b, n, m, s;
+
+	b = hop_home(oh->digest) & mask;
+	for (n = 0; n <= mask; n++) {
+		bp = &tbl[b];
+		m = hop_match(bp, 0);
+		if (m != 0) {
+			s = __builtin_ctz(m);
+			bp->tag[s] = HOP_TAG(oh->digest);
+			bp->oh[s] = oh;
+			return;
+		}
+		if (bp->ovf < 255)
+			bp->ovf++;
+		b = (b + 1) & mask;
+	}
+	WRONG("hop table full");
+}
+
+static void
+hop_remove(struct hop_bucket *tbl, unsigned mask, unsigned b, unsigned s)
+{
+	unsigned h;
+
+	h = hop_home(tbl[b].oh[s]->digest) & mask;
+	tbl[b].tag[s] = 0;
+	tbl[b].oh[s] = NULL;
+	for (; h != b; h = (h + 1) & mask) {
+		if (tbl[h].ovf == 255)
+			continue;
+		assert(tbl[h].ovf > 0);
+		tbl[h].ovf--;
+	}
+}
+
+/*--------------------------------------------------------------------
+ * Move up to n buckets from the old table to the new one.
+ *
+ * The moved entries do not give back the overflow counts they hold in
+ * the old table, so lookups there may look a bit further than needed,
+ * but never miss an entry which is still there.
+ */
+
+static void
+hop_migrate(struct hop_shard *sh, unsigned n)
+{
+	struct hop_bucket *bp;
+	unsigned s;
+
+	for (; sh->otbl != NULL && n > 0; n--) {
+		bp = &sh->otbl[sh->onext];
+		for (s = 0; s < HOP_NSLOT; s++) {
+			if (bp->tag[s] == 0)
+				continue;
+			hop_place(sh->tbl, sh->mask, bp->oh[s]);
+			bp->tag[s] = 0;
+			bp->oh[s] = NULL;
+		}
+		if (sh->onext++ == sh->omask) {
+			free(sh->otbl);
+			sh->otbl = NULL;
+		}
+	}
+}
+
+static void
+hop_resize(struct hop_shard *sh, unsigned nbucket)
+{
+
+	hop_migrate(sh, ~0U);
+	AZ(sh->otbl);
+	sh->otbl = sh->tbl;
+	sh->omask = sh->mask;
+	sh->onext = 0;
+	sh->tbl = hop_alloc(nbucket);
+	sh->mask = nbucket - 1;
+	VSC_C_main->hop_resize++;
+}
+
+/*--------------------------------------------------------------------
+ * The ->init method allows the management process to pass arguments
+ */
+
+static void
+hop_init(int ac, char * const *av)
+{
+	unsigned u;
+
+	if (ac > 2)
+		ARGV_ERR("(-hopen) too many arguments\n");
+	if (ac > 0) {
+		if (sscanf(av[0], "%u", &u) != 1 || u == 0 || u > 65536 ||
+		    (u & (u - 1)))
+			ARGV_ERR("(-hopen) shards must be a power of two"
+			    " no larger than 65536\n");
+		hop_nshard = u;
+	}
+	if (ac > 1) {
+		if (sscanf(av[1], "%u", &u) != 1 || u == 0 || (u & (u - 1)))
+			ARGV_ERR("(-hopen) buckets must be a power of two\n");
+		hop_nbucket = u;
+	}
+}
+
+/*--------------------------------------------------------------------
+ * The ->start method is called during cache process start and allows
+ * initialization to happen before the first lookup.
+ */
+
+static void
+hop_start(void)
+{
+	unsigned u;
+
+	hop_shard = calloc(sizeof *hop_shard, hop_nshard);
+	XXXAN(hop_shard);
+
+	for (u = 0; u < hop_nshard; u++) {
+		Lck_New(&hop_shard[u].mtx, lck_hop);
+		hop_shard[u].tbl = hop_alloc(hop_nbucket);
+		hop_shard[u].mask = hop_nbucket - 1;
+		hop_shard[u].magic = HOP_SHARD_MAGIC;
+	}
+}
+
+/*--------------------------------------------------------------------
+ * The ->prep method runs right before the lookup, so get the home
+ * bucket on its way into the cache.  This is done without the lock,
+ * the worst a concurrent resize can do is make it a wasted prefetch.
+ */
+
+static void
+hop_prep(const struct sess *sp)
+{
+	const struct hop_shard *sh;
+
+	CHECK_OBJ_NOTNULL(sp, SESS_MAGIC);
+	if (sp->req == NULL)
+		return;
+	sh = hop_shard_of(sp->req->digest);
+	__builtin_prefetch(sh->tbl + (hop_home(sp->req->digest) & sh->mask));
+}
+
+/*--------------------------------------------------------------------
+ * Lookup and possibly insert element.
+ * If the lookup does not find the key, noh is inserted.
+ * A reference to the returned object is held.
+ */
+
+static struct objhead *
+hop_lookup(const struct sess *sp, struct objhead *noh)
+{
+	struct hop_shard *sh;
+	struct objhead *oh;
+	unsigned b, s;
+
+	CHECK_OBJ_NOTNULL(sp, SESS_MAGIC);
+	CHECK_OBJ_NOTNULL(noh, OBJHEAD_MAGIC);
+
+	sh = hop_shard_of(noh->digest);
+	Lck_Lock(&sh->mtx);
+	hop_migrate(sh, HOP_MIGRATE);
+	if (!hop_find(sh->tbl, sh->mask, noh->digest, &b, &s))
+		oh = sh->tbl[b].oh[s];
+	else if (!hop_find(sh->otbl, sh->omask, noh->digest, &b, &s))
+		oh = sh->otbl[b].oh[s];
+	else
+		oh = NULL;
+	if (oh != NULL) {
+		assert(oh->refcnt > 0);
+		oh->refcnt++;
+		Lck_Unlock(&sh->mtx);
+		return (oh);
+	}
+
+	if (sh->nentry >= (sh->mask + 1) * (HOP_NSLOT * 3 / 4.))
+		hop_resize(sh, (sh->mask + 1) * 2);
+	hop_place(sh->tbl, sh->mask, noh);
+	sh->nentry++;
+	noh->hoh_head = sh;
+	Lck_Unlock(&sh->mtx);
+	return (noh);
+}
+
+/*--------------------------------------------------------------------
+ * Dereference and if no references are left, free.
+ */
+
+static int
+hop_deref(struct objhead *oh)
+{
+	struct hop_shard *sh;
+	unsigned b, s;
+
+	CHECK_OBJ_NOTNULL(oh, OBJHEAD_MAGIC);
+	CAST_OBJ_NOTNULL(sh, oh->hoh_head, HOP_SHARD_MAGIC);
+	Lck_Lock(&sh->mtx);
+	assert(oh->refcnt > 0);
+	if (--oh->refcnt > 0) {
+		Lck_Unlock(&sh->mtx);
+		return (1);
+	}
+	hop_migrate(sh, HOP_MIGRATE);
+	if (!hop_find(sh->tbl, sh->mask, oh->digest, &b, &s)) {
+		assert(sh->tbl[b].oh[s] == oh);
+		hop_remove(sh->tbl, sh->mask, b, s);
+	} else {
+		AZ(hop_find(sh->otbl, sh->omask, oh->digest, &b, &s));
+		assert(sh->otbl[b].oh[s] == oh);
+		hop_remove(sh->otbl, sh->omask, b, s);
+	}
+	sh->nentry--;
+	if (sh->otbl == NULL && sh->mask + 1 > hop_nbucket &&
+	    sh->nentry < (sh->mask + 1) * (HOP_NSLOT / 8.))
+		hop_resize(sh, (sh->mask + 1) / 2);
+	Lck_Unlock(&sh->mtx);
+	return (0);
+}
+
+/*--------------------------------------------------------------------*/
+
+const struct hash_slinger hop_slinger = {
+	.magic	=	SLINGER_MAGIC,
+	.name	=	"open",
+	.init	=	hop_init,
+	.start	=	hop_start,
+	.prep	=	hop_prep,
+	.lookup =	hop_lookup,
+	.deref	=	hop_deref,
+};
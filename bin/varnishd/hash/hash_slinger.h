@@ -31,6 +31,7 @@
 struct sess;
 struct worker;
 struct object;
+struct hsh_vary;
 
 typedef void hash_init_f(int ac, char * const *av);
 typedef void hash_start_f(void);
@@ -58,7 +59,9 @@ void HSH_Unbusy(struct worker *wrk);
 void HSH_Ref(struct objcore *o);
 void HSH_Drop(struct worker *wrk);
 void HSH_Init(const struct hash_slinger *slinger);
+void HSH_DigestInit(struct worker *wrk);
 void HSH_AddString(const struct sess *sp, const char *str);
+void HSH_DigestFinal(struct worker *wrk, unsigned char *digest);
 struct objcore *HSH_Insert(const struct sess *sp);
 void HSH_Purge(const struct sess *, struct objhead *, double ttl, double grace);
 void HSH_config(const char *h_arg);
@@ -77,10 +80,14 @@ struct objhead {
 
 	int			refcnt;
 	struct lock		mtx;
-	VTAILQ_HEAD(,objcore)	objcs;
+	VTAILQ_HEAD(objcorehead, objcore) objcs;
 	unsigned char		digest[DIGEST_LEN];
 	struct waitinglist	*waitinglist;
 
+	/* Variants by vary fingerprint, see cache_hash.c */
+	struct hsh_vary		*vary_idx;
+	unsigned		vary_odd;
+
 	/*----------------------------------------------------
 	 * The fields below are for the sole private use of
 	 * the hash implementation(s).
@@ -102,3 +109,4 @@ int HSH_Deref(struct worker *w, struct objcore *oc, struct object **o);
 extern const struct hash_slinger hsl_slinger;
 extern const struct hash_slinger hcl_slinger;
 extern const struct hash_slinger hcb_slinger;
+extern const struct hash_slinger hop_slinger;
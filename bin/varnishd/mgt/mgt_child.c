@@ -220,31 +220,83 @@ MGT_Child_Cli_Fail(void)
 		(void)kill(child_pid, SIGQUIT);
 }
 
+/*--------------------------------------------------------------------
+ * Socket options for listen sockets, which the accepted connections
+ * inherit.
+ */
+
+static void
+listen_opts(int sock)
+{
+
+	/*
+	 * Set nonblocking mode to avoid a race where a client
+	 * closes before we call accept(2) and nobody else are in
+	 * the listen queue to release us.
+	 */
+	if (mgt_param.listen_defer_accept)
+		(void)VTCP_filter_http(sock);
+	if (mgt_param.listen_fastopen > 0)
+		(void)VTCP_fastopen(sock, mgt_param.listen_fastopen);
+}
+
+/*--------------------------------------------------------------------
+ * Open a SO_REUSEPORT clone of a listen socket for each of the other
+ * thread pools.  If we cannot get them all, the pools share what we got.
+ */
+
+static void
+open_shards(struct listen_sock *ls)
+{
+	struct listen_sock *ls2;
+	unsigned u;
+
+	AZ(ls->nshard);
+	AZ(ls->shard);
+	ls->shard = calloc(mgt_param.wthread_pools - 1, sizeof *ls->shard);
+	XXXAN(ls->shard);
+	for (u = 1; u < mgt_param.wthread_pools; u++) {
+		ALLOC_OBJ(ls2, LISTEN_SOCK_MAGIC);
+		XXXAN(ls2);
+		ls2->name = ls->name;
+		ls2->addr = ls->addr;
+		ls2->sock = VSS_bind_reuseport(ls->addr, ls->sock);
+		if (ls2->sock < 0) {
+			FREE_OBJ(ls2);
+			break;
+		}
+		mgt_child_inherit(ls2->sock, "sock");
+		listen_opts(ls2->sock);
+		ls->shard[ls->nshard++] = ls2;
+	}
+}
+
 /*--------------------------------------------------------------------*/
 
 static int
 open_sockets(void)
 {
 	struct listen_sock *ls, *ls2;
-	int good = 0;
+	int good = 0, reuseport;
 
+	reuseport = mgt_param.listen_reuseport && mgt_param.wthread_pools > 1;
 	VTAILQ_FOREACH_SAFE(ls, &heritage.socks, list, ls2) {
 		if (ls->sock >= 0) {
 			good++;
 			continue;
 		}
-		ls->sock = VSS_bind(ls->addr);
+		ls->sock = -1;
+		if (reuseport)
+			ls->sock = VSS_bind_reuseport(ls->addr, -1);
+		if (ls->sock < 0)
+			ls->sock = VSS_bind(ls->addr);
+		else
+			open_shards(ls);
 		if (ls->sock < 0)
 			continue;
 
 		mgt_child_inherit(ls->sock, "sock");
-
-		/*
-		 * Set nonblocking mode to avoid a race where a client
-		 * closes before we call accept(2) and nobody else are in
-		 * the listen queue to release us.
-		 */
-		(void)VTCP_filter_http(ls->sock);
+		listen_opts(ls->sock);
 		good++;
 	}
 	if (!good)
@@ -257,9 +309,20 @@ open_sockets(void)
 static void
 close_sockets(void)
 {
-	struct listen_sock *ls;
+	struct listen_sock *ls, *ls2;
+	unsigned u;
 
 	VTAILQ_FOREACH(ls, &heritage.socks, list) {
+		for (u = 0; u < ls->nshard; u++) {
+			ls2 = ls->shard[u];
+			CHECK_OBJ_NOTNULL(ls2, LISTEN_SOCK_MAGIC);
+			mgt_child_inherit(ls2->sock, NULL);
+			closex(&ls2->sock);
+			FREE_OBJ(ls2);
+		}
+		free(ls->shard);
+		ls->shard = NULL;
+		ls->nshard = 0;
 		if (ls->sock < 0)
 			continue;
 		mgt_child_inherit(ls->sock, NULL);
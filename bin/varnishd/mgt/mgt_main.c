@@ -52,6 +52,7 @@
 #include "vcli.h"
 #include "vcli_common.h"
 #include "vev.h"
+#include "vfh256.h"
 #include "vfil.h"
 #include "vin.h"
 #include "vpf.h"
@@ -130,9 +131,12 @@ usage(void)
 	fprintf(stderr, FMT, "-F", "Run in foreground");
 	fprintf(stderr, FMT, "-h kind[,hashoptions]", "Hash specification");
 	fprintf(stderr, FMT, "", "  -h critbit [default]");
+	fprintf(stderr, FMT, "", "  -h critbit,<shards>");
 	fprintf(stderr, FMT, "", "  -h simple_list");
 	fprintf(stderr, FMT, "", "  -h classic");
 	fprintf(stderr, FMT, "", "  -h classic,<buckets>");
+	fprintf(stderr, FMT, "", "  -h open");
+	fprintf(stderr, FMT, "", "  -h open,<shards>,<buckets>");
 	fprintf(stderr, FMT, "-i identity", "Identity of varnish instance");
 	fprintf(stderr, FMT, "-l shl,free,fill", "Size of shared memory file");
 	fprintf(stderr, FMT, "", "  shl: space for SHL records [80m]");
@@ -385,9 +389,10 @@ main(int argc, char * const *argv)
 	assert(VTIM_parse("Sun Nov  6 08:49:37 1994") == 784111777);
 
 	/*
-	 * Check that our SHA256 works
+	 * Check that our SHA256 and VFH256 work
 	 */
 	SHA256_Test();
+	VFH256_Test();
 
 	memset(cli, 0, sizeof cli);
 	cli[0].magic = CLI_MAGIC;
@@ -219,7 +219,7 @@ tweak_generic_bool(struct cli *cli, volatile unsigned *dest, const char *arg)
 
 /*--------------------------------------------------------------------*/
 
-static void
+void
 tweak_bool(struct cli *cli, const struct parspec *par, const char *arg)
 {
 	volatile unsigned *dest;
@@ -287,7 +287,7 @@ fmt_bytes(struct cli *cli, ssize_t t)
 {
 	const char *p;
 
-	if (t & 0xff) {
+	if (t == 0 || (t & 0xff)) {
 		VCLI_Out(cli, "%zub", t);
 		return;
 	}
@@ -695,6 +695,13 @@ static const struct parspec input_parspec[] = {
 		"Minimum is 1024 bytes.",
 		DELAYED_EFFECT,
 		"64k", "bytes" },
+	{ "sess_hugepages", tweak_bool, &mgt_param.sess_hugepages, 0, 0,
+		"Back the slabs session structures are carved from with "
+		"transparent huge pages, where the kernel supports it.\n"
+		"Fewer TLB misses, at the price of memory being committed "
+		"in 2MB steps.",
+		EXPERIMENTAL | DELAYED_EFFECT,
+		"off", "bool" },
 	{ "http_req_hdr_len",
 		tweak_bytes_u, &mgt_param.http_req_hdr_len,
 		40, UINT_MAX,
@@ -713,6 +720,15 @@ static const struct parspec input_parspec[] = {
 		"how much of that the request is allowed to take up.",
 		0,
 		"32k", "bytes" },
+	{ "req_body_cache",
+		tweak_bytes_u, &mgt_param.req_body_cache,
+		0, UINT_MAX,
+		"Keep request bodies up to this size in Transient storage "
+		"while the request is being handled, so that a retried or "
+		"restarted backend request can send the body again.\n"
+		"Zero disables this, and the body can only be sent once.",
+		EXPERIMENTAL,
+		"0", "bytes" },
 	{ "http_resp_hdr_len",
 		tweak_bytes_u, &mgt_param.http_resp_hdr_len,
 		40, UINT_MAX,
@@ -797,6 +813,12 @@ static const struct parspec input_parspec[] = {
 		"this many seconds, the session is closed.\n",
 		0,
 		"60", "seconds" },
+	{ "pipe_thread", tweak_bool, &mgt_param.pipe_thread, 0, 0,
+		"Hand piped connections to a single thread, which moves "
+		"the bytes for all of them, instead of keeping a worker "
+		"thread busy for each until it closes.\n",
+		EXPERIMENTAL,
+		"off", "bool" },
 	{ "send_timeout", tweak_timeout, &mgt_param.send_timeout, 0, 0,
 		"Send timeout for client connections. "
 		"If the HTTP response hasn't been transmitted in this many\n"
@@ -812,6 +834,15 @@ static const struct parspec input_parspec[] = {
 		"See setsockopt(2) under SO_SNDTIMEO for more information.",
 		DELAYED_EFFECT,
 		"60", "seconds" },
+	{ "send_async_threshold",
+		tweak_bytes_u, &mgt_param.send_async_threshold, 0, UINT_MAX,
+		"Bodies of cached objects at least this large are sent by "
+		"the sender thread, which writes to all such clients as "
+		"their sockets drain, rather than by the worker thread "
+		"which handled the request.\n"
+		"Zero disables this.",
+		EXPERIMENTAL,
+		"0", "bytes" },
 	{ "auto_restart", tweak_bool, &mgt_param.auto_restart, 0, 0,
 		"Restart child process automatically if it dies.\n",
 		0,
@@ -822,6 +853,15 @@ static const struct parspec input_parspec[] = {
 		"to make space for a object body.",
 		EXPERIMENTAL,
 		"50", "allocations" },
+	{ "fetch_park", tweak_bool, &mgt_param.fetch_park, 0, 0,
+		"Let the worker thread go while waiting for the first byte "
+		"of a backend response.  A single thread watches the "
+		"backend connections, and the request continues on a "
+		"worker once the response starts arriving, so slow "
+		"backends do not tie up worker threads.\n"
+		"ESI includes always wait on their worker.",
+		EXPERIMENTAL,
+		"off", "bool" },
 	{ "fetch_chunksize",
 		tweak_bytes_u,
 		    &mgt_param.fetch_chunksize, 4 * 1024, UINT_MAX,
@@ -865,6 +905,35 @@ static const struct parspec input_parspec[] = {
 		"Listen queue depth.",
 		MUST_RESTART,
 		"1024", "connections" },
+	{ "listen_reuseport", tweak_bool, &mgt_param.listen_reuseport, 0, 0,
+		"Give each thread pool its own listen socket.\n"
+		"Every listen address is opened thread_pools times with "
+		"SO_REUSEPORT, and the kernel spreads new connections "
+		"between the sockets, instead of all pools competing to "
+		"accept(2) on one.\n"
+		"Connections queued on the socket of a pool are only "
+		"accepted by that pool, and pools added after the child "
+		"started share the sockets round-robin.\n"
+		"Ignored where SO_REUSEPORT is not available.",
+		EXPERIMENTAL | MUST_RESTART,
+		"off", "bool" },
+	{ "listen_defer_accept", tweak_bool,
+		&mgt_param.listen_defer_accept, 0, 0,
+		"Only hand connections to a worker thread once there is "
+		"request data on them.\n"
+		"Uses TCP_DEFER_ACCEPT on Linux and the httpready accept "
+		"filter on FreeBSD.",
+		MUST_RESTART,
+		"on", "bool" },
+	{ "listen_fastopen", tweak_uint, &mgt_param.listen_fastopen,
+		0, UINT_MAX,
+		"Enable TCP Fast Open on the listen sockets, with this many "
+		"pending handshakes, so returning clients can send their "
+		"request with the SYN.\n"
+		"Zero disables.  Ignored where TCP_FASTOPEN is not "
+		"available.",
+		EXPERIMENTAL | MUST_RESTART,
+		"0", "connections" },
 	{ "cli_buffer",
 		tweak_bytes_u, &mgt_param.cli_buffer, 4096, UINT_MAX,
 		"Size of buffer for CLI command input."
@@ -981,6 +1050,17 @@ static const struct parspec input_parspec[] = {
 		"for each succesfull accept. (ie: 0.9 = reduce by 10%)",
 		EXPERIMENTAL,
 		"0.900", "" },
+	{ "accept_batch", tweak_uint, &mgt_param.accept_batch, 1, 1024,
+		"How many connections a worker thread accepts when it wakes "
+		"up on a listen socket.\n"
+		"The first connection is handled by the thread itself, the "
+		"rest are scheduled on the pool like sessions coming back "
+		"from the waiter.  Above one, the listen sockets are put in "
+		"non-blocking mode so draining them never blocks, and "
+		"pools sharing a socket all wake up for a connection, so "
+		"this is best combined with listen_reuseport.",
+		EXPERIMENTAL | MUST_RESTART,
+		"1", "connections" },
 	{ "clock_skew", tweak_uint, &mgt_param.clock_skew, 0, UINT_MAX,
 		"How much clockskew we are willing to accept between the "
 		"backend and our own clock.",
@@ -1016,6 +1096,18 @@ static const struct parspec input_parspec[] = {
 		"Log the hash string components to shared memory log.\n",
 		0,
 		"on", "bool" },
+	{ "hash_fast_digest", tweak_bool, &mgt_param.hash_fast_digest, 0, 0,
+		"Digest the hash string with a fast, non-cryptographic "
+		"hash instead of SHA256.\n"
+		"This is several times faster, but whoever controls what "
+		"goes into vcl_hash can construct two requests with the "
+		"same digest, and have one of them served the object of "
+		"the other.  Only enable it if all the hash inputs are "
+		"trusted.\n"
+		"Objects in persistent storage are only found again with "
+		"the setting they were stored with.",
+		MUST_RESTART,
+		"off", "bool" },
 	{ "log_local_address", tweak_bool, &mgt_param.log_local_addr, 0, 0,
 		"Log the local address on the TCP connection in the "
 		"SessionOpen shared memory record.\n",
@@ -1025,6 +1117,16 @@ static const struct parspec input_parspec[] = {
 		"Select the waiter kernel interface.\n",
 		EXPERIMENTAL | MUST_RESTART,
 		"default", NULL },
+	{ "waiter_shards", tweak_uint, &mgt_param.waiter_shards, 1, 64,
+		"How many threads the waiter uses for idle sessions.\n"
+		"Each shard has its own kernel event queue.  The sessions "
+		"of a pool go to the shards whose number modulo thread_pools "
+		"is that of the pool, spread over those by file descriptor.  "
+		"With waiter_shards a multiple of thread_pools, no shard "
+		"serves more than one pool.\n"
+		"Only the epoll waiter has shards.",
+		EXPERIMENTAL | MUST_RESTART,
+		"1", "threads" },
 	{ "diag_bitmap", tweak_diag_bitmap, 0, 0, 0,
 		"Bitmap controlling diagnostics code:\n"
 		"  0x00000001 - CNT_Session states.\n"
@@ -1073,6 +1175,14 @@ static const struct parspec input_parspec[] = {
 		"Enable support for HTTP Range headers.\n",
 		EXPERIMENTAL,
 		"on", "bool" },
+	{ "obj_hdrblk", tweak_bool, &mgt_param.obj_hdrblk, 0, 0,
+		"Serialize the headers of cached objects when they are "
+		"inserted, so hits can send them to the client as a single "
+		"block.\n"
+		"The block is kept with the object and takes about as much "
+		"storage again as its headers.",
+		EXPERIMENTAL,
+		"off", "bool" },
 	{ "http_gzip_support", tweak_bool, &mgt_param.http_gzip_support, 0, 0,
 		"Enable gzip support. When enabled Varnish will compress "
 		"uncompressed objects before they are stored in the cache. "
@@ -1130,11 +1240,11 @@ static const struct parspec input_parspec[] = {
 		0,
 		"10.0", "s" },
 	{ "critbit_cooloff", tweak_timeout_double,
-		&mgt_param.critbit_cooloff, 60, 254,
-		"How long time the critbit hasher keeps deleted objheads "
-		"on the cooloff list.\n",
+		&mgt_param.critbit_cooloff, 0.01, 60,
+		"How often the critbit hasher tries to move on to the next "
+		"epoch, and free the objheads deleted two epochs ago.\n",
 		WIZARD,
-		"180.0", "s" },
+		"1.0", "s" },
 	{ "vcl_dir", tweak_string, &mgt_vcl_dir, 0, 0,
 		"Directory from which relative VCL filenames (vcl.load and "
 		"include) are opened.",
@@ -1222,6 +1332,16 @@ static const struct parspec input_parspec[] = {
 		0,
 		"10,100,10", ""},
 
+	{ "pool_sess", tweak_poolparam, &mgt_param.sess_pool, 0, 10000,
+		"Parameters for per worker pool memory pool for the sessions "
+		"idling in the waiter.\n"
+		"The three numbers are:\n"
+		"   min_pool -- minimum size of free pool.\n"
+		"   max_pool -- maximum size of free pool.\n"
+		"   max_age -- max age of free element.\n",
+		0,
+		"10,100,10", ""},
+
 	{ NULL, NULL, NULL }
 };
 
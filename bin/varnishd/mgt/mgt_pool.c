@@ -51,6 +51,8 @@
 #include "common/params.h"
 
 #include "mgt/mgt_param.h"
+#include "vcli.h"
+#include "vcli_priv.h"
 
 /*--------------------------------------------------------------------*/
 
@@ -102,6 +104,67 @@ tweak_thread_pool_max(struct cli *cli, const struct parspec *par,
 	    mgt_param.wthread_min, UINT_MAX);
 }
 
+/*--------------------------------------------------------------------
+ * Parameters which take one of a list of keywords
+ */
+
+static void
+tweak_keyword(struct cli *cli, unsigned *dst, const char * const *names,
+    unsigned nnames, const char *what, const char *arg)
+{
+	unsigned u;
+
+	if (arg == NULL) {
+		VCLI_Out(cli, "%s", names[*dst]);
+		return;
+	}
+	for (u = 0; u < nnames; u++) {
+		if (!strcmp(arg, names[u])) {
+			*dst = u;
+			return;
+		}
+	}
+	VCLI_Out(cli, "Unknown %s, use one of:", what);
+	for (u = 0; u < nnames; u++)
+		VCLI_Out(cli, "%s %s", u ? "," : "", names[u]);
+	VCLI_SetResult(cli, CLIS_PARAM);
+}
+
+/*--------------------------------------------------------------------*/
+
+static const char * const affinity_names[] = {
+	[WTHREAD_AFFINITY_OFF] =	"off",
+	[WTHREAD_AFFINITY_CPU] =	"cpu",
+	[WTHREAD_AFFINITY_NUMA] =	"numa",
+};
+
+static void
+tweak_thread_pool_affinity(struct cli *cli, const struct parspec *par,
+    const char *arg)
+{
+
+	(void)par;
+	tweak_keyword(cli, &mgt_param.wthread_affinity, affinity_names,
+	    sizeof affinity_names / sizeof *affinity_names, "affinity", arg);
+}
+
+/*--------------------------------------------------------------------*/
+
+static const char * const herder_names[] = {
+	[WTHREAD_HERDER_QUEUE] =	"queue",
+	[WTHREAD_HERDER_LATENCY] =	"latency",
+};
+
+static void
+tweak_thread_pool_herder(struct cli *cli, const struct parspec *par,
+    const char *arg)
+{
+
+	(void)par;
+	tweak_keyword(cli, &mgt_param.wthread_herder, herder_names,
+	    sizeof herder_names / sizeof *herder_names, "herder", arg);
+}
+
 /*--------------------------------------------------------------------*/
 
 const struct parspec WRK_parspec[] = {
@@ -235,5 +298,68 @@ const struct parspec WRK_parspec[] = {
 		DELAYED_EFFECT,
 		"65536",
 		"bytes" },
+	{ "thread_pool_affinity", tweak_thread_pool_affinity, NULL, 0, 0,
+		"Bind thread pools to CPUs.\n"
+		"\n"
+		"off: Threads run wherever the kernel schedules them.\n"
+		"\n"
+		"cpu: The online CPUs are divided evenly between the "
+		"pools, and each pool is bound to its share.\n"
+		"\n"
+		"numa: Each pool is bound to the CPUs of one NUMA node, "
+		"pools are distributed round-robin over the nodes.  "
+		"Falls back to 'cpu' if no NUMA topology can be found.\n"
+		"\n"
+		"The herder and worker threads of a bound pool, and the "
+		"session memory and worker stacks they allocate, stay local "
+		"to the pool's CPUs, and so do the connections the pool "
+		"accepts.\n"
+		"Only implemented on systems with sched_setaffinity(2).",
+		EXPERIMENTAL | MUST_RESTART,
+		"off", NULL },
+	{ "thread_pool_lockfree", tweak_bool, &mgt_param.wthread_lockfree,
+		0, 0,
+		"Use a lock-free queue to hand sessions to the worker "
+		"threads, and park idle threads on a futex, instead of "
+		"the pool mutex and per-thread condition variables.\n"
+		"Idle threads in lock-free pools retire on their own after "
+		"thread_pool_timeout.\n"
+		"Compare the contended counters of the pools to see which "
+		"mode suits your load.\n"
+		"Ignored if the compiler lacks atomic builtins.",
+		EXPERIMENTAL | MUST_RESTART,
+		"off", "bool" },
+	{ "thread_pool_steal", tweak_bool, &mgt_param.wthread_steal, 0, 0,
+		"Let idle threads take sessions from other pools.\n"
+		"A thread about to go idle first looks for sessions "
+		"queued in other pools, and a pool with no idle threads "
+		"offers new sessions to idle threads in other pools "
+		"before it queues them.",
+		EXPERIMENTAL,
+		"off", "bool" },
+	{ "thread_pool_herder", tweak_thread_pool_herder, NULL, 0, 0,
+		"How the herder decides to add and remove threads.\n"
+		"\n"
+		"queue: Add a thread when more than "
+		"thread_pool_add_threshold sessions are queued and the "
+		"queue keeps growing, remove threads which have been idle "
+		"for thread_pool_timeout.\n"
+		"\n"
+		"latency: Add threads when sessions wait longer than "
+		"thread_pool_latency_target for a thread, remove idle "
+		"threads when they wait much less than that.\n"
+		"\n"
+		"thread_pool_min and thread_pool_max apply in both modes.",
+		EXPERIMENTAL,
+		"queue", NULL },
+	{ "thread_pool_latency_target", tweak_uint,
+		&mgt_param.wthread_lat_target, 1, UINT_MAX,
+		"How long sessions may wait for a thread before the herder "
+		"adds threads, when thread_pool_herder is 'latency'.\n"
+		"The herder compares this to an estimate of the 95th "
+		"percentile of the wait, and to how long the oldest queued "
+		"session has been waiting.",
+		EXPERIMENTAL,
+		"1000", "microseconds" },
 	{ NULL, NULL, NULL }
 };
@@ -245,7 +245,7 @@ STV_MkObject(struct worker *wrk, void *ptr, unsigned ltot,
 	l = PRNDDN(ltot - (sizeof *o + soc->lhttp));
 	assert(l >= soc->wsl);
 
-	o->http = HTTP_create(o + 1, soc->nhttp);
+	o->http = HTTP_create_noindex(o + 1, soc->nhttp);
 	WS_Init(o->ws_o, "obj", (char *)(o + 1) + soc->lhttp, soc->wsl);
 	WS_Assert(o->ws_o);
 	assert(o->ws_o->e <= (char*)ptr + ltot);
@@ -316,7 +316,7 @@ STV_NewObject(struct worker *wrk, const char *hint, unsigned wsl,
 	assert(wsl > 0);
 	wsl = PRNDUP(wsl);
 
-	lhttp = HTTP_estimate(nhttp);
+	lhttp = HTTP_estimate_noindex(nhttp);
 	lhttp = PRNDUP(lhttp);
 
 	memset(&soc, 0, sizeof soc);
@@ -380,6 +380,24 @@ STV_alloc(struct worker *w, size_t size)
 	return (stv_alloc(w, w->busyobj->fetch_obj, size));
 }
 
+/*
+ * Storage which does not belong to any object, for instance a request
+ * body we hold on to.
+ */
+
+struct storage *
+STV_AllocTransient(size_t size)
+{
+	struct storage *st;
+
+	CHECK_OBJ_NOTNULL(stv_transient, STEVEDORE_MAGIC);
+	AN(stv_transient->alloc);
+	st = stv_transient->alloc(stv_transient, size);
+	if (st != NULL)
+		CHECK_OBJ_NOTNULL(st, STORAGE_MAGIC);
+	return (st);
+}
+
 void
 STV_trim(struct storage *st, size_t size)
 {
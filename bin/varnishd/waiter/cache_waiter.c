@@ -59,6 +59,7 @@ WAIT_Init(void)
 	AN(waiter->name);
 	AN(waiter->init);
 	AN(waiter->pass);
+	WAIT_WheelInit();
 	waiter_priv = waiter->init();
 }
 
@@ -70,6 +71,8 @@ WAIT_Enter(struct sess *sp)
 	CHECK_OBJ_NOTNULL(sp->wrk, WORKER_MAGIC);
 	AZ(sp->req);
 	assert(sp->fd >= 0);
+	/* Only the bare session waits, see SES_Detach() */
+	sp = SES_Detach(sp);
 	sp->wrk = NULL;
 
 	/*
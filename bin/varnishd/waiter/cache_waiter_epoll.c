@@ -29,6 +29,10 @@
  * XXX: We need to pass sessions back into the event engine when they are
  * reused.  Not sure what the most efficient way is for that.  For now
  * write the session pointer to a pipe which the event engine monitors.
+ *
+ * With param waiter_shards > 1 we run that many independent event engines,
+ * each with its own epoll fd, pipes and threads, and a session goes to
+ * the shard of the pool it belongs to.
  */
 
 #include "config.h"
@@ -38,6 +42,7 @@
 #include <sys/epoll.h>
 
 #include <fcntl.h>
+#include <stdio.h>
 #include <stdlib.h>
 
 #include "cache/cache.h"
@@ -59,9 +64,19 @@ struct vwe {
 	pthread_t		timer_thread;
 	int			epfd;
 
-	VTAILQ_HEAD(,sess)	sesshead;
+	struct waitwheel	*wheel;
 	int			pipes[2];
 	int			timer_pipes[2];
+
+	struct VSC_C_waiter	*vsc;
+	char			name[24];
+};
+
+struct vwes {
+	unsigned		magic;
+#define VWES_MAGIC		0x1c9d5e2a
+	unsigned		nshard;
+	struct vwe		*shard;
 };
 
 static void
@@ -94,13 +109,21 @@ vwe_cond_modadd(struct vwe *vwe, int fd, void *data)
 
 	assert(fd >= 0);
 	CHECK_OBJ_NOTNULL(sp, SESS_MAGIC);
-	if (sp->ev.data.ptr)
-		AZ(epoll_ctl(vwe->epfd, EPOLL_CTL_MOD, fd, &sp->ev));
-	else {
+	if (sp->ev.data.ptr) {
+		/* The session may have moved since, see SES_Detach() */
 		sp->ev.data.ptr = data;
-		sp->ev.events = EPOLLIN | EPOLLPRI | EPOLLONESHOT | EPOLLRDHUP;
-		AZ(epoll_ctl(vwe->epfd, EPOLL_CTL_ADD, fd, &sp->ev));
+		if (!epoll_ctl(vwe->epfd, EPOLL_CTL_MOD, fd, &sp->ev))
+			return;
+		/*
+		 * If not, it waited on another shard last time, because
+		 * thread_pools changed, see vwe_pass().  The disarmed
+		 * registration there goes away when the fd is closed.
+		 */
+		assert(errno == ENOENT);
 	}
+	sp->ev.data.ptr = data;
+	sp->ev.events = EPOLLIN | EPOLLPRI | EPOLLONESHOT | EPOLLRDHUP;
+	AZ(epoll_ctl(vwe->epfd, EPOLL_CTL_ADD, fd, &sp->ev));
 }
 
 static void
@@ -119,7 +142,8 @@ vwe_eev(struct vwe *vwe, const struct epoll_event *ep, double now)
 			while (i >= sizeof ss[0]) {
 				CHECK_OBJ_NOTNULL(ss[j], SESS_MAGIC);
 				assert(ss[j]->fd >= 0);
-				VTAILQ_INSERT_TAIL(&vwe->sesshead, ss[j], list);
+				WAIT_WheelInsert(vwe->wheel, ss[j]);
+				vwe->vsc->sess_wait++;
 				vwe_cond_modadd(vwe, ss[j]->fd, ss[j]);
 				j++;
 				i -= sizeof ss[0];
@@ -129,16 +153,24 @@ vwe_eev(struct vwe *vwe, const struct epoll_event *ep, double now)
 	} else {
 		CAST_OBJ_NOTNULL(sp, ep->data.ptr, SESS_MAGIC);
 		if (ep->events & EPOLLIN || ep->events & EPOLLPRI) {
-			VTAILQ_REMOVE(&vwe->sesshead, sp, list);
+			WAIT_WheelRemove(vwe->wheel, sp);
+			vwe->vsc->sess_wait--;
+			vwe->vsc->sess_handled++;
 			SES_Handle(sp, now);
 		} else if (ep->events & EPOLLERR) {
-			VTAILQ_REMOVE(&vwe->sesshead, sp, list);
+			WAIT_WheelRemove(vwe->wheel, sp);
+			vwe->vsc->sess_wait--;
+			vwe->vsc->sess_closed++;
 			SES_Delete(sp, "ERR", now);
 		} else if (ep->events & EPOLLHUP) {
-			VTAILQ_REMOVE(&vwe->sesshead, sp, list);
+			WAIT_WheelRemove(vwe->wheel, sp);
+			vwe->vsc->sess_wait--;
+			vwe->vsc->sess_closed++;
 			SES_Delete(sp, "HUP", now);
 		} else if (ep->events & EPOLLRDHUP) {
-			VTAILQ_REMOVE(&vwe->sesshead, sp, list);
+			WAIT_WheelRemove(vwe->wheel, sp);
+			vwe->vsc->sess_wait--;
+			vwe->vsc->sess_closed++;
 			SES_Delete(sp, "RHUP", now);
 		}
 	}
@@ -150,18 +182,17 @@ static void *
 vwe_thread(void *priv)
 {
 	struct epoll_event ev[NEEV], *ep;
+	struct waitwheel_head expired;
 	struct sess *sp;
 	char junk;
-	double now, deadline;
+	double now;
 	int dotimer, i, n;
+	unsigned u;
 	struct vwe *vwe;
 
 	CAST_OBJ_NOTNULL(vwe, priv, VWE_MAGIC);
 
-	THR_SetName("cache-epoll");
-
-	vwe->epfd = epoll_create(1);
-	assert(vwe->epfd >= 0);
+	THR_SetName(vwe->name);
 
 	vwe_modadd(vwe, vwe->pipes[0], vwe->pipes, EPOLL_CTL_ADD);
 	vwe_modadd(vwe, vwe->timer_pipes[0], vwe->timer_pipes, EPOLL_CTL_ADD);
@@ -170,6 +201,7 @@ vwe_thread(void *priv)
 		dotimer = 0;
 		n = epoll_wait(vwe->epfd, ev, NEEV, -1);
 		now = VTIM_real();
+		vwe->vsc->wakeups++;
 		for (ep = ev, i = 0; i < n; i++, ep++) {
 			if (ep->data.ptr == vwe->timer_pipes &&
 			    (ep->events == EPOLLIN || ep->events == EPOLLPRI))
@@ -183,14 +215,13 @@ vwe_thread(void *priv)
 			continue;
 
 		/* check for timeouts */
-		deadline = now - cache_param->timeout_idle;
-		for (;;) {
-			sp = VTAILQ_FIRST(&vwe->sesshead);
-			if (sp == NULL)
-				break;
-			if (sp->t_idle > deadline)
-				break;
-			VTAILQ_REMOVE(&vwe->sesshead, sp, list);
+		VTAILQ_INIT(&expired);
+		u = WAIT_WheelExpire(vwe->wheel, now, &expired);
+		vwe->vsc->sess_wait -= u;
+		vwe->vsc->sess_timeout += u;
+		while (!VTAILQ_EMPTY(&expired)) {
+			sp = VTAILQ_FIRST(&expired);
+			VTAILQ_REMOVE(&expired, sp, list);
 			// XXX: not yet VTCP_linger(sp->fd, 0);
 			SES_Delete(sp, "timeout", now);
 		}
@@ -217,28 +248,47 @@ vwe_timeout_idle_ticker(void *priv)
 	return (NULL);
 }
 
-/*--------------------------------------------------------------------*/
+/*--------------------------------------------------------------------
+ * A pool gets the shards which are its number modulo thread_pools, and
+ * its sessions are spread over those by fd.  That way every shard gets
+ * work, whether there are more or fewer of them than pools.
+ */
 
 static void
 vwe_pass(void *priv, const struct sess *sp)
 {
+	struct vwes *vwes;
 	struct vwe *vwe;
-
-	CAST_OBJ_NOTNULL(vwe, priv, VWE_MAGIC);
+	unsigned np, n;
+
+	CAST_OBJ_NOTNULL(vwes, priv, VWES_MAGIC);
+	np = cache_param->wthread_pools;
+	if (np < 1)
+		np = 1;
+	n = (vwes->nshard + np - 1) / np;
+	vwe = &vwes->shard[(SES_PoolNo(sp) + np * ((unsigned)sp->fd % n)) %
+	    vwes->nshard];
+	CHECK_OBJ_NOTNULL(vwe, VWE_MAGIC);
 	assert(sizeof sp == write(vwe->pipes[1], &sp, sizeof sp));
 }
 
 /*--------------------------------------------------------------------*/
 
-static void *
-vwe_init(void)
+static void
+vwe_init_shard(struct vwe *vwe, unsigned n)
 {
+	char buf[8];
 	int i;
-	struct vwe *vwe;
 
-	ALLOC_OBJ(vwe, VWE_MAGIC);
-	AN(vwe);
-	VTAILQ_INIT(&vwe->sesshead);
+	vwe->magic = VWE_MAGIC;
+	vwe->wheel = WAIT_WheelNew();
+	bprintf(buf, "%u", n);
+	vwe->vsc = VSM_Alloc(sizeof *vwe->vsc, VSC_CLASS, VSC_TYPE_WAITER, buf);
+	AN(vwe->vsc);
+	bprintf(vwe->name, "cache-epoll%s", n == 0 ? "" : buf);
+
+	vwe->epfd = epoll_create(1);
+	assert(vwe->epfd >= 0);
 	AZ(pipe(vwe->pipes));
 	AZ(pipe(vwe->timer_pipes));
 
@@ -257,7 +307,24 @@ vwe_init(void)
 	AZ(pthread_create(&vwe->timer_thread,
 	    NULL, vwe_timeout_idle_ticker, vwe));
 	AZ(pthread_create(&vwe->epoll_thread, NULL, vwe_thread, vwe));
-	return(vwe);
+}
+
+static void *
+vwe_init(void)
+{
+	struct vwes *vwes;
+	unsigned u;
+
+	ALLOC_OBJ(vwes, VWES_MAGIC);
+	AN(vwes);
+	vwes->nshard = cache_param->waiter_shards;
+	if (vwes->nshard < 1)
+		vwes->nshard = 1;
+	vwes->shard = calloc(vwes->nshard, sizeof *vwes->shard);
+	AN(vwes->shard);
+	for (u = 0; u < vwes->nshard; u++)
+		vwe_init_shard(&vwes->shard[u], u);
+	return(vwes);
 }
 
 /*--------------------------------------------------------------------*/
@@ -0,0 +1,344 @@
+/*-
+ * Copyright (c) 2006 Verdens Gang AS
+ * Copyright (c) 2006-2011 Varnish Software AS
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * A waiter on top of Linux io_uring.
+ *
+ * Sessions are passed in through a pipe, like for epoll, which stays
+ * armed with a multishot poll.  Each waiting session gets a oneshot
+ * poll, and when it fires we read what the client sent straight into
+ * the receive buffer of a fresh request, so the worker which picks up
+ * the session can start parsing without another trip through poll(2).
+ *
+ * A session which times out has its poll removed, and is only closed
+ * once the kernel has completed the poll, since the ring holds on to
+ * the file until then.
+ */
+
+#include "config.h"
+
+#if defined(HAVE_LIBURING)
+
+#include <liburing.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache/cache.h"
+
+#include "waiter/waiter.h"
+#include "vtim.h"
+
+#define NRING	1024
+#define NPIPE	100
+
+struct vwu {
+	unsigned		magic;
+#define VWU_MAGIC		0x2a1f7c53
+
+	pthread_t		thread;
+	struct io_uring		ring;
+
+	struct waitwheel	*wheel;
+	int			pipes[2];
+
+	struct VSC_C_waiter	*vsc;
+};
+
+/*--------------------------------------------------------------------*/
+
+static struct io_uring_sqe *
+vwu_sqe(struct vwu *vwu)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = io_uring_get_sqe(&vwu->ring);
+	if (sqe == NULL) {
+		/* Submission queue full, push it to the kernel */
+		assert(io_uring_submit(&vwu->ring) >= 0);
+		sqe = io_uring_get_sqe(&vwu->ring);
+	}
+	AN(sqe);
+	return (sqe);
+}
+
+static void
+vwu_arm_pipe(struct vwu *vwu)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = vwu_sqe(vwu);
+	io_uring_prep_poll_multishot(sqe, vwu->pipes[0], POLLIN);
+	io_uring_sqe_set_data(sqe, vwu->pipes);
+}
+
+static void
+vwu_arm(struct vwu *vwu, struct sess *sp)
+{
+	struct io_uring_sqe *sqe;
+
+	CHECK_OBJ_NOTNULL(sp, SESS_MAGIC);
+	assert(sp->fd >= 0);
+	sqe = vwu_sqe(vwu);
+	io_uring_prep_poll_add(sqe, sp->fd, POLLIN | POLLPRI | POLLRDHUP);
+	io_uring_sqe_set_data(sqe, sp);
+}
+
+static void
+vwu_disarm(struct vwu *vwu, struct sess *sp)
+{
+	struct io_uring_sqe *sqe;
+
+	CHECK_OBJ_NOTNULL(sp, SESS_MAGIC);
+	sqe = vwu_sqe(vwu);
+	io_uring_prep_poll_remove(sqe, (uintptr_t)sp);
+	/* Completion of the removal itself is of no interest */
+	io_uring_sqe_set_data(sqe, vwu);
+}
+
+/*--------------------------------------------------------------------
+ * Read whatever the client has sent into a new request.
+ *
+ * Returns:
+ *	>0  bytes read
+ *	 0  nothing there after all, keep waiting
+ *	<0  EOF, error or no room
+ */
+
+static int
+vwu_read(struct sess *sp)
+{
+	struct http_conn *htc;
+	int i;
+
+	if (sp->req == NULL) {
+		SES_GetReq(sp);
+		HTC_Init(sp->req->htc, sp->ws, sp->fd, sp->vsl_id,
+		    cache_param->http_req_size,
+		    cache_param->http_req_hdr_len);
+	}
+	htc = sp->req->htc;
+	CHECK_OBJ_NOTNULL(htc, HTTP_CONN_MAGIC);
+	AN(htc->ws->r);
+	i = (htc->ws->r - htc->rxbuf.e) - 1;	/* space for NUL */
+	if (i <= 0)
+		return (-1);
+	i = read(sp->fd, htc->rxbuf.e, i);
+	if (i < 0 && errno == EAGAIN)
+		return (0);
+	if (i <= 0)
+		return (-1);
+	htc->rxbuf.e += i;
+	*htc->rxbuf.e = '\0';
+	return (i);
+}
+
+/*--------------------------------------------------------------------*/
+
+static void
+vwu_pipe(struct vwu *vwu)
+{
+	struct sess *ss[NPIPE];
+	int i, j;
+
+	/* The multishot poll does not fire again for what is left behind */
+	do {
+		i = read(vwu->pipes[0], ss, sizeof ss);
+		if (i == -1 && errno == EAGAIN)
+			return;
+		j = 0;
+		while (i >= sizeof ss[0]) {
+			CHECK_OBJ_NOTNULL(ss[j], SESS_MAGIC);
+			assert(ss[j]->fd >= 0);
+			AZ(ss[j]->req);
+			WAIT_WheelInsert(vwu->wheel, ss[j]);
+			vwu->vsc->sess_wait++;
+			vwu_arm(vwu, ss[j]);
+			j++;
+			i -= sizeof ss[0];
+		}
+		assert(i == 0);
+	} while (j == NPIPE);
+}
+
+static void
+vwu_cqe(struct vwu *vwu, const struct io_uring_cqe *cqe, double now)
+{
+	struct sess *sp, *nsp;
+	void *p;
+
+	p = io_uring_cqe_get_data(cqe);
+	AN(p);
+	if (p == vwu)
+		return;
+	if (p == vwu->pipes) {
+		if (!(cqe->flags & IORING_CQE_F_MORE))
+			vwu_arm_pipe(vwu);
+		if (cqe->res > 0)
+			vwu_pipe(vwu);
+		return;
+	}
+	CAST_OBJ_NOTNULL(sp, p, SESS_MAGIC);
+	if (sp->wslot == 0) {
+		/* Timed out, and the poll is gone now */
+		vwu->vsc->sess_timeout++;
+		SES_Delete(sp, "timeout", now);
+		return;
+	}
+	WAIT_WheelRemove(vwu->wheel, sp);
+	vwu->vsc->sess_wait--;
+	if (cqe->res < 0 || cqe->res & (POLLERR | POLLNVAL)) {
+		vwu->vsc->sess_closed++;
+		SES_Delete(sp, "ERR", now);
+		return;
+	}
+	/* We need the workspace back to read into it */
+	nsp = SES_Attach(sp);
+	if (nsp == NULL) {
+		vwu->vsc->sess_closed++;
+		SES_Delete(sp, "no memory", now);
+		return;
+	}
+	sp = nsp;
+	switch (vwu_read(sp)) {
+	case 0:
+		WAIT_WheelInsert(vwu->wheel, sp);
+		vwu->vsc->sess_wait++;
+		vwu_arm(vwu, sp);
+		break;
+	case -1:
+		vwu->vsc->sess_closed++;
+		SES_Delete(sp, "EOF", now);
+		break;
+	default:
+		vwu->vsc->sess_handled++;
+		SES_Handle(sp, now);
+		break;
+	}
+}
+
+/*--------------------------------------------------------------------*/
+
+static void *
+vwu_thread(void *priv)
+{
+	struct __kernel_timespec ts;
+	struct waitwheel_head expired;
+	struct io_uring_cqe *cqe;
+	struct sess *sp;
+	unsigned head, n;
+	double now;
+	struct vwu *vwu;
+	int i;
+
+	CAST_OBJ_NOTNULL(vwu, priv, VWU_MAGIC);
+	THR_SetName("cache-io_uring");
+
+	vwu_arm_pipe(vwu);
+
+	ts.tv_sec = 0;
+	ts.tv_nsec = 100 * 1000 * 1000;
+	while (1) {
+		assert(io_uring_submit(&vwu->ring) >= 0);
+		i = io_uring_wait_cqe_timeout(&vwu->ring, &cqe, &ts);
+		assert(i == 0 || i == -ETIME || i == -EINTR);
+		now = VTIM_real();
+		vwu->vsc->wakeups++;
+		n = 0;
+		io_uring_for_each_cqe(&vwu->ring, head, cqe) {
+			vwu_cqe(vwu, cqe, now);
+			n++;
+		}
+		io_uring_cq_advance(&vwu->ring, n);
+
+		/* check for timeouts */
+		VTAILQ_INIT(&expired);
+		n = WAIT_WheelExpire(vwu->wheel, now, &expired);
+		vwu->vsc->sess_wait -= n;
+		while (!VTAILQ_EMPTY(&expired)) {
+			sp = VTAILQ_FIRST(&expired);
+			VTAILQ_REMOVE(&expired, sp, list);
+			/* Closed when its poll completes, see vwu_cqe() */
+			vwu_disarm(vwu, sp);
+		}
+	}
+	return (NULL);
+}
+
+/*--------------------------------------------------------------------*/
+
+static void
+vwu_pass(void *priv, const struct sess *sp)
+{
+	struct vwu *vwu;
+
+	CAST_OBJ_NOTNULL(vwu, priv, VWU_MAGIC);
+	assert(sizeof sp == write(vwu->pipes[1], &sp, sizeof sp));
+}
+
+/*--------------------------------------------------------------------*/
+
+static void *
+vwu_init(void)
+{
+	struct vwu *vwu;
+	int i;
+
+	ALLOC_OBJ(vwu, VWU_MAGIC);
+	AN(vwu);
+	vwu->wheel = WAIT_WheelNew();
+	vwu->vsc = VSM_Alloc(sizeof *vwu->vsc, VSC_CLASS, VSC_TYPE_WAITER, "0");
+	AN(vwu->vsc);
+
+	i = io_uring_queue_init(NRING, &vwu->ring, 0);
+	if (i < 0) {
+		fprintf(stderr, "io_uring_queue_init(): %s\n", strerror(-i));
+		exit(2);
+	}
+	AZ(pipe(vwu->pipes));
+
+	i = fcntl(vwu->pipes[0], F_GETFL);
+	assert(i != -1);
+	i |= O_NONBLOCK;
+	i = fcntl(vwu->pipes[0], F_SETFL, i);
+	assert(i != -1);
+
+	AZ(pthread_create(&vwu->thread, NULL, vwu_thread, vwu));
+	return (vwu);
+}
+
+/*--------------------------------------------------------------------*/
+
+const struct waiter waiter_io_uring = {
+	.name =		"io_uring",
+	.init =		vwu_init,
+	.pass =		vwu_pass,
+};
+
+#endif /* defined(HAVE_LIBURING) */
@@ -57,7 +57,7 @@ struct vwk {
 	int			kq;
 	struct kevent		ki[NKEV];
 	unsigned		nki;
-	VTAILQ_HEAD(,sess)	sesshead;
+	struct waitwheel	*wheel;
 };
 
 /*--------------------------------------------------------------------*/
@@ -103,7 +103,7 @@ vwk_pipe_ev(struct vwk *vwk, const struct kevent *kp)
 	while (i >= sizeof ss[0]) {
 		CHECK_OBJ_NOTNULL(ss[j], SESS_MAGIC);
 		assert(ss[j]->fd >= 0);
-		VTAILQ_INSERT_TAIL(&vwk->sesshead, ss[j], list);
+		WAIT_WheelInsert(vwk->wheel, ss[j]);
 		vwk_kq_sess(vwk, ss[j], EV_ADD | EV_ONESHOT);
 		j++;
 		i -= sizeof ss[0];
@@ -128,11 +128,11 @@ vwk_sess_ev(struct vwk *vwk, const struct kevent *kp, double now)
 	assert((sp->vsl_id & VSL_IDENTMASK) == kp->ident);
 	assert((sp->vsl_id & VSL_IDENTMASK) == sp->fd);
 	if (kp->data > 0) {
-		VTAILQ_REMOVE(&vwk->sesshead, sp, list);
+		WAIT_WheelRemove(vwk->wheel, sp);
 		SES_Handle(sp, now);
 		return;
 	} else if (kp->flags & EV_EOF) {
-		VTAILQ_REMOVE(&vwk->sesshead, sp, list);
+		WAIT_WheelRemove(vwk->wheel, sp);
 		SES_Delete(sp, "EOF", now);
 		return;
 	} else {
@@ -151,7 +151,8 @@ vwk_thread(void *priv)
 	struct vwk *vwk;
 	struct kevent ke[NKEV], *kp;
 	int j, n, dotimer;
-	double now, deadline;
+	double now;
+	struct waitwheel_head expired;
 	struct sess *sp;
 
 	CAST_OBJ_NOTNULL(vwk, priv, VWK_MAGIC);
@@ -195,14 +196,11 @@ vwk_thread(void *priv)
 		 * would not know we meant "the old fd of this number".
 		 */
 		vwk_kq_flush(vwk);
-		deadline = now - cache_param->timeout_idle;
-		for (;;) {
-			sp = VTAILQ_FIRST(&vwk->sesshead);
-			if (sp == NULL)
-				break;
-			if (sp->t_idle > deadline)
-				break;
-			VTAILQ_REMOVE(&vwk->sesshead, sp, list);
+		VTAILQ_INIT(&expired);
+		(void)WAIT_WheelExpire(vwk->wheel, now, &expired);
+		while (!VTAILQ_EMPTY(&expired)) {
+			sp = VTAILQ_FIRST(&expired);
+			VTAILQ_REMOVE(&expired, sp, list);
 			// XXX: not yet (void)VTCP_linger(sp->fd, 0);
 			SES_Delete(sp, "timeout", now);
 		}
@@ -231,7 +229,7 @@ vwk_init(void)
 	ALLOC_OBJ(vwk, VWK_MAGIC);
 	AN(vwk);
 
-	VTAILQ_INIT(&vwk->sesshead);
+	vwk->wheel = WAIT_WheelNew();
 	AZ(pipe(vwk->pipes));
 
 	i = fcntl(vwk->pipes[0], F_GETFL);
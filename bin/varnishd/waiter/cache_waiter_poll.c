@@ -46,10 +46,11 @@ struct vwp {
 	int			pipes[2];
 	pthread_t		poll_thread;
 	struct pollfd		*pollfd;
+	struct sess		**sess;		/* Indexed like pollfd */
 	unsigned		npoll;
 	unsigned		hpoll;
 
-	VTAILQ_HEAD(,sess)	sesshead;
+	struct waitwheel	*wheel;
 };
 
 /*--------------------------------------------------------------------*/
@@ -58,6 +59,7 @@ static void
 vwp_pollspace(struct vwp *vwp, unsigned fd)
 {
 	struct pollfd *newpollfd = vwp->pollfd;
+	struct sess **newsess = vwp->sess;
 	unsigned newnpoll;
 
 	if (fd < vwp->npoll)
@@ -72,7 +74,12 @@ vwp_pollspace(struct vwp *vwp, unsigned fd)
 	XXXAN(newpollfd);
 	memset(newpollfd + vwp->npoll, 0,
 	    (newnpoll - vwp->npoll) * sizeof *newpollfd);
+	newsess = realloc(newsess, newnpoll * sizeof *newsess);
+	XXXAN(newsess);
+	memset(newsess + vwp->npoll, 0,
+	    (newnpoll - vwp->npoll) * sizeof *newsess);
 	vwp->pollfd = newpollfd;
+	vwp->sess = newsess;
 	while (vwp->npoll < newnpoll)
 		vwp->pollfd[vwp->npoll++].fd = -1;
 	assert(fd < vwp->npoll);
@@ -113,6 +120,7 @@ vwp_unpoll(struct vwp *vwp, int fd)
 
 	vwp->pollfd[fd].fd = -1;
 	vwp->pollfd[fd].events = 0;
+	vwp->sess[fd] = NULL;
 }
 
 /*--------------------------------------------------------------------*/
@@ -122,8 +130,9 @@ vwp_main(void *priv)
 {
 	int v, v2;
 	struct vwp *vwp;
-	struct sess *ss[NEEV], *sp, *sp2;
-	double now, deadline;
+	struct sess *ss[NEEV], *sp;
+	struct waitwheel_head expired;
+	double now;
 	int i, j, fd;
 
 	CAST_OBJ_NOTNULL(vwp, priv, VWP_MAGIC);
@@ -141,29 +150,27 @@ vwp_main(void *priv)
 		v = poll(vwp->pollfd, vwp->hpoll + 1, 100);
 		assert(v >= 0);
 		now = VTIM_real();
-		deadline = now - cache_param->timeout_idle;
 		v2 = v;
-		VTAILQ_FOREACH_SAFE(sp, &vwp->sesshead, list, sp2) {
-			if (v != 0 && v2 == 0)
-				break;
+		for (fd = 0; v2 > 0 && fd <= vwp->hpoll; fd++) {
+			if (fd == vwp->pipes[0] || !vwp->pollfd[fd].revents)
+				continue;
+			sp = vwp->sess[fd];
 			CHECK_OBJ_NOTNULL(sp, SESS_MAGIC);
-			fd = sp->fd;
-			assert(fd >= 0);
-			assert(fd <= vwp->hpoll);
-			assert(fd < vwp->npoll);
-			assert(vwp->pollfd[fd].fd == fd);
-			if (vwp->pollfd[fd].revents) {
-				v2--;
-				vwp->pollfd[fd].revents = 0;
-				VTAILQ_REMOVE(&vwp->sesshead, sp, list);
-				vwp_unpoll(vwp, fd);
-				SES_Handle(sp, now);
-			} else if (sp->t_idle <= deadline) {
-				VTAILQ_REMOVE(&vwp->sesshead, sp, list);
-				vwp_unpoll(vwp, fd);
-				// XXX: not yet (void)VTCP_linger(sp->fd, 0);
-				SES_Delete(sp, "timeout", now);
-			}
+			assert(sp->fd == fd);
+			v2--;
+			vwp->pollfd[fd].revents = 0;
+			WAIT_WheelRemove(vwp->wheel, sp);
+			vwp_unpoll(vwp, fd);
+			SES_Handle(sp, now);
+		}
+		VTAILQ_INIT(&expired);
+		(void)WAIT_WheelExpire(vwp->wheel, now, &expired);
+		while (!VTAILQ_EMPTY(&expired)) {
+			sp = VTAILQ_FIRST(&expired);
+			VTAILQ_REMOVE(&expired, sp, list);
+			vwp_unpoll(vwp, sp->fd);
+			// XXX: not yet (void)VTCP_linger(sp->fd, 0);
+			SES_Delete(sp, "timeout", now);
 		}
 		if (v2 && vwp->pollfd[vwp->pipes[0]].revents) {
 
@@ -179,8 +186,9 @@ vwp_main(void *priv)
 			for (j = 0; j * sizeof ss[0] < i; j++) {
 				CHECK_OBJ_NOTNULL(ss[j], SESS_MAGIC);
 				assert(ss[j]->fd >= 0);
-				VTAILQ_INSERT_TAIL(&vwp->sesshead, ss[j], list);
 				vwp_poll(vwp, ss[j]->fd);
+				vwp->sess[ss[j]->fd] = ss[j];
+				WAIT_WheelInsert(vwp->wheel, ss[j]);
 			}
 		}
 		assert(v2 == 0);
@@ -209,7 +217,7 @@ vwp_poll_init(void)
 
 	ALLOC_OBJ(vwp, VWP_MAGIC);
 	AN(vwp);
-	VTAILQ_INIT(&vwp->sesshead);
+	vwp->wheel = WAIT_WheelNew();
 	AZ(pipe(vwp->pipes));
 	vwp_pollspace(vwp, 256);
 	AZ(pthread_create(&vwp->poll_thread, NULL, vwp_main, vwp));
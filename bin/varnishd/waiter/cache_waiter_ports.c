@@ -52,7 +52,7 @@ struct vws {
 #define VWS_MAGIC		0x0b771473
 	pthread_t		ports_thread;
 	int			dport;
-	VTAILQ_HEAD(,sess)	sesshead;
+	struct waitwheel	*wheel;
 };
 
 static inline void
@@ -77,7 +77,7 @@ vws_port_ev(struct vws *vws, port_event_t *ev, double now) {
 	if(ev->portev_source == PORT_SOURCE_USER) {
 		CAST_OBJ_NOTNULL(sp, ev->portev_user, SESS_MAGIC);
 		assert(sp->fd >= 0);
-		VTAILQ_INSERT_TAIL(&vws->sesshead, sp, list);
+		WAIT_WheelInsert(vws->wheel, sp);
 		vws_add(vws, sp->fd, sp);
 	} else {
 		int i;
@@ -86,7 +86,7 @@ vws_port_ev(struct vws *vws, port_event_t *ev, double now) {
 		assert(sp->fd >= 0);
 		if(ev->portev_events & POLLERR) {
 			vws_del(vws, sp->fd);
-			VTAILQ_REMOVE(&vws->sesshead, sp, list);
+			WAIT_WheelRemove(vws->wheel, sp);
 			SES_Delete(sp, "EOF", now);
 			return;
 		}
@@ -105,7 +105,7 @@ vws_port_ev(struct vws *vws, port_event_t *ev, double now) {
 		 *          threadID=129476&tstart=0
 		 */
 		vws_del(vws, sp->fd);
-		VTAILQ_REMOVE(&vws->sesshead, sp, list);
+		WAIT_WheelRemove(vws->wheel, sp);
 
 		/* SES_Handle will also handle errors */
 		SES_Handle(sp, now);
@@ -123,29 +123,16 @@ vws_thread(void *priv)
 	/*
 	 * timeouts:
 	 *
-	 * min_ts : Minimum timeout for port_getn
-	 * min_t  : ^ equivalent in floating point representation
+	 * min_ts : Timeout for port_getn while sessions are waiting,
+	 *          one tick of the timing wheel
 	 *
-	 * max_ts : Maximum timeout for port_getn
-	 * max_t  : ^ equivalent in floating point representation
-	 *
-	 * with (nevents == 1), we should always choose the correct port_getn
-	 * timeout to check session timeouts, so max is just a safety measure
-	 * (if this implementation is correct, it could be set to an "infinte"
-	 *  value)
-	 *
-	 * with (nevents > 1), min and max define the acceptable range for
-	 * - additional latency of keep-alive connections and
-	 * - additional tolerance for handling session timeouts
+	 * max_ts : Timeout for port_getn when idle, just a safety measure
 	 *
 	 */
 	static struct timespec min_ts = {0L, 100L * 1000L * 1000L /*ns*/};
-	static double          min_t  = 0.1; /* 100    ms*/
 	static struct timespec max_ts = {1L, 0L};		/* 1 second */
-	static double	       max_t  = 1.0;			/* 1 second */
 
-	/* XXX: These should probably go in vws ? */
-	struct timespec ts;
+	struct waitwheel_head expired;
 	struct timespec *timeout;
 
 	vws->dport = port_create();
@@ -156,7 +143,7 @@ vws_thread(void *priv)
 	while (1) {
 		port_event_t ev[MAX_EVENTS];
 		int nevents, ei, ret;
-		double now, deadline;
+		double now;
 
 		/*
 		 * XXX Do we want to scale this up dynamically to increase
@@ -191,23 +178,11 @@ vws_thread(void *priv)
 			vws_port_ev(vws, ev + ei, now);
 
 		/* check for timeouts */
-		deadline = now - cache_param->timeout_idle;
-
-		/*
-		 * This loop assumes that the oldest sessions are always at the
-		 * beginning of the list (which is the case if we guarantee to
-		 * enqueue at the tail only
-		 *
-		 */
-
-		for (;;) {
-			sp = VTAILQ_FIRST(&vws->sesshead);
-			if (sp == NULL)
-				break;
-			if (sp->t_idle > deadline) {
-				break;
-			}
-			VTAILQ_REMOVE(&vws->sesshead, sp, list);
+		VTAILQ_INIT(&expired);
+		(void)WAIT_WheelExpire(vws->wheel, now, &expired);
+		while (!VTAILQ_EMPTY(&expired)) {
+			sp = VTAILQ_FIRST(&expired);
+			VTAILQ_REMOVE(&expired, sp, list);
 			if(sp->fd != -1) {
 				vws_del(vws, sp->fd);
 			}
@@ -215,27 +190,13 @@ vws_thread(void *priv)
 		}
 
 		/*
-		 * Calculate the timeout for the next get_portn
+		 * Calculate the timeout for the next get_portn: the timing
+		 * wheel ticks every min_ts, so that is as precise as we can
+		 * usefully be.
 		 */
 
-		if (sp) {
-			double tmo =
-			    (sp->t_open + cache_param->timeout_idle) - now;
-
-			/*
-			 * we should have removed all sps whose timeout
-			 * has passed
-			 */
-			assert(tmo > 0.0);
-
-			if (tmo < min_t) {
-				timeout = &min_ts;
-			} else if (tmo > max_t) {
-				timeout = &max_ts;
-			} else {
-				ts = VTIM_timespec(tmo);
-				timeout = &ts;
-			}
+		if (WAIT_WheelCount(vws->wheel) > 0) {
+			timeout = &min_ts;
 		} else {
 			timeout = &max_ts;
 		}
@@ -265,7 +226,7 @@ vws_init(void)
 
 	ALLOC_OBJ(vws, VWS_MAGIC);
 	AN(vws);
-	VTAILQ_INIT(&vws->sesshead);
+	vws->wheel = WAIT_WheelNew();
 	AZ(pthread_create(&vws->ports_thread, NULL, vws_thread, vws));
 	return (vws);
 }
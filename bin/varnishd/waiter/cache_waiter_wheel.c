@@ -0,0 +1,241 @@
+/*-
+ * Copyright (c) 2006 Verdens Gang AS
+ * Copyright (c) 2006-2011 Varnish Software AS
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Hierarchical timing wheel for the idle timeout of waiting sessions.
+ *
+ * Time is counted in ticks of WHL_TICK seconds.  Level zero has a slot
+ * for each of the next WHL_SLOTS ticks, and every level above has slots
+ * WHL_SLOTS times wider.  A session goes into the lowest level which
+ * covers its deadline, and as the lower level wraps around, the slot
+ * of the level above which comes due is redistributed one level down.
+ * Insert and remove are a list operation, and expiring a tick takes
+ * the sessions in its level zero slot.
+ *
+ * The deadline is recalculated from timeout_idle whenever a session is
+ * moved, and checked once more when it expires, so a longer timeout_idle
+ * takes effect for sessions already waiting.
+ *
+ * Each waiter thread has its own wheel, no locking is needed.
+ */
+
+#include "config.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "cache/cache.h"
+
+#include "waiter/waiter.h"
+#include "vtim.h"
+
+#define WHL_TICK	0.1		/* seconds */
+#define WHL_BITS	6
+#define WHL_SLOTS	(1U << WHL_BITS)
+#define WHL_MASK	(WHL_SLOTS - 1)
+#define WHL_LEVELS	4		/* 2^24 ticks, about 19 days */
+
+struct waitwheel {
+	unsigned		magic;
+#define WAITWHEEL_MAGIC		0x7bd0b1e5
+	double			t0;
+	uint64_t		now;	/* All ticks until now are expired */
+	unsigned		nsess;
+	struct waitwheel_head		slot[WHL_LEVELS][WHL_SLOTS];
+};
+
+static struct lock		whl_mtx;
+
+/*--------------------------------------------------------------------*/
+
+static uint64_t
+whl_tick(const struct waitwheel *whl, double t)
+{
+
+	if (t <= whl->t0)
+		return (0);
+	return ((uint64_t)ceil((t - whl->t0) / WHL_TICK));
+}
+
+static void
+whl_insert(struct waitwheel *whl, struct sess *sp)
+{
+	uint64_t when, delta;
+	unsigned lvl, idx;
+
+	AZ(sp->wslot);
+	when = whl_tick(whl, sp->t_idle + cache_param->timeout_idle);
+	if (when <= whl->now)
+		when = whl->now + 1;
+	delta = when - whl->now;
+	for (lvl = 0; lvl < WHL_LEVELS - 1; lvl++)
+		if (delta < (1ULL << (WHL_BITS * (lvl + 1))))
+			break;
+	if (delta >= (1ULL << (WHL_BITS * WHL_LEVELS)))
+		when = whl->now + (1ULL << (WHL_BITS * WHL_LEVELS)) - 1;
+	idx = (when >> (WHL_BITS * lvl)) & WHL_MASK;
+	VTAILQ_INSERT_TAIL(&whl->slot[lvl][idx], sp, list);
+	sp->wslot = 1 + lvl * WHL_SLOTS + idx;
+}
+
+static void
+whl_remove(struct waitwheel *whl, struct sess *sp)
+{
+	unsigned u;
+
+	AN(sp->wslot);
+	u = sp->wslot - 1;
+	assert(u < WHL_LEVELS * WHL_SLOTS);
+	VTAILQ_REMOVE(&whl->slot[u / WHL_SLOTS][u % WHL_SLOTS], sp, list);
+	sp->wslot = 0;
+}
+
+/*--------------------------------------------------------------------
+ * Move the slot of level 'lvl' which comes due now one level down.
+ * Returns the index of that slot, so the caller knows if the level
+ * above wrapped as well.
+ */
+
+static unsigned
+whl_cascade(struct waitwheel *whl, unsigned lvl)
+{
+	struct waitwheel_head head;
+	struct sess *sp;
+	unsigned idx;
+
+	idx = (whl->now >> (WHL_BITS * lvl)) & WHL_MASK;
+	VTAILQ_INIT(&head);
+	VTAILQ_CONCAT(&head, &whl->slot[lvl][idx], list);
+	while (!VTAILQ_EMPTY(&head)) {
+		sp = VTAILQ_FIRST(&head);
+		VTAILQ_REMOVE(&head, sp, list);
+		sp->wslot = 0;
+		whl_insert(whl, sp);
+	}
+	return (idx);
+}
+
+/*--------------------------------------------------------------------*/
+
+struct waitwheel *
+WAIT_WheelNew(void)
+{
+	struct waitwheel *whl;
+	unsigned l, s;
+
+	ALLOC_OBJ(whl, WAITWHEEL_MAGIC);
+	AN(whl);
+	whl->t0 = VTIM_real();
+	for (l = 0; l < WHL_LEVELS; l++)
+		for (s = 0; s < WHL_SLOTS; s++)
+			VTAILQ_INIT(&whl->slot[l][s]);
+	return (whl);
+}
+
+void
+WAIT_WheelInsert(struct waitwheel *whl, struct sess *sp)
+{
+
+	CHECK_OBJ_NOTNULL(whl, WAITWHEEL_MAGIC);
+	CHECK_OBJ_NOTNULL(sp, SESS_MAGIC);
+	whl_insert(whl, sp);
+	whl->nsess++;
+}
+
+void
+WAIT_WheelRemove(struct waitwheel *whl, struct sess *sp)
+{
+
+	CHECK_OBJ_NOTNULL(whl, WAITWHEEL_MAGIC);
+	CHECK_OBJ_NOTNULL(sp, SESS_MAGIC);
+	whl_remove(whl, sp);
+	assert(whl->nsess > 0);
+	whl->nsess--;
+}
+
+unsigned
+WAIT_WheelCount(const struct waitwheel *whl)
+{
+
+	CHECK_OBJ_NOTNULL(whl, WAITWHEEL_MAGIC);
+	return (whl->nsess);
+}
+
+/*--------------------------------------------------------------------
+ * Advance the wheel to 'now', and move the sessions which timed out to
+ * 'expired', for the caller to close in one go.  Returns how many.
+ */
+
+unsigned
+WAIT_WheelExpire(struct waitwheel *whl, double now, struct waitwheel_head *expired)
+{
+	struct waitwheel_head head;
+	struct sess *sp;
+	uint64_t target;
+	unsigned lvl, n;
+
+	CHECK_OBJ_NOTNULL(whl, WAITWHEEL_MAGIC);
+	AN(expired);
+	target = 0;
+	if (now > whl->t0)
+		target = (uint64_t)floor((now - whl->t0) / WHL_TICK);
+	n = 0;
+	while (whl->now < target) {
+		whl->now++;
+		if ((whl->now & WHL_MASK) == 0)
+			for (lvl = 1; lvl < WHL_LEVELS; lvl++)
+				if (whl_cascade(whl, lvl) != 0)
+					break;
+		VTAILQ_INIT(&head);
+		VTAILQ_CONCAT(&head, &whl->slot[0][whl->now & WHL_MASK], list);
+		while (!VTAILQ_EMPTY(&head)) {
+			sp = VTAILQ_FIRST(&head);
+			VTAILQ_REMOVE(&head, sp, list);
+			sp->wslot = 0;
+			if (sp->t_idle + cache_param->timeout_idle > now) {
+				/* timeout_idle was raised */
+				whl_insert(whl, sp);
+				continue;
+			}
+			VTAILQ_INSERT_TAIL(expired, sp, list);
+			whl->nsess--;
+			n++;
+		}
+	}
+	if (n > 0) {
+		Lck_Lock(&whl_mtx);
+		VSC_C_main->sess_timeout += n;
+		VSC_C_main->sess_timeout_tick = n;
+		Lck_Unlock(&whl_mtx);
+	}
+	return (n);
+}
+
+void
+WAIT_WheelInit(void)
+{
+
+	Lck_New(&whl_mtx, lck_waitwheel);
+}
@@ -46,6 +46,9 @@ static const struct waiter *const vca_waiters[] = {
     #if defined(HAVE_EPOLL_CTL)
 	&waiter_epoll,
     #endif
+    #if defined(HAVE_LIBURING)
+	&waiter_io_uring,
+    #endif
     #if defined(HAVE_PORT_CREATE)
 	&waiter_ports,
     #endif
@@ -29,6 +29,7 @@
  */
 
 struct sess;
+struct waitwheel;
 
 typedef void* waiter_init_f(void);
 typedef void waiter_pass_f(void *priv, const struct sess *);
@@ -39,6 +40,16 @@ struct waiter {
 	waiter_pass_f		*pass;
 };
 
+/* cache_waiter_wheel.c */
+VTAILQ_HEAD(waitwheel_head, sess);
+void WAIT_WheelInit(void);
+struct waitwheel *WAIT_WheelNew(void);
+void WAIT_WheelInsert(struct waitwheel *, struct sess *);
+void WAIT_WheelRemove(struct waitwheel *, struct sess *);
+unsigned WAIT_WheelCount(const struct waitwheel *);
+unsigned WAIT_WheelExpire(struct waitwheel *, double now,
+    struct waitwheel_head *expired);
+
 /* mgt_waiter.c */
 extern struct waiter const * waiter;
 void WAIT_tweak_waiter(struct cli *cli, const char *arg);
@@ -47,6 +58,10 @@ void WAIT_tweak_waiter(struct cli *cli, const char *arg);
 extern const struct waiter waiter_epoll;
 #endif
 
+#if defined(HAVE_LIBURING)
+extern const struct waiter waiter_io_uring;
+#endif
+
 #if defined(HAVE_KQUEUE)
 extern const struct waiter waiter_kqueue;
 #endif
@@ -488,6 +488,14 @@ cmd_feature(CMD_ARGS)
 #endif
 		if (sizeof(void*) == 8 && !strcmp(av[i], "64bit"))
 			continue;
+#ifdef HAVE_EPOLL_CTL
+		if (!strcmp(av[i], "epoll"))
+			continue;
+#endif
+#ifdef HAVE_LIBURING
+		if (!strcmp(av[i], "io_uring"))
+			continue;
+#endif
 
 		if (!strcmp(av[i], "!OSX")) {
 #if !defined(__APPLE__) || !defined(__MACH__)
@@ -190,6 +190,8 @@ cmd_var_resolve(struct http *hp, char *spec)
 		return(hp->chunklen);
 	if (!strcmp(spec, "resp.bodylen"))
 		return(hp->bodylen);
+	if (!strcmp(spec, "req.bodylen"))
+		return(hp->bodylen);
 	if (!memcmp(spec, "req.http.", 9)) {
 		hh = hp->req;
 		hdr = spec + 9;
@@ -435,10 +437,11 @@ http_swallow_body(struct http *hp, char * const *hh, int body)
 	}
 	p = http_find_header(hh, "transfer-encoding");
 	if (p != NULL && !strcmp(p, "chunked")) {
+		hp->body = hp->rxbuf + hp->prxbuf;
 		while (http_rxchunk(hp) != 0)
 			continue;
-		vtc_dump(hp->vl, 4, "body", hp->body, ll);
 		ll = hp->rxbuf + hp->prxbuf - hp->body;
+		vtc_dump(hp->vl, 4, "body", hp->body, ll);
 		hp->bodyl = ll;
 		sprintf(hp->bodylen, "%d", ll);
 		return;
@@ -35,6 +35,7 @@ LOCK(smf)
 LOCK(hsl)
 LOCK(hcb)
 LOCK(hcl)
+LOCK(hop)
 LOCK(vcl)
 LOCK(sessmem)
 LOCK(wstat)
@@ -51,4 +52,5 @@ LOCK(vcapace)
 LOCK(nbusyobj)
 LOCK(busyobj)
 LOCK(mempool)
+LOCK(waitwheel)
 /*lint -restore */
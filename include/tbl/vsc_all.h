@@ -62,3 +62,27 @@ VSC_DO(MEMPOOL, mempool, VSC_TYPE_MEMPOOL)
 #include "tbl/vsc_fields.h"
 #undef VSC_DO_MEMPOOL
 VSC_DONE(MEMPOOL, mempool, VSC_TYPE_MEMPOOL)
+
+VSC_DO(POOL, pool, VSC_TYPE_POOL)
+#define VSC_DO_POOL
+#include "tbl/vsc_fields.h"
+#undef VSC_DO_POOL
+VSC_DONE(POOL, pool, VSC_TYPE_POOL)
+
+VSC_DO(WAITER, waiter, VSC_TYPE_WAITER)
+#define VSC_DO_WAITER
+#include "tbl/vsc_fields.h"
+#undef VSC_DO_WAITER
+VSC_DONE(WAITER, waiter, VSC_TYPE_WAITER)
+
+VSC_DO(SESSMEM, sessmem, VSC_TYPE_SESSMEM)
+#define VSC_DO_SESSMEM
+#include "tbl/vsc_fields.h"
+#undef VSC_DO_SESSMEM
+VSC_DONE(SESSMEM, sessmem, VSC_TYPE_SESSMEM)
+
+VSC_DO(HCB, hcb, VSC_TYPE_HCB)
+#define VSC_DO_HCB
+#include "tbl/vsc_fields.h"
+#undef VSC_DO_HCB
+VSC_DONE(HCB, hcb, VSC_TYPE_HCB)
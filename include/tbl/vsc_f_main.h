@@ -79,6 +79,18 @@ VSC_F(sess_fail,		uint64_t, 1, 'c',
 	" some resource like filedescriptors."
 )
 
+VSC_F(sess_timeout,		uint64_t, 0, 'c',
+    "Sessions timed out idle",
+	"Count of sessions the waiter closed because they were idle for"
+	" longer than timeout_idle."
+)
+
+VSC_F(sess_timeout_tick,	uint64_t, 0, 'g',
+    "Sessions timed out last tick",
+	"Number of sessions a waiter closed for timeout_idle the last time"
+	" it closed any."
+)
+
 /*---------------------------------------------------------------------*/
 
 VSC_F(client_req,		uint64_t, 1, 'a',
@@ -129,7 +141,15 @@ VSC_F(backend_recycle,	uint64_t, 0, 'a',
       "  It has not yet been used, but it might be, unless the backend"
       "  closes it.")
 VSC_F(backend_retry,	uint64_t, 0, 'a', "Backend conn. retry", "")
-
+VSC_F(backend_reqbody,	uint64_t, 1, 'a',
+      "Backend req. body resent",
+      "Count of request bodies sent again from storage"
+      "  (param: req_body_cache) to a retried or restarted"
+      "  backend request.")
+
+VSC_F(fetch_park,		uint64_t, 1, 'a', "Fetch parked",
+      "Count of backend requests whose response was waited for without"
+      " a worker thread (param: fetch_park)")
 VSC_F(fetch_head,		uint64_t, 1, 'a', "Fetch head", "")
 VSC_F(fetch_length,		uint64_t, 1, 'a', "Fetch with Length", "")
 VSC_F(fetch_chunked,		uint64_t, 1, 'a', "Fetch chunked", "")
@@ -140,6 +160,10 @@ VSC_F(fetch_oldhttp,		uint64_t, 1, 'a',
     "Fetch pre HTTP/1.1 closed", "")
 VSC_F(fetch_zero,		uint64_t, 1, 'a', "Fetch zero len", "")
 VSC_F(fetch_failed,		uint64_t, 1, 'a', "Fetch failed", "")
+VSC_F(fetch_reads,		uint64_t, 1, 'c', "Fetch read calls",
+	"Count of read(2) calls on backend connections, for headers and "
+	"body, by fetches which got as far as the body.  The number of "
+	"reads for each fetch is in its Fetch_Body log record.")
 VSC_F(fetch_1xx,		uint64_t, 1, 'a', "Fetch no body (1xx)", "")
 VSC_F(fetch_204,		uint64_t, 1, 'a', "Fetch no body (204)", "")
 VSC_F(fetch_304,		uint64_t, 1, 'a', "Fetch no body (304)", "")
@@ -271,16 +295,26 @@ VSC_F(losthdr,		uint64_t, 0, 'a', "HTTP header overflows", "")
 VSC_F(n_objsendfile,	uint64_t, 0, 'a', "Objects sent with sendfile",
       "The number of objects sent with the sendfile system call. If enabled "
       "sendfile will be used on object larger than a certain size.")
+VSC_F(n_objsendasync,	uint64_t, 0, 'a', "Objects sent by the sender",
+      "The number of object bodies handed to the sender thread, because "
+      "they were larger than param send_async_threshold.")
 VSC_F(n_objwrite,		uint64_t, 0, 'a', "Objects sent with write",
       "The number of objects sent with regular write calls."
       "Writes are used when the objects are too small for sendfile "
       "or if the sendfile call has been disabled")
 VSC_F(n_objoverflow,	uint64_t, 1, 'a',
 					"Objects overflowing workspace", "")
+VSC_F(n_objhdrblk,	uint64_t, 0, 'a', "Objects sent with prebuilt headers",
+      "The number of responses whose object headers went out as one "
+      "block, serialized when the object was inserted.  Responses "
+      "where vcl_deliver{} or the delivery code removed any of them "
+      "are built header by header instead.")
 
 VSC_F(s_sess,		uint64_t, 1, 'a', "Total Sessions", "")
 VSC_F(s_req,		uint64_t, 1, 'a', "Total Requests", "")
 VSC_F(s_pipe,		uint64_t, 1, 'a', "Total pipe", "")
+VSC_F(pipe_handoff,	uint64_t, 1, 'a', "Pipes handed off",
+      "Count of pipes handed to the pipe thread (param: pipe_thread)")
 VSC_F(s_pass,		uint64_t, 1, 'a', "Total pass", "")
 VSC_F(s_fetch,		uint64_t, 1, 'a', "Total fetch", "")
 VSC_F(s_hdrbytes,		uint64_t, 1, 'a', "Total header bytes", "")
@@ -356,10 +390,15 @@ VSC_F(bans_dups,		uint64_t, 0, 'c',
 
 /**********************************************************************/
 
-VSC_F(hcb_nolock,		uint64_t, 0, 'a',
-    "HCB Lookups without lock", "")
-VSC_F(hcb_lock,		uint64_t, 0, 'a', "HCB Lookups with lock", "")
-VSC_F(hcb_insert,		uint64_t, 0, 'a', "HCB Inserts", "")
+VSC_F(hcl_buckets,		uint64_t, 0, 'g', "HCL Buckets",
+	"Number of buckets in use by the classic hash (-hclassic)")
+VSC_F(hcl_load,		uint64_t, 0, 'g', "HCL Load factor (%)",
+	"Number of objheads per 100 buckets in the classic hash")
+VSC_F(hcl_chain,		uint64_t, 0, 'g', "HCL Average chain (%)",
+	"Number of objheads per 100 non-empty buckets in the classic hash")
+VSC_F(hop_resize,		uint64_t, 0, 'a', "HOP Table resizes",
+	"Count of times a shard of the open addressing hash started"
+	" to grow or shrink its table (-hopen)")
 
 VSC_F(esi_errors,		uint64_t, 0, 'a',
     "ESI parse errors (unlock)", "")
@@ -120,3 +120,224 @@ VSC_F(surplus,			uint64_t, 0, 'c', "Too many for pool", "")
 VSC_F(randry,			uint64_t, 0, 'c', "Pool ran dry", "")
 
 #endif
+
+/**********************************************************************
+ * Thread pools
+ *    see: cache_pool.c
+ */
+
+#ifdef VSC_DO_POOL
+
+VSC_F(threads,			uint64_t, 0, 'g',
+    "Threads in pool",
+	"Number of worker threads in this pool."
+)
+
+VSC_F(queue_len,		uint64_t, 0, 'g',
+    "Length of session queue",
+	"Number of sessions in this pool waiting for a thread."
+)
+
+VSC_F(sess_queued,		uint64_t, 0, 'c',
+    "Sessions queued for thread",
+	"Count of sessions which had to be queued waiting for a thread."
+)
+
+VSC_F(sess_dropped,		uint64_t, 0, 'c',
+    "Sessions dropped for thread",
+	"Count of sessions dropped because the queue was too long."
+	"  See also param queue_max."
+)
+
+VSC_F(cpus,			uint64_t, 0, 'g',
+    "CPUs bound",
+	"Number of CPUs the threads of this pool are bound to."
+	"  Zero if the pool is not bound."
+	"  See also param thread_pool_affinity."
+)
+
+VSC_F(sess_local,		uint64_t, 0, 'c',
+    "Sessions run on pool CPUs",
+	"Count of sessions picked up by a worker thread running on one of"
+	" the CPUs the pool is bound to."
+	"  Only counted for bound pools."
+)
+
+VSC_F(sess_remote,		uint64_t, 0, 'c',
+    "Sessions run off pool CPUs",
+	"Count of sessions picked up by a worker thread running outside"
+	" the CPUs the pool is bound to."
+	"  Only counted for bound pools."
+)
+
+VSC_F(contended,		uint64_t, 0, 'c',
+    "Hand-off contention",
+	"Count of times a thread had to wait or retry to hand a session"
+	" to or from the pool."
+	"  For mutex pools this counts collisions on the pool lock,"
+	" for lock-free pools it counts failed compare-and-swaps."
+	"  See also param thread_pool_lockfree."
+)
+
+VSC_F(steals,			uint64_t, 0, 'c',
+    "Sessions taken from siblings",
+	"Count of sessions threads in this pool took over from other"
+	" pools, either by stealing from their queue or because the"
+	" other pool had no idle threads."
+	"  See also param thread_pool_steal."
+)
+
+VSC_F(qlat_ewma,		uint64_t, 0, 'g',
+    "Queue latency, average (us)",
+	"Moving average of the time sessions waited for a thread, in"
+	" microseconds."
+)
+
+VSC_F(qlat_p95,			uint64_t, 0, 'g',
+    "Queue latency, 95th pct (us)",
+	"Estimate of the 95th percentile of the time sessions waited for"
+	" a thread, in microseconds.  Rounded up to a power of two."
+)
+
+VSC_F(qlat_100us,		uint64_t, 0, 'c',
+    "Queue latency < 100us",
+	"Count of sessions which waited less than 100 microseconds for"
+	" a thread."
+)
+
+VSC_F(qlat_1ms,			uint64_t, 0, 'c',
+    "Queue latency < 1ms",
+	"Count of sessions which waited 100 microseconds to 1 millisecond"
+	" for a thread."
+)
+
+VSC_F(qlat_10ms,		uint64_t, 0, 'c',
+    "Queue latency < 10ms",
+	"Count of sessions which waited 1 to 10 milliseconds for a"
+	" thread."
+)
+
+VSC_F(qlat_100ms,		uint64_t, 0, 'c',
+    "Queue latency < 100ms",
+	"Count of sessions which waited 10 to 100 milliseconds for a"
+	" thread."
+)
+
+VSC_F(qlat_1s,			uint64_t, 0, 'c',
+    "Queue latency < 1s",
+	"Count of sessions which waited 100 milliseconds to 1 second for"
+	" a thread."
+)
+
+VSC_F(qlat_slow,		uint64_t, 0, 'c',
+    "Queue latency >= 1s",
+	"Count of sessions which waited a second or more for a thread."
+)
+
+#endif
+
+/**********************************************************************
+ * Waiter shards
+ *    see: cache_waiter_epoll.c
+ */
+
+#ifdef VSC_DO_WAITER
+
+VSC_F(sess_wait,		uint64_t, 0, 'g',
+    "Sessions waiting",
+	"Number of idle sessions this waiter shard is watching."
+)
+
+VSC_F(sess_handled,		uint64_t, 0, 'c',
+    "Sessions handed back",
+	"Count of sessions with new data this shard handed back to their"
+	" pool."
+)
+
+VSC_F(sess_timeout,		uint64_t, 0, 'c',
+    "Sessions timed out",
+	"Count of sessions this shard closed because of timeout_idle."
+)
+
+VSC_F(sess_closed,		uint64_t, 0, 'c',
+    "Sessions closed by client",
+	"Count of sessions this shard closed because the client went"
+	" away or the connection failed."
+)
+
+VSC_F(wakeups,			uint64_t, 0, 'c',
+    "Wakeups",
+	"Count of times the shard thread woke up with events."
+)
+
+#endif
+
+/**********************************************************************
+ * Session memory of a thread pool
+ *    see: cache_session.c
+ */
+
+#ifdef VSC_DO_SESSMEM
+
+VSC_F(sessmem,			uint64_t, 0, 'g',
+    "Session structures",
+	"Number of session structures allocated by this pool, in use or"
+	" cached for reuse."
+)
+
+VSC_F(depot,			uint64_t, 0, 'g',
+    "Session structures in depot",
+	"Number of free session structures held by the pool, not counting"
+	" those cached by the worker threads."
+)
+
+VSC_F(depot_swaps,		uint64_t, 0, 'c',
+    "Magazine swaps",
+	"Count of times a worker thread traded a magazine with the depot."
+	"  Allocations and frees which do not need this take no locks."
+)
+
+VSC_F(slabs,			uint64_t, 0, 'g',
+    "Slabs",
+	"Number of slabs session structures are carved from."
+)
+
+VSC_F(slab_bytes,		uint64_t, 0, 'g',
+    "Slab bytes",
+	"Bytes of memory in slabs."
+)
+
+VSC_F(slab_live,		uint64_t, 0, 'g',
+    "Slab structures in use",
+	"Number of session structures carved from the slabs which have not"
+	" been given back.  Together with slab_bytes and sessmem_size this"
+	" gives the occupancy of the slabs."
+)
+
+#endif
+
+/**********************************************************************
+ * Critbit hash shards
+ *    see: hash_critbit.c
+ */
+
+#ifdef VSC_DO_HCB
+
+VSC_F(nolock,			uint64_t, 0, 'c',
+    "Lookups without lock",
+	"Count of lookups in this shard which walked the tree without"
+	" taking the shard lock."
+)
+
+VSC_F(lock,			uint64_t, 0, 'c',
+    "Lookups with lock",
+	"Count of lookups in this shard which had to take the shard lock,"
+	" to insert or because the tree changed under them."
+)
+
+VSC_F(insert,			uint64_t, 0, 'c',
+    "Inserts",
+	"Count of objheads inserted in this shard."
+)
+
+#endif
@@ -36,6 +36,10 @@
 #define VSC_TYPE_VBE		"VBE"
 #define VSC_TYPE_LCK		"LCK"
 #define VSC_TYPE_MEMPOOL	"MEMPOOL"
+#define VSC_TYPE_POOL		"POOL"
+#define VSC_TYPE_WAITER		"WAITER"
+#define VSC_TYPE_SESSMEM	"SESSMEM"
+#define VSC_TYPE_HCB		"HCB"
 
 #define VSC_F(n, t, l, f, e, d)	t n;
 
@@ -32,6 +32,7 @@ struct vss_addr;
 int VSS_parse(const char *str, char **addr, char **port);
 int VSS_resolve(const char *addr, const char *port, struct vss_addr ***ta);
 int VSS_bind(const struct vss_addr *addr);
+int VSS_bind_reuseport(const struct vss_addr *addr, int like);
 int VSS_listen(const struct vss_addr *addr, int depth);
 int VSS_connect(const struct vss_addr *addr, int nonblock);
 int VSS_open(const char *str, double tmo);
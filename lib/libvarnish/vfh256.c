@@ -0,0 +1,200 @@
+/*-
+ * Copyright (c) 2012 Varnish Software AS
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * A fast 256 bit digest for the hash key.
+ *
+ * The input is consumed 32 bytes at a time, one 64 bit word into each of
+ * four lanes, with the round function of xxHash64.  At the end the
+ * lanes are folded together and the result mixed back into each, so
+ * every output bit depends on all of the input.  It spreads URLs well, but it is NOT collision resistant: with
+ * control over what goes into the hash, finding two keys which collide
+ * is easy, so it is only fit for use where all the hash inputs are
+ * trusted.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "vas.h"
+#include "vend.h"
+#include "vfh256.h"
+
+#define P1	0x9e3779b185ebca87ULL
+#define P2	0xc2b2ae3d27d4eb4fULL
+#define P3	0x165667b19e3779f9ULL
+#define P4	0x85ebca77c2b2ae63ULL
+#define P5	0x27d4eb2f165667c5ULL
+
+#define ROTL(x, n)	(((x) << (n)) | ((x) >> (64 - (n))))
+
+static inline uint64_t
+vfh_round(uint64_t v, uint64_t in)
+{
+
+	v += in * P2;
+	v = ROTL(v, 31);
+	return (v * P1);
+}
+
+static inline uint64_t
+vfh_avalanche(uint64_t h)
+{
+
+	h ^= h >> 33;
+	h *= P2;
+	h ^= h >> 29;
+	h *= P3;
+	h ^= h >> 32;
+	return (h);
+}
+
+static void
+vfh_stripes(uint64_t *v, const unsigned char *p, size_t n)
+{
+	uint64_t v0, v1, v2, v3;
+
+	v0 = v[0];
+	v1 = v[1];
+	v2 = v[2];
+	v3 = v[3];
+	for (; n > 0; n--, p += 32) {
+		v0 = vfh_round(v0, vle64dec(p));
+		v1 = vfh_round(v1, vle64dec(p + 8));
+		v2 = vfh_round(v2, vle64dec(p + 16));
+		v3 = vfh_round(v3, vle64dec(p + 24));
+	}
+	v[0] = v0;
+	v[1] = v1;
+	v[2] = v2;
+	v[3] = v3;
+}
+
+void
+VFH256_Init(struct VFH256Context *ctx)
+{
+
+	ctx->v[0] = P1 + P2;
+	ctx->v[1] = P2;
+	ctx->v[2] = 0;
+	ctx->v[3] = -P1;
+	ctx->count = 0;
+}
+
+void
+VFH256_Update(struct VFH256Context *ctx, const void *in, size_t len)
+{
+	const unsigned char *src = in;
+	size_t r, l;
+
+	ctx->count += len;
+
+	/* Bytes left in the buffer from previous updates */
+	r = (ctx->count - len) & 0x1f;
+	if (r > 0) {
+		l = 32 - r;
+		if (l > len) {
+			memcpy(ctx->buf + r, src, len);
+			return;
+		}
+		memcpy(ctx->buf + r, src, l);
+		vfh_stripes(ctx->v, ctx->buf, 1);
+		src += l;
+		len -= l;
+	}
+	if (len >= 32) {
+		vfh_stripes(ctx->v, src, len / 32);
+		src += len & ~(size_t)0x1f;
+		len &= 0x1f;
+	}
+	memcpy(ctx->buf, src, len);
+}
+
+void
+VFH256_Final(unsigned char digest[VFH256_LEN], struct VFH256Context *ctx)
+{
+	uint64_t *v = ctx->v, h;
+	size_t r;
+	int i;
+
+	/* The tail is zero padded, the length tells it from real zeros */
+	r = ctx->count & 0x1f;
+	if (r > 0) {
+		memset(ctx->buf + r, 0, 32 - r);
+		vfh_stripes(v, ctx->buf, 1);
+	}
+	/* Fold all lanes and the length together, then back into each */
+	h = ctx->count * P5;
+	for (i = 0; i < 4; i++)
+		h = vfh_round(h, v[i]);
+	h = vfh_avalanche(h);
+	for (i = 0; i < 4; i++)
+		v[i] = vfh_avalanche(v[i] ^ (h + i * P3));
+
+	for (i = 0; i < 4; i++)
+		vle64enc(digest + i * 8, v[i]);
+	memset(ctx, 0, sizeof *ctx);
+}
+
+/*
+ * A few test-vectors, to catch any change to the output, which would
+ * invalidate persistent storage.
+ */
+
+static const struct vfh256test {
+	const char		*input;
+	const unsigned char	output[32];
+} vfh256test[] = {
+    { "",
+	{0x4e, 0xeb, 0x93, 0x70, 0x10, 0xdd, 0x9f, 0x9d, 0xe7, 0x7a, 0x56,
+	 0xb2, 0xad, 0x68, 0x78, 0x98, 0x0b, 0x7a, 0xcf, 0xa8, 0x72, 0x30,
+	 0x61, 0xbb, 0x7a, 0xa6, 0xf5, 0xf8, 0xa1, 0x34, 0xb8, 0xf1} },
+    { "message digest",
+	{0x41, 0xf2, 0x9c, 0x2e, 0x0b, 0xf1, 0xb8, 0x84, 0xc7, 0xec, 0x19,
+	 0xeb, 0x5b, 0x9a, 0xcf, 0xad, 0x1b, 0xd8, 0x9a, 0xab, 0x78, 0x61,
+	 0xdd, 0x9f, 0xf7, 0x03, 0xcf, 0x65, 0x03, 0x0d, 0x98, 0xb9} },
+    { "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789",
+	{0x23, 0x28, 0x9c, 0xa4, 0xfb, 0x55, 0x64, 0x9b, 0x14, 0xf6, 0xd6,
+	 0xa0, 0xd4, 0x3e, 0xe2, 0xed, 0x7a, 0xf3, 0x0c, 0x6c, 0xbc, 0x09,
+	 0x70, 0x77, 0xf9, 0xf5, 0x3d, 0xde, 0x4d, 0x30, 0x84, 0x98} },
+    { NULL }
+};
+
+void
+VFH256_Test(void)
+{
+	struct VFH256Context c;
+	const struct vfh256test *p;
+	unsigned char o[32];
+
+	for (p = vfh256test; p->input != NULL; p++) {
+		VFH256_Init(&c);
+		VFH256_Update(&c, p->input, strlen(p->input));
+		VFH256_Final(o, &c);
+		assert(!memcmp(o, p->output, 32));
+	}
+}
@@ -43,6 +43,12 @@
 #include <stdint.h>
 #include <string.h>
 
+#if defined(__x86_64__) && defined(__GNUC__) && defined(HAVE_CPUID_H)
+#include <cpuid.h>
+#include <immintrin.h>
+#define VSHA256_SHANI
+#endif
+
 #include "vas.h"
 #include "vend.h"
 #include "vsha256.h"
@@ -203,6 +209,125 @@ SHA256_Transform(uint32_t * state, const unsigned char block[64])
 		state[i] += S[i];
 }
 
+/*
+ * Compress nblk consecutive blocks.  This is where the time goes, so
+ * on CPUs with the SHA extensions we let the hardware do it.
+ */
+
+static void
+sha256_blocks_c(uint32_t *state, const unsigned char *data, size_t nblk)
+{
+
+	for (; nblk > 0; nblk--, data += 64)
+		SHA256_Transform(state, data);
+}
+
+#ifdef VSHA256_SHANI
+
+static const uint32_t sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+/*
+ * The SHA-NI instructions work on the state as ABEF and CDGH, and do
+ * two rounds per sha256rnds2, with the message schedule for the next
+ * four words coming out of sha256msg1/sha256msg2.
+ */
+
+__attribute__((target("sha,sse4.1")))
+static void
+sha256_blocks_shani(uint32_t *state, const unsigned char *data, size_t nblk)
+{
+	__m128i s0, s1, abef, cdgh, m[4], t, mask;
+	int i;
+
+	mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	t = _mm_shuffle_epi32(_mm_loadu_si128((const void *)&state[0]), 0xb1);
+	s1 = _mm_shuffle_epi32(_mm_loadu_si128((const void *)&state[4]), 0x1b);
+	s0 = _mm_alignr_epi8(t, s1, 8);
+	s1 = _mm_blend_epi16(s1, t, 0xf0);
+
+	for (; nblk > 0; nblk--, data += 64) {
+		abef = s0;
+		cdgh = s1;
+		for (i = 0; i < 4; i++)
+			m[i] = _mm_shuffle_epi8(
+			    _mm_loadu_si128((const void *)(data + i * 16)),
+			    mask);
+		for (i = 0; i < 16; i++) {
+			t = _mm_add_epi32(m[i & 3],
+			    _mm_loadu_si128((const void *)&sha256_k[i * 4]));
+			s1 = _mm_sha256rnds2_epu32(s1, s0, t);
+			s0 = _mm_sha256rnds2_epu32(s0, s1,
+			    _mm_shuffle_epi32(t, 0x0e));
+			if (i >= 12)
+				continue;
+			/* W[4i+16 ... 4i+19] replaces W[4i ... 4i+3] */
+			t = _mm_sha256msg1_epu32(m[i & 3], m[(i + 1) & 3]);
+			t = _mm_add_epi32(t,
+			    _mm_alignr_epi8(m[(i + 3) & 3], m[(i + 2) & 3], 4));
+			m[i & 3] = _mm_sha256msg2_epu32(t, m[(i + 3) & 3]);
+		}
+		s0 = _mm_add_epi32(s0, abef);
+		s1 = _mm_add_epi32(s1, cdgh);
+	}
+
+	t = _mm_shuffle_epi32(s0, 0x1b);
+	s1 = _mm_shuffle_epi32(s1, 0xb1);
+	_mm_storeu_si128((void *)&state[0], _mm_blend_epi16(t, s1, 0xf0));
+	_mm_storeu_si128((void *)&state[4], _mm_alignr_epi8(s1, t, 8));
+}
+
+static int
+sha256_has_shani(void)
+{
+	unsigned a, b, c, d;
+
+	if (__get_cpuid_max(0, NULL) < 7)
+		return (0);
+	__cpuid(1, a, b, c, d);
+	if (!(c & bit_SSSE3) || !(c & bit_SSE4_1))
+		return (0);
+	__cpuid_count(7, 0, a, b, c, d);
+	return ((b & (1U << 29)) != 0);		/* SHA */
+}
+
+#endif
+
+static void sha256_blocks_probe(uint32_t *, const unsigned char *, size_t);
+
+/* Set on first use, racing here is harmless */
+static void (*sha256_blocks)(uint32_t *, const unsigned char *, size_t) =
+    sha256_blocks_probe;
+
+static void
+sha256_blocks_probe(uint32_t *state, const unsigned char *data, size_t nblk)
+{
+
+#ifdef VSHA256_SHANI
+	if (sha256_has_shani())
+		sha256_blocks = sha256_blocks_shani;
+	else
+#endif
+		sha256_blocks = sha256_blocks_c;
+	sha256_blocks(state, data, nblk);
+}
+
 static const unsigned char PAD[64] = {
 	0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
 	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
@@ -259,20 +384,29 @@ SHA256_Update(SHA256_CTX * ctx, const void *in, size_t len)
 	uint32_t r, l;
 	const unsigned char *src = in;
 
+	ctx->count += len;
+
 	/* Number of bytes left in the buffer from previous updates */
-	r = ctx->count & 0x3f;
-	while (len > 0) {
+	r = (ctx->count - len) & 0x3f;
+	if (r > 0) {
 		l = 64 - r;
-		if (l > len)
-			l = len;
+		if (l > len) {
+			memcpy(&ctx->buf[r], src, len);
+			return;
+		}
 		memcpy(&ctx->buf[r], src, l);
+		sha256_blocks(ctx->state, ctx->buf, 1);
 		len -= l;
 		src += l;
-		ctx->count += l;
-		r = ctx->count & 0x3f;
-		if (r == 0)
-			SHA256_Transform(ctx->state, ctx->buf);
 	}
+
+	/* Whole blocks straight from the input */
+	if (len >= 64) {
+		sha256_blocks(ctx->state, src, len / 64);
+		src += len & ~(size_t)0x3f;
+		len &= 0x3f;
+	}
+	memcpy(ctx->buf, src, len);
 }
 
 /*
@@ -332,3 +466,113 @@ SHA256_Test(void)
 	}
 }
 
+
+#ifdef VSHA256_C_TEST
+/*
+ * Check the block functions against each other, and with -b, time them
+ * and the fast digest on hash inputs the size of typical URLs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "vfh256.h"
+
+static const char * const vsha256_urls[] = {
+	"/#www.example.com#",
+	"/images/logo.png#www.example.com#",
+	"/news/2012/02/07/some-article-about-something.html?ref=front"
+	    "#www.example.com#",
+	"/search?q=varnish+cache&lang=en&page=2&sort=date&filter=none"
+	    "&utm_source=newsletter&utm_medium=email#www.example.com#",
+};
+
+static volatile unsigned vsha256_sink;
+
+static void
+vsha256_bench(const char *name, unsigned which)
+{
+	struct SHA256Context c;
+	struct VFH256Context f;
+	unsigned char o[32];
+	struct timespec t0, t1;
+	const char *p;
+	unsigned i, u;
+	size_t l;
+	double d;
+
+	for (i = 0; i < sizeof vsha256_urls / sizeof *vsha256_urls; i++) {
+		p = vsha256_urls[i];
+		l = strlen(p);
+		(void)clock_gettime(CLOCK_MONOTONIC, &t0);
+		for (u = 0; u < 1000000; u++) {
+			if (which == 2) {
+				VFH256_Init(&f);
+				VFH256_Update(&f, p, l);
+				VFH256_Final(o, &f);
+			} else {
+				SHA256_Init(&c);
+				SHA256_Update(&c, p, l);
+				SHA256_Final(o, &c);
+			}
+			vsha256_sink += o[0];
+		}
+		(void)clock_gettime(CLOCK_MONOTONIC, &t1);
+		d = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+		printf("%-8s %3zu bytes: %6.1f ns/digest\n", name, l, d / u);
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	SHA256_CTX c;
+	unsigned char buf[1024], o1[32], o2[32];
+	unsigned u, i, n, m, ec = 0;
+
+	(void)argc;
+	SHA256_Test();
+	VFH256_Test();
+	srandom(42);
+	for (u = 0; u < 100000; u++) {
+		n = random() % sizeof buf;
+		for (i = 0; i < n; i++)
+			buf[i] = (unsigned char)random();
+
+		sha256_blocks = sha256_blocks_c;
+		SHA256_Init(&c);
+		SHA256_Update(&c, buf, n);
+		SHA256_Final(o1, &c);
+
+		/* Whatever the CPU has, fed in random pieces */
+		sha256_blocks = sha256_blocks_probe;
+		SHA256_Init(&c);
+		for (i = 0; i < n; i += m) {
+			m = random() % 100;
+			if (m > n - i)
+				m = n - i;
+			SHA256_Update(&c, buf + i, m);
+		}
+		SHA256_Final(o2, &c);
+		if (memcmp(o1, o2, sizeof o1)) {
+			printf("%s: mismatch at %u bytes\n", *argv, n);
+			ec++;
+		}
+	}
+	if (argc > 1 && !strcmp(argv[1], "-b")) {
+		sha256_blocks = sha256_blocks_c;
+		vsha256_bench("sha256", 0);
+#ifdef VSHA256_SHANI
+		if (sha256_has_shani()) {
+			sha256_blocks = sha256_blocks_shani;
+			vsha256_bench("sha-ni", 1);
+		}
+#endif
+		vsha256_bench("vfh256", 2);
+	}
+	if (!ec)
+		printf("OK\n");
+	return (ec > 0);
+}
+#endif
@@ -189,9 +189,11 @@ VSS_resolve(const char *addr, const char *port, struct vss_addr ***vap)
  * avoid conflicts between INADDR_ANY and IN6ADDR_ANY.
  */
 
-int
-VSS_bind(const struct vss_addr *va)
+static int
+vss_bind(const struct vss_addr *va, int reuseport, int like)
 {
+	struct sockaddr_storage ss;
+	socklen_t sl;
 	int sd, val;
 
 	sd = socket(va->va_family, va->va_socktype, va->va_protocol);
@@ -205,6 +207,17 @@ VSS_bind(const struct vss_addr *va)
 		(void)close(sd);
 		return (-1);
 	}
+#ifdef SO_REUSEPORT
+	val = 1;
+	if (reuseport &&
+	    setsockopt(sd, SOL_SOCKET, SO_REUSEPORT, &val, sizeof val) != 0) {
+		perror("setsockopt(SO_REUSEPORT, 1)");
+		(void)close(sd);
+		return (-1);
+	}
+#else
+	AZ(reuseport);
+#endif
 #ifdef IPV6_V6ONLY
 	/* forcibly use separate sockets for IPv4 and IPv6 */
 	val = 1;
@@ -215,7 +228,19 @@ VSS_bind(const struct vss_addr *va)
 		return (-1);
 	}
 #endif
-	if (bind(sd, (const void*)&va->va_addr, va->va_addrlen) != 0) {
+	if (like >= 0) {
+		/* Same address, including the port the kernel picked */
+		sl = sizeof ss;
+		if (getsockname(like, (void*)&ss, &sl) != 0) {
+			perror("getsockname()");
+			(void)close(sd);
+			return (-1);
+		}
+	} else {
+		memcpy(&ss, &va->va_addr, va->va_addrlen);
+		sl = va->va_addrlen;
+	}
+	if (bind(sd, (const void*)&ss, sl) != 0) {
 		perror("bind()");
 		(void)close(sd);
 		return (-1);
@@ -223,6 +248,38 @@ VSS_bind(const struct vss_addr *va)
 	return (sd);
 }
 
+int
+VSS_bind(const struct vss_addr *va)
+{
+
+	return (vss_bind(va, 0, -1));
+}
+
+/*
+ * As VSS_bind(), but with SO_REUSEPORT, so several sockets can be bound
+ * to the same address and the kernel spreads connections between them.
+ *
+ * If 'like' is a socket, bind to its local address instead of the
+ * requested one, so that clones of a socket bound to port zero get the
+ * port it was given.
+ *
+ * Fails with ENOPROTOOPT where SO_REUSEPORT is not available.
+ */
+
+int
+VSS_bind_reuseport(const struct vss_addr *va, int like)
+{
+
+#ifdef SO_REUSEPORT
+	return (vss_bind(va, 1, like));
+#else
+	(void)va;
+	(void)like;
+	errno = ENOPROTOOPT;
+	return (-1);
+#endif
+}
+
 /*
  * Given a struct vss_addr, open a socket of the appropriate type, bind it
  * to the requested address, and start listening.
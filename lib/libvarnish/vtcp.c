@@ -157,6 +157,27 @@ VTCP_filter_http(int sock)
 #endif
 }
 
+/*--------------------------------------------------------------------
+ * Enable TCP Fast Open on a listen socket, with a queue of 'qlen'
+ * pending handshakes.
+ */
+
+int
+VTCP_fastopen(int sock, unsigned qlen)
+{
+#ifdef TCP_FASTOPEN
+	int i;
+
+	i = qlen;
+	return (setsockopt(sock, IPPROTO_TCP, TCP_FASTOPEN, &i, sizeof i));
+#else
+	(void)sock;
+	(void)qlen;
+	errno = ENOPROTOOPT;
+	return (-1);
+#endif
+}
+
 /*--------------------------------------------------------------------
  * Functions for controlling NONBLOCK mode.
  *